@@ -0,0 +1,38 @@
+#ifndef _ASM_X86_CRC32_H
+#define _ASM_X86_CRC32_H
+
+#include <linux/types.h>
+#include <asm/cpufeature.h>
+#include <asm/i387.h>
+
+/*
+ * crc32_pclmul_le_16() folds 16 byte aligned buffers of at least
+ * 64 bytes; lib/crc32.c does the unaligned head and the tail.
+ */
+#define ARCH_CRC32_LE_ALIGN	16
+#define ARCH_CRC32_LE_MIN	64
+
+extern u32 crc32_pclmul_le_16(unsigned char const *buffer, size_t len,
+			      u32 crc);
+
+/*
+ * Fold as much of @p (ARCH_CRC32_LE_ALIGN aligned, at least
+ * ARCH_CRC32_LE_MIN long) into *@crc as possible.  Returns the number
+ * of bytes consumed, 0 if the FPU can not be used here.
+ */
+static inline size_t arch_crc32_le(u32 *crc, unsigned char const *p,
+				   size_t len)
+{
+	size_t bulk = len & ~(size_t)(ARCH_CRC32_LE_ALIGN - 1);
+
+	if (!cpu_has_pclmulqdq || !irq_fpu_usable())
+		return 0;
+
+	kernel_fpu_begin();
+	*crc = crc32_pclmul_le_16(p, bulk, *crc);
+	kernel_fpu_end();
+
+	return bulk;
+}
+
+#endif /* _ASM_X86_CRC32_H */
@@ -337,6 +337,53 @@ int ptep_clear_flush_young(struct vm_area_struct *vma,
 	return young;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+int pmdp_set_access_flags(struct vm_area_struct *vma,
+			  unsigned long address, pmd_t *pmdp,
+			  pmd_t entry, int dirty)
+{
+	int changed = !pmd_same(*pmdp, entry);
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	if (changed && dirty) {
+		*pmdp = entry;
+		flush_tlb_range(vma, address, address + HPAGE_PMD_SIZE);
+	}
+
+	return changed;
+}
+
+int pmdp_test_and_clear_young(struct vm_area_struct *vma,
+			      unsigned long addr, pmd_t *pmdp)
+{
+	int ret = 0;
+
+	if (pmd_young(*pmdp))
+		ret = test_and_clear_bit(_PAGE_BIT_ACCESSED,
+					 (unsigned long *)pmdp);
+
+	return ret;
+}
+
+/*
+ * Make a huge pmd non-present and flush it out of the TLBs, returning
+ * its last value with the accessed and dirty bits the CPUs set.  Used
+ * before the pmd is replaced by a pte table, so that no CPU ever holds
+ * both the 2MB and the 4KB translations of the same address.
+ */
+pmd_t pmdp_invalidate(struct mm_struct *mm, pmd_t *pmdp)
+{
+	pmd_t pmd;
+
+	pmd = native_make_pmd(xchg(&pmdp->pmd,
+				   pmd_val(pmd_mknotpresent(*pmdp))));
+	flush_tlb_mm(mm);
+
+	return pmd;
+}
+#endif
+
 /**
  * reserve_top_address - reserves a hole in the top of kernel address space
  * @reserve - size of hole to reserve
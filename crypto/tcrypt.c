@@ -26,6 +26,7 @@
 #include <linux/jiffies.h>
 #include <linux/timex.h>
 #include <linux/interrupt.h>
+#include <linux/vmalloc.h>
 #include "tcrypt.h"
 #include "internal.h"
 
@@ -57,7 +58,7 @@ static char *check[] = {
 	"cast6", "arc4", "michael_mic", "deflate", "crc32c", "tea", "xtea",
 	"khazad", "wp512", "wp384", "wp256", "tnepres", "xeta",  "fcrypt",
 	"camellia", "seed", "salsa20", "rmd128", "rmd160", "rmd256", "rmd320",
-	"lzo", "cts", "zlib", NULL
+	"lzo", "cts", "zlib", "lz4", NULL
 };
 
 static int test_cipher_jiffies(struct blkcipher_desc *desc, int enc,
@@ -711,6 +712,203 @@ out:
 	crypto_free_ahash(tfm);
 }
 
+/*
+ * Test data for test_comp_speed(): runs of zeroes, a few random bytes and
+ * words from a small vocabulary.  It compresses to roughly half with lzo,
+ * which is about what anonymous memory in compressed swap does.
+ */
+static void test_comp_fill(char *buf, unsigned int len)
+{
+	static const char * const words[] = {
+		"the ", "page ", "struct ", "kernel ", "return ", "memory ",
+		"if (", ") {\n\t", "NULL", "swap ", "0x", "int ",
+	};
+	const char *w;
+	unsigned int i = 0, n;
+	u32 seed = 1;
+
+	while (i < len) {
+		seed = seed * 1103515245 + 12345;
+		switch ((seed >> 16) & 3) {
+		case 0:
+			for (n = (seed >> 18) & 31; n && i < len; n--)
+				buf[i++] = 0;
+			break;
+		case 1:
+			buf[i++] = seed >> 24;
+			break;
+		default:
+			w = words[(seed >> 18) % ARRAY_SIZE(words)];
+			while (*w && i < len)
+				buf[i++] = *w++;
+			break;
+		}
+	}
+}
+
+static inline int do_one_comp_op(struct crypto_comp *tfm, int enc,
+				 const char *src, unsigned int slen,
+				 char *dst, unsigned int dlen)
+{
+	if (enc)
+		return crypto_comp_compress(tfm, src, slen, dst, &dlen);
+	return crypto_comp_decompress(tfm, src, slen, dst, &dlen);
+}
+
+static int test_comp_jiffies(struct crypto_comp *tfm, int enc,
+			     const char *src, unsigned int slen,
+			     char *dst, unsigned int dlen,
+			     unsigned int blen, int sec)
+{
+	unsigned long start, end;
+	int bcount;
+	int ret;
+
+	for (start = jiffies, end = start + sec * HZ, bcount = 0;
+	     time_before(jiffies, end); bcount++) {
+		ret = do_one_comp_op(tfm, enc, src, slen, dst, dlen);
+		if (ret)
+			return ret;
+	}
+
+	printk("%6u opers/sec, %9lu bytes/sec\n",
+	       bcount / sec, ((long)bcount * blen) / sec);
+
+	return 0;
+}
+
+static int test_comp_cycles(struct crypto_comp *tfm, int enc,
+			    const char *src, unsigned int slen,
+			    char *dst, unsigned int dlen, unsigned int blen)
+{
+	unsigned long cycles = 0;
+	int ret = 0;
+	int i;
+
+	local_bh_disable();
+	local_irq_disable();
+
+	/* Warm-up run. */
+	for (i = 0; i < 4; i++) {
+		ret = do_one_comp_op(tfm, enc, src, slen, dst, dlen);
+		if (ret)
+			goto out;
+	}
+
+	/* The real thing. */
+	for (i = 0; i < 8; i++) {
+		cycles_t start, end;
+
+		start = get_cycles();
+
+		ret = do_one_comp_op(tfm, enc, src, slen, dst, dlen);
+		if (ret)
+			goto out;
+
+		end = get_cycles();
+
+		cycles += end - start;
+	}
+
+out:
+	local_irq_enable();
+	local_bh_enable();
+
+	if (ret)
+		return ret;
+
+	printk("%6lu cycles/operation, %4lu cycles/byte\n",
+	       cycles / 8, cycles / (8 * blen));
+
+	return 0;
+}
+
+/*
+ * Speed is reported in uncompressed bytes for both directions, so the
+ * numbers of different algorithms can be compared directly.
+ */
+static void test_comp_speed(const char *algo, unsigned int sec,
+			    unsigned int *blens)
+{
+	struct crypto_comp *tfm;
+	unsigned int i, blen, clen, dlen, max = 0;
+	char *src, *comp, *decomp;
+	int ret;
+
+	printk(KERN_INFO "\ntesting speed of %s\n", algo);
+
+	tfm = crypto_alloc_comp(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		printk(KERN_ERR "failed to load transform for %s: %ld\n", algo,
+		       PTR_ERR(tfm));
+		return;
+	}
+
+	for (i = 0; blens[i] != 0; i++)
+		max = max(max, blens[i]);
+
+	/* deflate and lzo may expand incompressible input by a fair bit */
+	src = vmalloc(max);
+	comp = vmalloc(2 * max);
+	decomp = vmalloc(max);
+	if (!src || !comp || !decomp) {
+		printk(KERN_ERR "tcrypt: failed to allocate buffers\n");
+		goto out;
+	}
+	test_comp_fill(src, max);
+
+	for (i = 0; blens[i] != 0; i++) {
+		blen = blens[i];
+
+		clen = 2 * max;
+		ret = crypto_comp_compress(tfm, src, blen, comp, &clen);
+		if (ret) {
+			printk(KERN_ERR "compression failed ret=%d\n", ret);
+			break;
+		}
+		dlen = blen;
+		ret = crypto_comp_decompress(tfm, comp, clen, decomp, &dlen);
+		if (ret || dlen != blen || memcmp(src, decomp, blen)) {
+			printk(KERN_ERR "decompression mismatch ret=%d\n", ret);
+			break;
+		}
+
+		printk(KERN_INFO "test%3u (%5u byte blocks, compressed to "
+		       "%5u bytes, %3u%%)\n", i, blen, clen, clen * 100 / blen);
+
+		printk(KERN_INFO "  compress:   ");
+		if (sec)
+			ret = test_comp_jiffies(tfm, 1, src, blen, comp,
+						2 * max, blen, sec);
+		else
+			ret = test_comp_cycles(tfm, 1, src, blen, comp,
+					       2 * max, blen);
+		if (ret) {
+			printk(KERN_ERR "compression failed ret=%d\n", ret);
+			break;
+		}
+
+		/* the timed runs above left the same output in comp */
+		printk(KERN_INFO "  decompress: ");
+		if (sec)
+			ret = test_comp_jiffies(tfm, 0, comp, clen, decomp,
+						blen, blen, sec);
+		else
+			ret = test_comp_cycles(tfm, 0, comp, clen, decomp,
+					       blen, blen);
+		if (ret) {
+			printk(KERN_ERR "decompression failed ret=%d\n", ret);
+			break;
+		}
+	}
+
+out:
+	vfree(decomp);
+	vfree(comp);
+	vfree(src);
+	crypto_free_comp(tfm);
+}
+
 static void test_available(void)
 {
 	char **name = check;
@@ -936,6 +1134,10 @@ static int do_test(int m)
 		ret += tcrypt_test("rfc4309(ccm(aes))");
 		break;
 
+	case 46:
+		ret += tcrypt_test("lz4");
+		break;
+
 	case 100:
 		ret += tcrypt_test("hmac(md5)");
 		break;
@@ -1215,6 +1417,24 @@ static int do_test(int m)
 	case 499:
 		break;
 
+	case 500:
+		/* fall through */
+
+	case 501:
+		test_comp_speed("lzo", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 502:
+		test_comp_speed("lz4", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 503:
+		test_comp_speed("deflate", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 599:
+		break;
+
 	case 1000:
 		test_available();
 		break;
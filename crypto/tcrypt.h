@@ -112,4 +112,9 @@ static struct hash_speed hash_speed_template_16[] = {
 	{  .blen = 0,	.plen = 0,	.klen = 0, }
 };
 
+/*
+ * Compression speed tests, buffer lengths
+ */
+static unsigned int comp_speed_template[] = { 512, 4096, 16384, 0 };
+
 #endif	/* _CRYPTO_TCRYPT_H */
@@ -977,6 +977,87 @@ out_nobuf:
 	return ret;
 }
 
+/*
+ * A decompressor must not write past the output length it is given, nor
+ * report more output than that, whatever it is fed.  Check this for every
+ * prefix of the vector and with each input byte damaged in turn, and
+ * check that an output buffer one byte too short is an error.
+ */
+#define COMP_GUARD	16
+
+static bool comp_guard_hit(const char *guard)
+{
+	int i;
+
+	for (i = 0; i < COMP_GUARD; i++)
+		if ((u8)guard[i] != 0xa5)
+			return true;
+	return false;
+}
+
+static int test_decomp_robust(struct crypto_comp *tfm,
+			      struct comp_testvec *tv, int i, const char *algo)
+{
+	static const u8 damage[] = { 0x01, 0x80, 0xff };
+	unsigned int ilen, dlen, limit, pos, k;
+	char *input, *result;
+	const char *what;
+	int ret = -ENOMEM;
+
+	input = kmalloc(tv->inlen, GFP_KERNEL);
+	result = kmalloc(COMP_BUF_SIZE + COMP_GUARD, GFP_KERNEL);
+	if (!input || !result)
+		goto out;
+	memcpy(input, tv->input, tv->inlen);
+
+	for (ilen = 0; ilen < tv->inlen; ilen++) {
+		limit = COMP_BUF_SIZE;
+		memset(result, 0xa5, limit + COMP_GUARD);
+		dlen = limit;
+		ret = crypto_comp_decompress(tfm, input, ilen, result, &dlen);
+		what = "truncated input";
+		if (dlen > limit || comp_guard_hit(result + limit))
+			goto fail;
+	}
+
+	limit = tv->outlen - 1;
+	memset(result, 0xa5, limit + COMP_GUARD);
+	dlen = limit;
+	ret = crypto_comp_decompress(tfm, input, tv->inlen, result, &dlen);
+	what = "short output buffer";
+	if (!ret || comp_guard_hit(result + limit))
+		goto fail;
+
+	limit = tv->outlen;
+	what = "damaged input";
+	for (pos = 0; pos < tv->inlen; pos++) {
+		for (k = 0; k < ARRAY_SIZE(damage); k++) {
+			input[pos] ^= damage[k];
+			memset(result, 0xa5, limit + COMP_GUARD);
+			dlen = limit;
+			ret = crypto_comp_decompress(tfm, input, tv->inlen,
+						     result, &dlen);
+			input[pos] ^= damage[k];
+			if (dlen > limit ||
+			    comp_guard_hit(result + limit))
+				goto fail;
+		}
+	}
+
+	ret = 0;
+	goto out;
+
+fail:
+	printk(KERN_ERR "alg: comp: Decompression test %d failed for %s: "
+	       "%s mishandled (ret=%d, output len = %d)\n", i + 1, algo,
+	       what, ret, dlen);
+	ret = -EINVAL;
+out:
+	kfree(result);
+	kfree(input);
+	return ret;
+}
+
 static int test_comp(struct crypto_comp *tfm, struct comp_testvec *ctemplate,
 		     struct comp_testvec *dtemplate, int ctcount, int dtcount)
 {
@@ -1049,6 +1130,10 @@ static int test_comp(struct crypto_comp *tfm, struct comp_testvec *ctemplate,
 			ret = -EINVAL;
 			goto out;
 		}
+
+		ret = test_decomp_robust(tfm, &dtemplate[i], i, algo);
+		if (ret)
+			goto out;
 	}
 
 	ret = 0;
@@ -2168,6 +2253,21 @@ static const struct alg_test_desc alg_test_descs[] = {
 				}
 			}
 		}
+	}, {
+		.alg = "lz4",
+		.test = alg_test_comp,
+		.suite = {
+			.comp = {
+				.comp = {
+					.vecs = lz4_comp_tv_template,
+					.count = LZ4_COMP_TEST_VECTORS
+				},
+				.decomp = {
+					.vecs = lz4_decomp_tv_template,
+					.count = LZ4_DECOMP_TEST_VECTORS
+				}
+			}
+		}
 	}, {
 		.alg = "lzo",
 		.test = alg_test_comp,
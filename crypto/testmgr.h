@@ -443,7 +443,7 @@ static struct hash_testvec rmd320_tv_template[] = {
 /*
  * SHA1 test vectors  from from FIPS PUB 180-1
  */
-#define SHA1_TEST_VECTORS	2
+#define SHA1_TEST_VECTORS	3
 
 static struct hash_testvec sha1_tv_template[] = {
 	{
@@ -458,6 +458,17 @@ static struct hash_testvec sha1_tv_template[] = {
 			  "\x4a\xa1\xf9\x51\x29\xe5\xe5\x46\x70\xf1",
 		.np	= 2,
 		.tap	= { 28, 28 }
+	}, {
+		.plaintext = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklm"
+			     "ghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrs"
+			     "mnopqrstnopqrstuabcdefghbcdefghicdefghijdefghijk"
+			     "efghijklfghijklmghijklmnhijklmnoijklmnopjklmnopq"
+			     "klmnopqrlmnopqrsmnopqrstnopqrstu",
+		.psize	= 224,
+		.digest	= "\x0c\x35\xf0\x42\xb1\x3b\xa2\xaa\xb1\xf6"
+			  "\xf0\x1c\x63\x80\x54\x09\x01\x7f\x41\x1a",
+		.np	= 3,
+		.tap	= { 5, 150, 69 }
 	}
 };
 
@@ -465,7 +476,7 @@ static struct hash_testvec sha1_tv_template[] = {
 /*
  * SHA224 test vectors from from FIPS PUB 180-2
  */
-#define SHA224_TEST_VECTORS     2
+#define SHA224_TEST_VECTORS     3
 
 static struct hash_testvec sha224_tv_template[] = {
 	{
@@ -485,13 +496,26 @@ static struct hash_testvec sha224_tv_template[] = {
 			  "\x52\x52\x25\x25",
 		.np     = 2,
 		.tap    = { 28, 28 }
+	}, {
+		.plaintext = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklm"
+			     "ghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrs"
+			     "mnopqrstnopqrstuabcdefghbcdefghicdefghijdefghijk"
+			     "efghijklfghijklmghijklmnhijklmnoijklmnopjklmnopq"
+			     "klmnopqrlmnopqrsmnopqrstnopqrstu",
+		.psize  = 224,
+		.digest = "\x8B\x18\xF9\x5E\xC5\x3E\x99\x3F"
+			  "\xF6\x37\xC8\xC4\xE0\x68\x75\xEA"
+			  "\x7B\xED\x04\x2F\x84\x17\x41\xEA"
+			  "\xCB\x26\x7C\x9F",
+		.np     = 3,
+		.tap    = { 5, 150, 69 }
 	}
 };
 
 /*
  * SHA256 test vectors from from NIST
  */
-#define SHA256_TEST_VECTORS	2
+#define SHA256_TEST_VECTORS	3
 
 static struct hash_testvec sha256_tv_template[] = {
 	{
@@ -510,6 +534,19 @@ static struct hash_testvec sha256_tv_template[] = {
 			  "\xf6\xec\xed\xd4\x19\xdb\x06\xc1",
 		.np	= 2,
 		.tap	= { 28, 28 }
+	}, {
+		.plaintext = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklm"
+			     "ghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrs"
+			     "mnopqrstnopqrstuabcdefghbcdefghicdefghijdefghijk"
+			     "efghijklfghijklmghijklmnhijklmnoijklmnopjklmnopq"
+			     "klmnopqrlmnopqrsmnopqrstnopqrstu",
+		.psize	= 224,
+		.digest	= "\xcd\xbf\x86\x7f\x78\x4a\x69\xc7"
+			  "\xd2\xe2\x52\xba\xa9\x07\x5c\x37"
+			  "\x62\x84\x3b\x1b\xeb\x52\xc0\x4d"
+			  "\x4b\xe3\x9e\x77\x77\xd9\x57\x17",
+		.np	= 3,
+		.tap	= { 5, 150, 69 }
 	},
 };
 
@@ -9299,11 +9336,91 @@ static struct pcomp_testvec zlib_decomp_tv_template[] = {
 	},
 };
 
+/*
+ * LZ4 test vectors (null-terminated strings).
+ */
+#define LZ4_COMP_TEST_VECTORS 2
+#define LZ4_DECOMP_TEST_VECTORS 2
+
+static struct comp_testvec lz4_comp_tv_template[] = {
+	{
+		.inlen	= 70,
+		.outlen	= 45,
+		.input	= "Join us now and share the software "
+			"Join us now and share the software ",
+		.output	= "\xf0\x10\x4a\x6f\x69\x6e\x20\x75"
+			  "\x73\x20\x6e\x6f\x77\x20\x61\x6e"
+			  "\x64\x20\x73\x68\x61\x72\x65\x20"
+			  "\x74\x68\x65\x20\x73\x6f\x66\x74"
+			  "\x77\x0d\x00\x0f\x23\x00\x0b\x50"
+			  "\x77\x61\x72\x65\x20",
+	}, {
+		.inlen	= 159,
+		.outlen	= 125,
+		.input	= "This document describes a compression method based on the LZO "
+			"compression algorithm.  This document defines the application of "
+			"the LZO algorithm used in UBIFS.",
+		.output	= "\xf9\x2e\x54\x68\x69\x73\x20\x64"
+			  "\x6f\x63\x75\x6d\x65\x6e\x74\x20"
+			  "\x64\x65\x73\x63\x72\x69\x62\x65"
+			  "\x73\x20\x61\x20\x63\x6f\x6d\x70"
+			  "\x72\x65\x73\x73\x69\x6f\x6e\x20"
+			  "\x6d\x65\x74\x68\x6f\x64\x20\x62"
+			  "\x61\x73\x65\x64\x20\x6f\x6e\x20"
+			  "\x74\x68\x65\x20\x4c\x5a\x4f\x24"
+			  "\x00\xcc\x61\x6c\x67\x6f\x72\x69"
+			  "\x74\x68\x6d\x2e\x20\x20\x56\x00"
+			  "\x51\x66\x69\x6e\x65\x73\x36\x00"
+			  "\x80\x61\x70\x70\x6c\x69\x63\x61"
+			  "\x74\x56\x00\x21\x6f\x66\x13\x00"
+			  "\x00\x49\x00\x05\x3d\x00\x20\x20"
+			  "\x75\x63\x00\x90\x69\x6e\x20\x55"
+			  "\x42\x49\x46\x53\x2e",
+	},
+};
+
+static struct comp_testvec lz4_decomp_tv_template[] = {
+	{
+		.inlen	= 125,
+		.outlen	= 159,
+		.input	= "\xf9\x2e\x54\x68\x69\x73\x20\x64"
+			  "\x6f\x63\x75\x6d\x65\x6e\x74\x20"
+			  "\x64\x65\x73\x63\x72\x69\x62\x65"
+			  "\x73\x20\x61\x20\x63\x6f\x6d\x70"
+			  "\x72\x65\x73\x73\x69\x6f\x6e\x20"
+			  "\x6d\x65\x74\x68\x6f\x64\x20\x62"
+			  "\x61\x73\x65\x64\x20\x6f\x6e\x20"
+			  "\x74\x68\x65\x20\x4c\x5a\x4f\x24"
+			  "\x00\xcc\x61\x6c\x67\x6f\x72\x69"
+			  "\x74\x68\x6d\x2e\x20\x20\x56\x00"
+			  "\x51\x66\x69\x6e\x65\x73\x36\x00"
+			  "\x80\x61\x70\x70\x6c\x69\x63\x61"
+			  "\x74\x56\x00\x21\x6f\x66\x13\x00"
+			  "\x00\x49\x00\x05\x3d\x00\x20\x20"
+			  "\x75\x63\x00\x90\x69\x6e\x20\x55"
+			  "\x42\x49\x46\x53\x2e",
+		.output	= "This document describes a compression method based on the LZO "
+			"compression algorithm.  This document defines the application of "
+			"the LZO algorithm used in UBIFS.",
+	}, {
+		.inlen	= 45,
+		.outlen	= 70,
+		.input	= "\xf0\x10\x4a\x6f\x69\x6e\x20\x75"
+			  "\x73\x20\x6e\x6f\x77\x20\x61\x6e"
+			  "\x64\x20\x73\x68\x61\x72\x65\x20"
+			  "\x74\x68\x65\x20\x73\x6f\x66\x74"
+			  "\x77\x0d\x00\x0f\x23\x00\x0b\x50"
+			  "\x77\x61\x72\x65\x20",
+		.output	= "Join us now and share the software "
+			"Join us now and share the software ",
+	},
+};
+
 /*
  * LZO test vectors (null-terminated strings).
  */
 #define LZO_COMP_TEST_VECTORS 2
-#define LZO_DECOMP_TEST_VECTORS 2
+#define LZO_DECOMP_TEST_VECTORS 3
 
 static struct comp_testvec lzo_comp_tv_template[] = {
 	{
@@ -9378,6 +9495,31 @@ static struct comp_testvec lzo_decomp_tv_template[] = {
 			  "\x3d\x88\x00\x11\x00\x00",
 		.output	= "Join us now and share the software "
 			"Join us now and share the software ",
+	}, {
+		.inlen	= 124,
+		.outlen	= 274,
+		.input	= "\x00\x20\x54\x68\x65\x20\x71\x75"
+			  "\x69\x63\x6b\x20\x62\x72\x6f\x77"
+			  "\x6e\x20\x66\x6f\x78\x20\x6a\x75"
+			  "\x6d\x70\x73\x20\x6f\x76\x65\x72"
+			  "\x20\x74\x68\x65\x20\x6c\x61\x7a"
+			  "\x79\x20\x64\x6f\x67\x2e\x20\x20"
+			  "\x54\x68\x65\x20\x20\x09\xb5\x00"
+			  "\x7a\x20\x0e\x00\x00\x2e\x77\x01"
+			  "\x64\x6f\x67\x33\x2c\x02\x00\x1b"
+			  "\x66\x6f\x78\x2e\x20\x20\x50\x61"
+			  "\x63\x6b\x20\x6d\x79\x20\x62\x6f"
+			  "\x78\x20\x77\x69\x74\x68\x20\x66"
+			  "\x69\x76\x65\x20\x64\x6f\x7a\x65"
+			  "\x6e\x20\x6c\x69\x71\x75\x6f\x72"
+			  "\x20\x6a\x75\x67\x73\x20\x10\xd4"
+			  "\x02\x11\x00\x00",
+		.output	= "The quick brown fox jumps over the lazy dog.  "
+			"The quick brown fox jumps over the lazy dog.  "
+			"zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz"
+			"The quick brown dog jumps over the lazy fox.  "
+			"Pack my box with five dozen liquor jugs.  "
+			"The quick brown fox jumps over the lazy dog.  ",
 	},
 };
 
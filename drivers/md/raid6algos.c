@@ -17,11 +17,11 @@
  */
 
 #include <linux/raid/pq.h>
-#include <linux/gfp.h>
 #ifndef __KERNEL__
 #include <sys/mman.h>
 #include <stdio.h>
 #else
+#include <linux/gfp.h>
 #if !RAID6_USE_EMPTY_ZERO_PAGE
 /* In .bss so it's zeroed */
 const char raid6_empty_zero_page[PAGE_SIZE] __attribute__((aligned(256)));
@@ -32,6 +32,12 @@ EXPORT_SYMBOL(raid6_empty_zero_page);
 struct raid6_calls raid6_call;
 EXPORT_SYMBOL_GPL(raid6_call);
 
+void (*raid6_2data_recov)(int, size_t, int, int, void **);
+EXPORT_SYMBOL_GPL(raid6_2data_recov);
+
+void (*raid6_datap_recov)(int, size_t, int, void **);
+EXPORT_SYMBOL_GPL(raid6_datap_recov);
+
 const struct raid6_calls * const raid6_algos[] = {
 	&raid6_intx1,
 	&raid6_intx2,
@@ -48,11 +54,20 @@ const struct raid6_calls * const raid6_algos[] = {
 	&raid6_sse1x2,
 	&raid6_sse2x1,
 	&raid6_sse2x2,
+#ifdef CONFIG_AS_AVX2
+	&raid6_avx2x1,
+	&raid6_avx2x2,
+#endif
 #endif
 #if defined(__x86_64__) && !defined(__arch_um__)
 	&raid6_sse2x1,
 	&raid6_sse2x2,
 	&raid6_sse2x4,
+#ifdef CONFIG_AS_AVX2
+	&raid6_avx2x1,
+	&raid6_avx2x2,
+	&raid6_avx2x4,
+#endif
 #endif
 #ifdef CONFIG_ALTIVEC
 	&raid6_altivec1,
@@ -63,6 +78,17 @@ const struct raid6_calls * const raid6_algos[] = {
 	NULL
 };
 
+const struct raid6_recov_calls * const raid6_recov_algos[] = {
+	&raid6_recov_intx1,
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(__arch_um__)
+	&raid6_recov_ssse3,
+#ifdef CONFIG_AS_AVX2
+	&raid6_recov_avx2,
+#endif
+#endif
+	NULL
+};
+
 #ifdef __KERNEL__
 #define RAID6_TIME_JIFFIES_LG2	4
 #else
@@ -71,6 +97,62 @@ const struct raid6_calls * const raid6_algos[] = {
 #define time_before(x, y) ((x) < (y))
 #endif
 
+/* Pick the fastest recovery routines on top of the chosen gen_syndrome */
+/* Two data blocks are rebuilt from a four disk set, all of it in cache */
+
+static int __init raid6_select_recov(char *pages)
+{
+	const struct raid6_recov_calls * const * algo;
+	const struct raid6_recov_calls * best;
+	void *dptrs[4];
+	unsigned long perf, bestperf;
+	unsigned long j0, j1;
+
+	bestperf = 0;  best = NULL;
+
+	for ( algo = raid6_recov_algos ; *algo ; algo++ ) {
+		if ( !(*algo)->valid || (*algo)->valid() ) {
+			dptrs[0] = pages + PAGE_SIZE*2;
+			dptrs[1] = pages + PAGE_SIZE*3;
+			dptrs[2] = pages;
+			dptrs[3] = pages + PAGE_SIZE;
+			perf = 0;
+
+			preempt_disable();
+			j0 = jiffies;
+			while ( (j1 = jiffies) == j0 )
+				cpu_relax();
+			while (time_before(jiffies,
+					    j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
+				(*algo)->data2(4, PAGE_SIZE, 0, 1, dptrs);
+				perf++;
+			}
+			preempt_enable();
+
+			if ( perf > bestperf ) {
+				best = *algo;
+				bestperf = perf;
+			}
+			printk("raid6: recov %-8s %5ld MB/s\n", (*algo)->name,
+			       (perf*HZ) >>
+			       (20-1-PAGE_SHIFT+RAID6_TIME_JIFFIES_LG2));
+		}
+	}
+
+	if (!best) {
+		printk("raid6: Yikes!  No recovery algorithm found!\n");
+		return -EINVAL;
+	}
+
+	printk("raid6: using recovery algorithm %s (%ld MB/s)\n",
+	       best->name,
+	       (bestperf*HZ) >> (20-1-PAGE_SHIFT+RAID6_TIME_JIFFIES_LG2));
+	raid6_2data_recov = best->data2;
+	raid6_datap_recov = best->datap;
+
+	return 0;
+}
+
 /* Try to pick the best algorithm */
 /* This code uses the gfmul table as convenient data set to abuse */
 
@@ -80,7 +162,7 @@ int __init raid6_select_algo(void)
 	const struct raid6_calls * best;
 	char *syndromes;
 	void *dptrs[(65536/PAGE_SIZE)+2];
-	int i, disks;
+	int i, disks, err;
 	unsigned long perf, bestperf;
 	int bestprefer;
 	unsigned long j0, j1;
@@ -90,8 +172,10 @@ int __init raid6_select_algo(void)
 		dptrs[i] = ((char *)raid6_gfmul) + PAGE_SIZE*i;
 	}
 
-	/* Normal code - use a 2-page allocation to avoid D$ conflict */
-	syndromes = (void *) __get_free_pages(GFP_KERNEL, 1);
+	/* Normal code - use a 2-page allocation to avoid D$ conflict;
+	   the other two pages stand in for failed disks when timing
+	   the recovery routines */
+	syndromes = (void *) __get_free_pages(GFP_KERNEL, 2);
 
 	if ( !syndromes ) {
 		printk("raid6: Yikes!  No memory available.\n");
@@ -135,12 +219,15 @@ int __init raid6_select_algo(void)
 		       best->name,
 		       (bestperf*HZ) >> (20-16+RAID6_TIME_JIFFIES_LG2));
 		raid6_call = *best;
-	} else
+		err = raid6_select_recov(syndromes);
+	} else {
 		printk("raid6: Yikes!  No algorithm found!\n");
+		err = -EINVAL;
+	}
 
-	free_pages((unsigned long)syndromes, 1);
+	free_pages((unsigned long)syndromes, 2);
 
-	return best ? 0 : -EINVAL;
+	return err;
 }
 
 static void raid6_exit(void)
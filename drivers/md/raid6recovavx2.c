@@ -0,0 +1,187 @@
+/* -*- linux-c -*- ------------------------------------------------------- *
+ *
+ *   Copyright 2002 H. Peter Anvin - All Rights Reserved
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ *   Boston MA 02111-1307, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * raid6recovavx2.c
+ *
+ * AVX2 implementation of RAID-6 dual failure recovery
+ *
+ * Same nibble table lookup as the SSSE3 code, 32 bytes at a time;
+ * vpshufb works on each 128-bit lane separately, so the 16-byte
+ * halves of raid6_vgfmul[] are broadcast into both lanes.
+ */
+
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(__arch_um__) && \
+	defined(CONFIG_AS_AVX2)
+
+#include <linux/raid/pq.h>
+#include "raid6x86.h"
+
+static const struct raid6_avx2_recov_constants {
+	u64 x0f[4];
+} raid6_avx2_recov_constants  __attribute__((aligned(32))) = {
+	{ 0x0f0f0f0f0f0f0f0fULL, 0x0f0f0f0f0f0f0f0fULL,
+	  0x0f0f0f0f0f0f0f0fULL, 0x0f0f0f0f0f0f0f0fULL },
+};
+
+static int raid6_have_avx2(void)
+{
+	/* The ymm state is only saved by kernel_fpu_begin() with XSAVE */
+	return boot_cpu_has(X86_FEATURE_AVX2) &&
+		boot_cpu_has(X86_FEATURE_AVX) &&
+		boot_cpu_has(X86_FEATURE_XSAVE);
+}
+
+/* Recover two failed data blocks. */
+static void raid6_2data_recov_avx2(int disks, size_t bytes, int faila,
+				   int failb, void **ptrs)
+{
+	u8 *p, *q, *dp, *dq;
+	const u8 *pbmul;	/* P multiplier table for B data */
+	const u8 *qmul;		/* Q multiplier table (for both) */
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/* Compute syndrome with zero for the missing data pages
+	   Use the dead data pages as temporary storage for
+	   delta p and delta q */
+	dp = (u8 *)ptrs[faila];
+	ptrs[faila] = (void *)raid6_empty_zero_page;
+	ptrs[disks-2] = dp;
+	dq = (u8 *)ptrs[failb];
+	ptrs[failb] = (void *)raid6_empty_zero_page;
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dp;
+	ptrs[failb]   = dq;
+	ptrs[disks-2] = p;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper data tables */
+	pbmul = raid6_vgfmul[raid6_gfexi[failb-faila]];
+	qmul  = raid6_vgfmul[raid6_gfinv[raid6_gfexp[faila]^raid6_gfexp[failb]]];
+
+	kernel_fpu_begin();
+
+	asm volatile("vmovdqa %0,%%ymm7" : : "m" (raid6_avx2_recov_constants.x0f[0]));
+	asm volatile("vbroadcasti128 %0,%%ymm4" : : "m" (qmul[0]));
+	asm volatile("vbroadcasti128 %0,%%ymm5" : : "m" (qmul[16]));
+
+	while ( bytes ) {
+		/* ymm1 = *q ^ *dq, ymm0 = px = *p ^ *dp */
+		asm volatile("vmovdqa %0,%%ymm1" : : "m" (*q));
+		asm volatile("vmovdqa %0,%%ymm0" : : "m" (*p));
+		asm volatile("vpxor %0,%%ymm1,%%ymm1" : : "m" (*dq));
+		asm volatile("vpxor %0,%%ymm0,%%ymm0" : : "m" (*dp));
+
+		/* ymm3 = qx = qmul[*q ^ *dq] */
+		asm volatile("vpsraw $4,%ymm1,%ymm6");
+		asm volatile("vpand %ymm7,%ymm1,%ymm1");
+		asm volatile("vpand %ymm7,%ymm6,%ymm6");
+		asm volatile("vpshufb %ymm1,%ymm4,%ymm2");
+		asm volatile("vpshufb %ymm6,%ymm5,%ymm3");
+		asm volatile("vpxor %ymm2,%ymm3,%ymm3");
+
+		/* ymm3 = db = pbmul[px] ^ qx */
+		asm volatile("vpsraw $4,%ymm0,%ymm6");
+		asm volatile("vpand %ymm7,%ymm0,%ymm1");
+		asm volatile("vpand %ymm7,%ymm6,%ymm6");
+		asm volatile("vbroadcasti128 %0,%%ymm2" : : "m" (pbmul[0]));
+		asm volatile("vpshufb %ymm1,%ymm2,%ymm2");
+		asm volatile("vpxor %ymm2,%ymm3,%ymm3");
+		asm volatile("vbroadcasti128 %0,%%ymm2" : : "m" (pbmul[16]));
+		asm volatile("vpshufb %ymm6,%ymm2,%ymm2");
+		asm volatile("vpxor %ymm2,%ymm3,%ymm3");
+
+		/* Reconstructed B, then A = db ^ px */
+		asm volatile("vmovdqa %%ymm3,%0" : "=m" (*dq));
+		asm volatile("vpxor %ymm3,%ymm0,%ymm0");
+		asm volatile("vmovdqa %%ymm0,%0" : "=m" (*dp));
+
+		bytes -= 32;
+		p += 32;
+		q += 32;
+		dp += 32;
+		dq += 32;
+	}
+
+	kernel_fpu_end();
+}
+
+/* Recover failure of one data block plus the P block */
+static void raid6_datap_recov_avx2(int disks, size_t bytes, int faila,
+				   void **ptrs)
+{
+	u8 *p, *q, *dq;
+	const u8 *qmul;		/* Q multiplier table */
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/* Compute syndrome with zero for the missing data page
+	   Use the dead data page as temporary storage for delta q */
+	dq = (u8 *)ptrs[faila];
+	ptrs[faila] = (void *)raid6_empty_zero_page;
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dq;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper data tables */
+	qmul  = raid6_vgfmul[raid6_gfinv[raid6_gfexp[faila]]];
+
+	kernel_fpu_begin();
+
+	asm volatile("vmovdqa %0,%%ymm7" : : "m" (raid6_avx2_recov_constants.x0f[0]));
+	asm volatile("vbroadcasti128 %0,%%ymm4" : : "m" (qmul[0]));
+	asm volatile("vbroadcasti128 %0,%%ymm5" : : "m" (qmul[16]));
+
+	while ( bytes ) {
+		/* ymm2 = qmul[*q ^ *dq] */
+		asm volatile("vmovdqa %0,%%ymm1" : : "m" (*dq));
+		asm volatile("vpxor %0,%%ymm1,%%ymm1" : : "m" (*q));
+		asm volatile("vpsraw $4,%ymm1,%ymm6");
+		asm volatile("vpand %ymm7,%ymm1,%ymm1");
+		asm volatile("vpand %ymm7,%ymm6,%ymm6");
+		asm volatile("vpshufb %ymm1,%ymm4,%ymm2");
+		asm volatile("vpshufb %ymm6,%ymm5,%ymm3");
+		asm volatile("vpxor %ymm3,%ymm2,%ymm2");
+
+		/* *dq = that, *p ^= that */
+		asm volatile("vmovdqa %%ymm2,%0" : "=m" (*dq));
+		asm volatile("vpxor %0,%%ymm2,%%ymm2" : : "m" (*p));
+		asm volatile("vmovdqa %%ymm2,%0" : "=m" (*p));
+
+		bytes -= 32;
+		p += 32;
+		q += 32;
+		dq += 32;
+	}
+
+	kernel_fpu_end();
+}
+
+const struct raid6_recov_calls raid6_recov_avx2 = {
+	raid6_2data_recov_avx2,
+	raid6_datap_recov_avx2,
+	raid6_have_avx2,
+	"avx2"
+};
+
+#endif
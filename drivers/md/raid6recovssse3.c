@@ -0,0 +1,191 @@
+/* -*- linux-c -*- ------------------------------------------------------- *
+ *
+ *   Copyright 2002 H. Peter Anvin - All Rights Reserved
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ *   Boston MA 02111-1307, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * raid6recovssse3.c
+ *
+ * SSSE3 implementation of RAID-6 dual failure recovery
+ *
+ * A GF(2^8) multiplication by a constant is linear, so c*x equals
+ * c*(x & 0x0f) ^ c*(x & 0xf0).  raid6_vgfmul[c] holds those two sets of
+ * 16 products, and pshufb looks up 16 bytes in each of them at once.
+ */
+
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(__arch_um__)
+
+#include <linux/raid/pq.h>
+#include "raid6x86.h"
+
+static const struct raid6_ssse3_constants {
+	u64 x0f[2];
+} raid6_ssse3_constants  __attribute__((aligned(16))) = {
+	{ 0x0f0f0f0f0f0f0f0fULL, 0x0f0f0f0f0f0f0f0fULL },
+};
+
+static int raid6_have_ssse3(void)
+{
+	return boot_cpu_has(X86_FEATURE_XMM2) &&
+		boot_cpu_has(X86_FEATURE_SSSE3);
+}
+
+/* Recover two failed data blocks. */
+static void raid6_2data_recov_ssse3(int disks, size_t bytes, int faila,
+				    int failb, void **ptrs)
+{
+	u8 *p, *q, *dp, *dq;
+	const u8 *pbmul;	/* P multiplier table for B data */
+	const u8 *qmul;		/* Q multiplier table (for both) */
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/* Compute syndrome with zero for the missing data pages
+	   Use the dead data pages as temporary storage for
+	   delta p and delta q */
+	dp = (u8 *)ptrs[faila];
+	ptrs[faila] = (void *)raid6_empty_zero_page;
+	ptrs[disks-2] = dp;
+	dq = (u8 *)ptrs[failb];
+	ptrs[failb] = (void *)raid6_empty_zero_page;
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dp;
+	ptrs[failb]   = dq;
+	ptrs[disks-2] = p;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper data tables */
+	pbmul = raid6_vgfmul[raid6_gfexi[failb-faila]];
+	qmul  = raid6_vgfmul[raid6_gfinv[raid6_gfexp[faila]^raid6_gfexp[failb]]];
+
+	kernel_fpu_begin();
+
+	asm volatile("movdqa %0,%%xmm7" : : "m" (raid6_ssse3_constants.x0f[0]));
+	asm volatile("movdqa %0,%%xmm4" : : "m" (qmul[0]));
+	asm volatile("movdqa %0,%%xmm5" : : "m" (qmul[16]));
+
+	while ( bytes ) {
+		/* xmm1 = *q ^ *dq, xmm0 = px = *p ^ *dp */
+		asm volatile("movdqa %0,%%xmm1" : : "m" (*q));
+		asm volatile("movdqa %0,%%xmm0" : : "m" (*p));
+		asm volatile("pxor %0,%%xmm1" : : "m" (*dq));
+		asm volatile("pxor %0,%%xmm0" : : "m" (*dp));
+
+		/* xmm3 = qx = qmul[*q ^ *dq] */
+		asm volatile("movdqa %xmm1,%xmm6");
+		asm volatile("psraw $4,%xmm6");
+		asm volatile("pand %xmm7,%xmm1");
+		asm volatile("pand %xmm7,%xmm6");
+		asm volatile("movdqa %xmm4,%xmm2");
+		asm volatile("movdqa %xmm5,%xmm3");
+		asm volatile("pshufb %xmm1,%xmm2");
+		asm volatile("pshufb %xmm6,%xmm3");
+		asm volatile("pxor %xmm2,%xmm3");
+
+		/* xmm3 = db = pbmul[px] ^ qx */
+		asm volatile("movdqa %xmm0,%xmm1");
+		asm volatile("movdqa %xmm0,%xmm6");
+		asm volatile("psraw $4,%xmm6");
+		asm volatile("pand %xmm7,%xmm1");
+		asm volatile("pand %xmm7,%xmm6");
+		asm volatile("movdqa %0,%%xmm2" : : "m" (pbmul[0]));
+		asm volatile("pshufb %xmm1,%xmm2");
+		asm volatile("pxor %xmm2,%xmm3");
+		asm volatile("movdqa %0,%%xmm2" : : "m" (pbmul[16]));
+		asm volatile("pshufb %xmm6,%xmm2");
+		asm volatile("pxor %xmm2,%xmm3");
+
+		/* Reconstructed B, then A = db ^ px */
+		asm volatile("movdqa %%xmm3,%0" : "=m" (*dq));
+		asm volatile("pxor %xmm3,%xmm0");
+		asm volatile("movdqa %%xmm0,%0" : "=m" (*dp));
+
+		bytes -= 16;
+		p += 16;
+		q += 16;
+		dp += 16;
+		dq += 16;
+	}
+
+	kernel_fpu_end();
+}
+
+/* Recover failure of one data block plus the P block */
+static void raid6_datap_recov_ssse3(int disks, size_t bytes, int faila,
+				    void **ptrs)
+{
+	u8 *p, *q, *dq;
+	const u8 *qmul;		/* Q multiplier table */
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/* Compute syndrome with zero for the missing data page
+	   Use the dead data page as temporary storage for delta q */
+	dq = (u8 *)ptrs[faila];
+	ptrs[faila] = (void *)raid6_empty_zero_page;
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dq;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper data tables */
+	qmul  = raid6_vgfmul[raid6_gfinv[raid6_gfexp[faila]]];
+
+	kernel_fpu_begin();
+
+	asm volatile("movdqa %0,%%xmm7" : : "m" (raid6_ssse3_constants.x0f[0]));
+	asm volatile("movdqa %0,%%xmm4" : : "m" (qmul[0]));
+	asm volatile("movdqa %0,%%xmm5" : : "m" (qmul[16]));
+
+	while ( bytes ) {
+		/* xmm2 = qmul[*q ^ *dq] */
+		asm volatile("movdqa %0,%%xmm1" : : "m" (*dq));
+		asm volatile("pxor %0,%%xmm1" : : "m" (*q));
+		asm volatile("movdqa %xmm1,%xmm6");
+		asm volatile("psraw $4,%xmm6");
+		asm volatile("pand %xmm7,%xmm1");
+		asm volatile("pand %xmm7,%xmm6");
+		asm volatile("movdqa %xmm4,%xmm2");
+		asm volatile("movdqa %xmm5,%xmm3");
+		asm volatile("pshufb %xmm1,%xmm2");
+		asm volatile("pshufb %xmm6,%xmm3");
+		asm volatile("pxor %xmm3,%xmm2");
+
+		/* *dq = that, *p ^= that */
+		asm volatile("movdqa %%xmm2,%0" : "=m" (*dq));
+		asm volatile("pxor %0,%%xmm2" : : "m" (*p));
+		asm volatile("movdqa %%xmm2,%0" : "=m" (*p));
+
+		bytes -= 16;
+		p += 16;
+		q += 16;
+		dq += 16;
+	}
+
+	kernel_fpu_end();
+}
+
+const struct raid6_recov_calls raid6_recov_ssse3 = {
+	raid6_2data_recov_ssse3,
+	raid6_datap_recov_ssse3,
+	raid6_have_ssse3,
+	"ssse3"
+};
+
+#endif
@@ -25,6 +25,7 @@
 #include <linux/highmem.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/lz4.h>
 #include <linux/string.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
@@ -38,6 +39,28 @@ static struct ramzswap *devices;
 
 /* Module params (documentation at end) */
 static unsigned int num_devices;
+static char *compressor = "lzo";
+
+/*
+ * lzo and lz4 share the calling convention and the return codes that
+ * matter here (0 for success, -5 for output overrun).
+ */
+static const struct ramzswap_compressor compressors[] = {
+	{
+		.name		= "lzo",
+		.workmem	= LZO1X_MEM_COMPRESS,
+		.compress	= lzo1x_1_compress,
+		.decompress	= lzo1x_decompress_safe,
+	}, {
+		.name		= "lz4",
+		.workmem	= LZ4_MEM_COMPRESS,
+		.compress	= lz4_compress,
+		.decompress	= lz4_decompress_safe,
+	},
+};
+
+/* Selected by the compressor parameter, used by all devices */
+static const struct ramzswap_compressor *ramzswap_comp;
 
 static int rzs_test_flag(struct ramzswap *rzs, u32 index,
 			enum rzs_pageflags flag)
@@ -292,7 +315,7 @@ static int ramzswap_read(struct ramzswap *rzs, struct bio *bio)
 	cmem = kmap_atomic(rzs->table[index].page, KM_USER1) +
 			rzs->table[index].offset;
 
-	ret = lzo1x_decompress_safe(
+	ret = rzs->comp->decompress(
 		cmem + sizeof(*zheader),
 		xv_get_object_size(cmem) - sizeof(*zheader),
 		user_mem, &clen);
@@ -301,7 +324,7 @@ static int ramzswap_read(struct ramzswap *rzs, struct bio *bio)
 	kunmap_atomic(cmem, KM_USER1);
 
 	/* should NEVER happen */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n",
 			ret, index);
 		rzs_stat64_inc(rzs, &rzs->stats.failed_reads);
@@ -349,12 +372,24 @@ static int ramzswap_write(struct ramzswap *rzs, struct bio *bio)
 		return 0;
 	}
 
-	ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
+	/*
+	 * lz4 stops as soon as the output grows past the limit, so it
+	 * gives up early on incompressible pages.  lzo ignores the limit
+	 * and may write up to lzo1x_worst_compress(PAGE_SIZE) bytes, which
+	 * still fits in the two page compress_buffer.
+	 */
+	clen = max_zpage_size;
+	ret = rzs->comp->compress(user_mem, PAGE_SIZE, src, &clen,
 				rzs->compress_workmem);
 
 	kunmap_atomic(user_mem, KM_USER0);
 
-	if (unlikely(ret != LZO_E_OK)) {
+	if (ret == LZ4_E_OUTPUT_OVERRUN) {
+		clen = PAGE_SIZE;
+		ret = 0;
+	}
+
+	if (unlikely(ret)) {
 		mutex_unlock(&rzs->lock);
 		pr_err("Compression failed! err=%d\n", ret);
 		rzs_stat64_inc(rzs, &rzs->stats.failed_writes);
@@ -541,7 +576,7 @@ static int ramzswap_ioctl_init_device(struct ramzswap *rzs)
 
 	ramzswap_set_disksize(rzs, totalram_pages << PAGE_SHIFT);
 
-	rzs->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+	rzs->compress_workmem = kzalloc(rzs->comp->workmem, GFP_KERNEL);
 	if (!rzs->compress_workmem) {
 		pr_err("Error allocating compressor working memory!\n");
 		ret = -ENOMEM;
@@ -705,6 +740,7 @@ static int create_device(struct ramzswap *rzs, int device_id)
 
 	mutex_init(&rzs->lock);
 	spin_lock_init(&rzs->stat64_lock);
+	rzs->comp = ramzswap_comp;
 
 	rzs->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!rzs->queue) {
@@ -761,7 +797,7 @@ static void destroy_device(struct ramzswap *rzs)
 
 static int __init ramzswap_init(void)
 {
-	int ret, dev_id;
+	int ret, dev_id, i;
 
 	if (num_devices > max_num_devices) {
 		pr_warning("Invalid value for num_devices: %u\n",
@@ -770,6 +806,15 @@ static int __init ramzswap_init(void)
 		goto out;
 	}
 
+	for (i = 0; i < ARRAY_SIZE(compressors); i++)
+		if (!strcmp(compressor, compressors[i].name))
+			ramzswap_comp = &compressors[i];
+	if (!ramzswap_comp) {
+		pr_warning("Invalid value for compressor: %s\n", compressor);
+		ret = -EINVAL;
+		goto out;
+	}
+
 	ramzswap_major = register_blkdev(0, "ramzswap");
 	if (ramzswap_major <= 0) {
 		pr_warning("Unable to get major number\n");
@@ -828,6 +873,8 @@ static void __exit ramzswap_exit(void)
 
 module_param(num_devices, uint, 0);
 MODULE_PARM_DESC(num_devices, "Number of ramzswap devices");
+module_param(compressor, charp, 0);
+MODULE_PARM_DESC(compressor, "Compression algorithm: lzo (default) or lz4");
 
 module_init(ramzswap_init);
 module_exit(ramzswap_exit);
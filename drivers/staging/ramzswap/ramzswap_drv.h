@@ -106,8 +106,19 @@ struct ramzswap_stats {
 #endif
 };
 
+/* lzo1x_1_compress() style compressor */
+struct ramzswap_compressor {
+	const char *name;
+	size_t workmem;		/* size of compress_workmem */
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len);
+};
+
 struct ramzswap {
 	struct xv_pool *mem_pool;
+	const struct ramzswap_compressor *comp;
 	void *compress_workmem;
 	void *compress_buffer;
 	struct table *table;
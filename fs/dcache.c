@@ -106,8 +106,10 @@ static void dentry_iput(struct dentry * dentry)
 {
 	struct inode *inode = dentry->d_inode;
 	if (inode) {
+		write_seqcount_begin(&dentry->d_seq);
 		dentry->d_inode = NULL;
 		list_del_init(&dentry->d_alias);
+		write_seqcount_end(&dentry->d_seq);
 		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
 		if (!inode->i_nlink)
@@ -949,6 +951,7 @@ struct dentry *d_alloc(struct dentry * parent, const struct qstr *name)
 	atomic_set(&dentry->d_count, 1);
 	dentry->d_flags = DCACHE_UNHASHED;
 	spin_lock_init(&dentry->d_lock);
+	seqcount_init(&dentry->d_seq);
 	dentry->d_inode = NULL;
 	dentry->d_parent = NULL;
 	dentry->d_sb = NULL;
@@ -993,7 +996,9 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 {
 	if (inode)
 		list_add(&dentry->d_alias, &inode->i_dentry);
+	write_seqcount_begin(&dentry->d_seq);
 	dentry->d_inode = inode;
+	write_seqcount_end(&dentry->d_seq);
 	fsnotify_d_instantiate(dentry, inode);
 }
 
@@ -1431,6 +1436,86 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking any locks
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ * @seq: returns the ->d_seq of the dentry found
+ *
+ * This is __d_lookup() for the RCU path walk: it neither takes ->d_lock
+ * nor a reference.  The caller must be in rcu_read_lock(), and whatever
+ * it reads from the dentry, ->d_inode included, is only known to be
+ * consistent after read_seqcount_retry(&dentry->d_seq, *@seq) says so.
+ *
+ * A concurrent d_move() may make us miss the dentry, so %NULL means
+ * "not found this time" and never "negative".  Parents with their own
+ * ->d_compare() are not handled here.
+ */
+struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name,
+			      unsigned *seq)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent, hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		const unsigned char *tname;
+		unsigned int tlen;
+		unsigned s;
+
+		if (dentry->d_name.hash != hash)
+			continue;
+seqretry:
+		s = read_seqcount_begin(&dentry->d_seq);
+		if (dentry->d_parent != parent)
+			continue;
+		if (d_unhashed(dentry))
+			continue;
+		tlen = dentry->d_name.len;
+		tname = dentry->d_name.name;
+		if (read_seqcount_retry(&dentry->d_seq, s)) {
+			cpu_relax();
+			goto seqretry;
+		}
+		/*
+		 * A rename may still change the name under us.  Then the
+		 * compare can go either way, but the caller's final check
+		 * of @seq fails and the result is thrown away.
+		 */
+		if (tlen != len || memcmp(tname, str, len))
+			continue;
+		*seq = s;
+		return dentry;
+	}
+	return NULL;
+}
+
+/**
+ * d_get_rcu - pin a dentry found by the RCU path walk
+ * @dentry: dentry to take a reference on
+ * @seq: ->d_seq the walk saw the dentry with
+ *
+ * Returns 1 with a reference held if @dentry has not changed since @seq
+ * was sampled, and 0 otherwise.  Nothing can kill the dentry without
+ * bumping ->d_seq under ->d_lock first, so, like the resurrection in
+ * __d_lookup(), this is safe even if the count is zero.
+ */
+int d_get_rcu(struct dentry *dentry, unsigned seq)
+{
+	int ret = 0;
+
+	spin_lock(&dentry->d_lock);
+	if (!read_seqcount_retry(&dentry->d_seq, seq)) {
+		atomic_inc(&dentry->d_count);
+		ret = 1;
+	}
+	spin_unlock(&dentry->d_lock);
+	return ret;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -1664,6 +1749,12 @@ static void d_move_locked(struct dentry * dentry, struct dentry * target)
 		spin_lock_nested(&target->d_lock, DENTRY_D_LOCK_NESTED);
 	}
 
+	/* Unhash the target: dput() will then get rid of it */
+	__d_drop(target);
+
+	write_seqcount_begin(&dentry->d_seq);
+	write_seqcount_begin(&target->d_seq);
+
 	/* Move the dentry to the target hash queue, if on different bucket */
 	if (d_unhashed(dentry))
 		goto already_unhashed;
@@ -1674,9 +1765,6 @@ already_unhashed:
 	list = d_hash(target->d_parent, target->d_name.hash);
 	__d_rehash(dentry, list);
 
-	/* Unhash the target: dput() will then get rid of it */
-	__d_drop(target);
-
 	list_del(&dentry->d_u.d_child);
 	list_del(&target->d_u.d_child);
 
@@ -1697,6 +1785,8 @@ already_unhashed:
 	}
 
 	list_add(&dentry->d_u.d_child, &dentry->d_parent->d_subdirs);
+	write_seqcount_end(&target->d_seq);
+	write_seqcount_end(&dentry->d_seq);
 	spin_unlock(&target->d_lock);
 	fsnotify_d_move(dentry);
 	spin_unlock(&dentry->d_lock);
@@ -1791,6 +1881,9 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 {
 	struct dentry *dparent, *aparent;
 
+	write_seqcount_begin(&dentry->d_seq);
+	write_seqcount_begin(&anon->d_seq);
+
 	switch_names(dentry, anon);
 	swap(dentry->d_name.hash, anon->d_name.hash);
 
@@ -1811,6 +1904,9 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 	else
 		INIT_LIST_HEAD(&anon->d_u.d_child);
 
+	write_seqcount_end(&anon->d_seq);
+	write_seqcount_end(&dentry->d_seq);
+
 	anon->d_flags &= ~DCACHE_DISCONNECTED;
 }
 
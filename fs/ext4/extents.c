@@ -142,6 +142,7 @@ static int ext4_ext_dirty(handle_t *handle, struct inode *inode,
 	int err;
 	if (path->p_bh) {
 		/* path points to block */
+		ext4_fc_mark_ineligible(inode->i_sb, handle);
 		err = ext4_handle_dirty_metadata(handle, inode, path->p_bh);
 	} else {
 		/* path points to leaf/index in inode body */
@@ -3404,8 +3405,22 @@ int ext4_ext_map_blocks(handle_t *handle, struct inode *inode,
 				ext4_ext_put_in_cache(inode, ee_block,
 							ee_len, ee_start,
 							EXT4_EXT_CACHE_EXTENT);
+				ext4_es_insert_extent(inode, ee_block, ee_len,
+						      ee_start,
+						      EXTENT_STATUS_WRITTEN);
 				goto out;
 			}
+			/*
+			 * A lookup can remember the extent as unwritten;
+			 * anything else may split or convert it, so forget
+			 * it and let the next lookup find the new layout.
+			 */
+			if ((flags & EXT4_GET_BLOCKS_CREATE) == 0)
+				ext4_es_insert_extent(inode, ee_block, ee_len,
+						      ee_start,
+						      EXTENT_STATUS_UNWRITTEN);
+			else
+				ext4_es_remove_extent(inode, ee_block, ee_len);
 			ret = ext4_ext_handle_uninitialized_extents(handle,
 					inode, map, path, flags, allocated,
 					newblock);
@@ -3558,9 +3573,14 @@ int ext4_ext_map_blocks(handle_t *handle, struct inode *inode,
 	if ((flags & EXT4_GET_BLOCKS_UNINIT_EXT) == 0) {
 		ext4_ext_put_in_cache(inode, map->m_lblk, allocated, newblock,
 						EXT4_EXT_CACHE_EXTENT);
+		ext4_es_insert_extent(inode, map->m_lblk, allocated, newblock,
+				      EXTENT_STATUS_WRITTEN);
 		ext4_update_inode_fsync_trans(handle, inode, 1);
-	} else
+	} else {
+		ext4_es_insert_extent(inode, map->m_lblk, allocated, newblock,
+				      EXTENT_STATUS_UNWRITTEN);
 		ext4_update_inode_fsync_trans(handle, inode, 0);
+	}
 out:
 	if (allocated > map->m_len)
 		allocated = map->m_len;
@@ -3615,6 +3635,7 @@ void ext4_ext_truncate(struct inode *inode)
 
 	last_block = (inode->i_size + sb->s_blocksize - 1)
 			>> EXT4_BLOCK_SIZE_BITS(sb);
+	ext4_es_remove_extent(inode, last_block, EXT_MAX_BLOCK);
 	err = ext4_ext_remove_space(inode, last_block);
 
 	/* In a multi-transaction truncate, we only make the final
@@ -3816,6 +3837,48 @@ int ext4_convert_unwritten_extents(struct inode *inode, loff_t offset,
 	}
 	return ret > 0 ? ret2 : ret;
 }
+/*
+ * Report the delayed allocated ranges inside a hole, as recorded in the
+ * extent status tree.
+ */
+static int ext4_ext_fiemap_delayed(struct inode *inode,
+				   struct ext4_ext_path *path,
+				   struct ext4_ext_cache *newex,
+				   struct fiemap_extent_info *fieinfo)
+{
+	unsigned char blksize_bits = inode->i_sb->s_blocksize_bits;
+	__u64 end = (__u64)newex->ec_block + newex->ec_len;
+	struct extent_status es, next;
+	int last, more, error;
+
+	/* see ext4_ext_fiemap_cb() */
+	last = ext4_ext_next_allocated_block(path) == EXT_MAX_BLOCK ||
+	       end - 1 == EXT_MAX_BLOCK;
+
+	more = ext4_es_find_delayed_extent(inode, newex->ec_block, &es);
+	while (more && es.es_lblk < end) {
+		__u64 start = max_t(__u64, es.es_lblk, newex->ec_block);
+		__u64 stop = min_t(__u64, (__u64)es.es_lblk + es.es_len, end);
+		__u32 flags = FIEMAP_EXTENT_DELALLOC;
+
+		more = stop < end &&
+		       ext4_es_find_delayed_extent(inode, stop, &next);
+		if (last && (!more || next.es_lblk >= end))
+			flags |= FIEMAP_EXTENT_LAST;
+
+		error = fiemap_fill_next_extent(fieinfo,
+						start << blksize_bits, 0,
+						(stop - start) << blksize_bits,
+						flags);
+		if (error < 0)
+			return error;
+		if (error == 1)
+			return EXT_BREAK;
+		es = next;
+	}
+	return EXT_CONTINUE;
+}
+
 /*
  * Callback function called for each extent to gather FIEMAP information.
  */
@@ -3825,38 +3888,17 @@ static int ext4_ext_fiemap_cb(struct inode *inode, struct ext4_ext_path *path,
 {
 	struct fiemap_extent_info *fieinfo = data;
 	unsigned char blksize_bits = inode->i_sb->s_blocksize_bits;
+	struct extent_status es;
 	__u64	logical;
 	__u64	physical;
 	__u64	length;
 	__u32	flags = 0;
 	int	error;
 
-	logical =  (__u64)newex->ec_block << blksize_bits;
-
-	if (newex->ec_type == EXT4_EXT_CACHE_GAP) {
-		pgoff_t offset;
-		struct page *page;
-		struct buffer_head *bh = NULL;
-
-		offset = logical >> PAGE_SHIFT;
-		page = find_get_page(inode->i_mapping, offset);
-		if (!page || !page_has_buffers(page))
-			return EXT_CONTINUE;
-
-		bh = page_buffers(page);
-
-		if (!bh)
-			return EXT_CONTINUE;
-
-		if (buffer_delay(bh)) {
-			flags |= FIEMAP_EXTENT_DELALLOC;
-			page_cache_release(page);
-		} else {
-			page_cache_release(page);
-			return EXT_CONTINUE;
-		}
-	}
+	if (newex->ec_type == EXT4_EXT_CACHE_GAP)
+		return ext4_ext_fiemap_delayed(inode, path, newex, fieinfo);
 
+	logical =  (__u64)newex->ec_block << blksize_bits;
 	physical = (__u64)newex->ec_start << blksize_bits;
 	length =   (__u64)newex->ec_len << blksize_bits;
 
@@ -3870,17 +3912,15 @@ static int ext4_ext_fiemap_cb(struct inode *inode, struct ext4_ext_path *path,
 	 * this also indicates no more allocated blocks.
 	 *
 	 * XXX this might miss a single-block extent at EXT_MAX_BLOCK
+	 *
+	 * Delayed allocated blocks past it still follow, though.
 	 */
-	if (ext4_ext_next_allocated_block(path) == EXT_MAX_BLOCK ||
-	    newex->ec_block + newex->ec_len - 1 == EXT_MAX_BLOCK) {
-		loff_t size = i_size_read(inode);
-		loff_t bs = EXT4_BLOCK_SIZE(inode->i_sb);
-
+	if (newex->ec_block + newex->ec_len - 1 == EXT_MAX_BLOCK)
+		flags |= FIEMAP_EXTENT_LAST;
+	else if (ext4_ext_next_allocated_block(path) == EXT_MAX_BLOCK &&
+		 !ext4_es_find_delayed_extent(inode,
+				newex->ec_block + newex->ec_len, &es))
 		flags |= FIEMAP_EXTENT_LAST;
-		if ((flags & FIEMAP_EXTENT_DELALLOC) &&
-		    logical+length > size)
-			length = (size - logical + bs - 1) & ~(bs-1);
-	}
 
 	error = fiemap_fill_next_extent(fieinfo, logical, physical,
 					length, flags);
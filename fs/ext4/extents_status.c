@@ -0,0 +1,457 @@
+/*
+ *  fs/ext4/extents_status.c
+ *
+ *  In-memory tree of the extents of an inode.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  ext4_map_blocks() looks up the tree before it goes to the on-disk
+ *  extent tree or indirect blocks, so that repeated lookups in a large,
+ *  fragmented file do not walk the whole path each time.  Entries never
+ *  overlap, are indexed by logical block, and are either a copy of what
+ *  is on disk (written or unwritten extents) or a range of blocks that
+ *  delayed allocation has reserved but not allocated yet.
+ *
+ *  Whoever changes the block mapping of an inode updates the tree while
+ *  it still holds i_data_sem for writing; entries found on disk are added
+ *  with i_data_sem held for reading.  The tree itself is protected by
+ *  i_es_lock, so lookups need not take i_data_sem at all.
+ *
+ *  Written and unwritten entries can always be dropped again, and a
+ *  shrinker does that when memory is short.  Delayed entries stay until
+ *  writeback allocates the blocks or the pages are thrown away, since
+ *  nothing on disk knows about them.
+ */
+
+#include <linux/fs.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/dcache.h>
+#include "ext4.h"
+#include "ext4_extents.h"
+
+static struct kmem_cache *ext4_es_cachep;
+
+int __init init_ext4_es(void)
+{
+	ext4_es_cachep = KMEM_CACHE(extent_status, SLAB_RECLAIM_ACCOUNT);
+	if (ext4_es_cachep == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+void exit_ext4_es(void)
+{
+	kmem_cache_destroy(ext4_es_cachep);
+}
+
+void ext4_es_init_tree(struct ext4_es_tree *tree)
+{
+	tree->root = RB_ROOT;
+}
+
+static inline ext4_lblk_t ext4_es_end(struct extent_status *es)
+{
+	return es->es_lblk + es->es_len - 1;
+}
+
+static inline struct extent_status *ext4_es_next(struct extent_status *es)
+{
+	struct rb_node *node = rb_next(&es->rb_node);
+
+	return node ? rb_entry(node, struct extent_status, rb_node) : NULL;
+}
+
+/* Return the entry containing @lblk, or else the first one after it */
+static struct extent_status *__es_tree_search(struct rb_root *root,
+					      ext4_lblk_t lblk)
+{
+	struct rb_node *node = root->rb_node;
+	struct extent_status *es = NULL;
+
+	while (node) {
+		es = rb_entry(node, struct extent_status, rb_node);
+		if (lblk < es->es_lblk)
+			node = node->rb_left;
+		else if (lblk > ext4_es_end(es))
+			node = node->rb_right;
+		else
+			return es;
+	}
+
+	/* We stopped at the entry just before or just after @lblk */
+	if (es && lblk > ext4_es_end(es))
+		es = ext4_es_next(es);
+	return es;
+}
+
+/* Only entries that can be reclaimed are counted */
+static void ext4_es_account(struct inode *inode, struct extent_status *es,
+			    int nr)
+{
+	if (ext4_es_is_delayed(es))
+		return;
+	EXT4_I(inode)->i_es_lru_nr += nr;
+	percpu_counter_add(&EXT4_SB(inode->i_sb)->s_extent_cache_cnt, nr);
+}
+
+static void __es_link(struct inode *inode, struct extent_status *new)
+{
+	struct rb_root *root = &EXT4_I(inode)->i_es_tree.root;
+	struct rb_node **p = &root->rb_node;
+	struct rb_node *parent = NULL;
+	struct extent_status *es;
+
+	while (*p) {
+		parent = *p;
+		es = rb_entry(parent, struct extent_status, rb_node);
+		if (new->es_lblk < es->es_lblk)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&new->rb_node, parent, p);
+	rb_insert_color(&new->rb_node, root);
+	ext4_es_account(inode, new, 1);
+}
+
+static void __es_unlink(struct inode *inode, struct extent_status *es)
+{
+	rb_erase(&es->rb_node, &EXT4_I(inode)->i_es_tree.root);
+	ext4_es_account(inode, es, -1);
+	kmem_cache_free(ext4_es_cachep, es);
+}
+
+/* Can @es2, which starts right after @es1 ends, be folded into it? */
+static int ext4_es_can_merge(struct extent_status *es1,
+			     struct extent_status *es2)
+{
+	if ((es1->es_pblk ^ es2->es_pblk) & EXTENT_STATUS_FLAGS)
+		return 0;
+	if (ext4_es_end(es1) + 1 != es2->es_lblk)
+		return 0;
+	if (es1->es_len + es2->es_len < es1->es_len)
+		return 0;
+	if (!ext4_es_is_delayed(es1) &&
+	    ext4_es_pblock(es1) + es1->es_len != ext4_es_pblock(es2))
+		return 0;
+	return 1;
+}
+
+static void __es_try_to_merge(struct inode *inode, struct extent_status *es)
+{
+	struct rb_node *node;
+	struct extent_status *prev, *next;
+
+	node = rb_prev(&es->rb_node);
+	if (node) {
+		prev = rb_entry(node, struct extent_status, rb_node);
+		if (ext4_es_can_merge(prev, es)) {
+			prev->es_len += es->es_len;
+			__es_unlink(inode, es);
+			es = prev;
+		}
+	}
+
+	next = ext4_es_next(es);
+	if (next && ext4_es_can_merge(es, next)) {
+		es->es_len += next->es_len;
+		__es_unlink(inode, next);
+	}
+}
+
+/*
+ * Cut [lblk, end] out of the tree.  Cutting a hole into the middle of an
+ * entry takes a new one for its tail, which has to come from *spare; if
+ * that is needed and *spare is NULL, nothing is changed and -ENOMEM is
+ * returned.
+ */
+static int __es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			      ext4_lblk_t end, struct extent_status **spare)
+{
+	struct extent_status *es, *tail, *next;
+	ext4_lblk_t delta;
+
+	es = __es_tree_search(&EXT4_I(inode)->i_es_tree.root, lblk);
+	if (!es || es->es_lblk > end)
+		return 0;
+
+	if (es->es_lblk < lblk && ext4_es_end(es) > end) {
+		if (!*spare)
+			return -ENOMEM;
+		tail = *spare;
+		*spare = NULL;
+		delta = end + 1 - es->es_lblk;
+		tail->es_lblk = end + 1;
+		tail->es_len = es->es_len - delta;
+		tail->es_pblk = es->es_pblk;
+		if (!ext4_es_is_delayed(es))
+			tail->es_pblk += delta;
+		es->es_len = lblk - es->es_lblk;
+		__es_link(inode, tail);
+		return 0;
+	}
+
+	if (es->es_lblk < lblk) {
+		es->es_len = lblk - es->es_lblk;
+		es = ext4_es_next(es);
+	}
+	while (es && ext4_es_end(es) <= end) {
+		next = ext4_es_next(es);
+		__es_unlink(inode, es);
+		es = next;
+	}
+	if (es && es->es_lblk <= end) {
+		delta = end + 1 - es->es_lblk;
+		es->es_lblk = end + 1;
+		es->es_len -= delta;
+		if (!ext4_es_is_delayed(es))
+			es->es_pblk += delta;
+	}
+	return 0;
+}
+
+/* Take i_es_lock for writing and cut [lblk, end] out of the tree */
+static void es_lock_and_remove(struct inode *inode, ext4_lblk_t lblk,
+			       ext4_lblk_t end)
+{
+	rwlock_t *lock = &EXT4_I(inode)->i_es_lock;
+	struct extent_status *spare = NULL;
+
+	write_lock(lock);
+	while (__es_remove_extent(inode, lblk, end, &spare)) {
+		write_unlock(lock);
+		spare = kmem_cache_alloc(ext4_es_cachep,
+					 GFP_NOFS | __GFP_NOFAIL);
+		write_lock(lock);
+	}
+	if (spare)
+		kmem_cache_free(ext4_es_cachep, spare);
+}
+
+static void ext4_es_lru_add(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	if (!list_empty(&ei->i_es_lru))
+		return;
+	spin_lock(&sbi->s_es_lru_lock);
+	if (list_empty(&ei->i_es_lru))
+		list_add_tail(&ei->i_es_lru, &sbi->s_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+}
+
+/**
+ * ext4_es_insert_extent() - record the state of a range of blocks
+ * @inode: inode the blocks belong to
+ * @lblk: first logical block
+ * @len: number of blocks
+ * @pblk: first physical block, unless @status is EXTENT_STATUS_DELAYED
+ * @status: one of the EXTENT_STATUS_* values
+ *
+ * Whatever the tree said about the range before is forgotten.  Returns
+ * -ENOMEM if the new entry could not be allocated, in which case the
+ * range is simply left out of the tree.
+ */
+int ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
+			  ext4_lblk_t len, ext4_fsblk_t pblk,
+			  unsigned long long status)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status *new;
+
+	if (len > EXT_MAX_BLOCK - lblk)
+		len = EXT_MAX_BLOCK - lblk;
+	if (!len)
+		return 0;
+
+	new = kmem_cache_alloc(ext4_es_cachep, GFP_NOFS);
+	if (!new) {
+		ext4_es_remove_extent(inode, lblk, len);
+		return -ENOMEM;
+	}
+	new->es_lblk = lblk;
+	new->es_len = len;
+	new->es_pblk = status;
+	if (!(status & EXTENT_STATUS_DELAYED))
+		new->es_pblk |= pblk;
+
+	es_lock_and_remove(inode, lblk, lblk + len - 1);
+	__es_link(inode, new);
+	__es_try_to_merge(inode, new);
+	write_unlock(&ei->i_es_lock);
+
+	if (!(status & EXTENT_STATUS_DELAYED))
+		ext4_es_lru_add(inode);
+	return 0;
+}
+
+/**
+ * ext4_es_remove_extent() - forget a range of blocks
+ * @inode: inode the blocks belong to
+ * @lblk: first logical block
+ * @len: number of blocks; EXT_MAX_BLOCK means up to the end of the file
+ */
+void ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			   ext4_lblk_t len)
+{
+	ext4_lblk_t end;
+
+	if (!len)
+		return;
+	if (len > EXT_MAX_BLOCK - lblk)
+		end = EXT_MAX_BLOCK;
+	else
+		end = lblk + len - 1;
+
+	es_lock_and_remove(inode, lblk, end);
+	write_unlock(&EXT4_I(inode)->i_es_lock);
+}
+
+/**
+ * ext4_es_lookup_extent() - look up the entry covering a block
+ * @inode: inode the block belongs to
+ * @lblk: logical block
+ * @es: where to return a copy of the entry
+ *
+ * Returns 1 if the tree knows about @lblk, and 0 otherwise.
+ */
+int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
+			  struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status *found;
+	int ret = 0;
+
+	read_lock(&ei->i_es_lock);
+	found = __es_tree_search(&ei->i_es_tree.root, lblk);
+	if (found && found->es_lblk <= lblk) {
+		es->es_lblk = found->es_lblk;
+		es->es_len = found->es_len;
+		es->es_pblk = found->es_pblk;
+		ret = 1;
+	}
+	read_unlock(&ei->i_es_lock);
+	return ret;
+}
+
+/**
+ * ext4_es_find_delayed_extent() - find delayed blocks at or after a block
+ * @inode: inode to look at
+ * @lblk: logical block to start at
+ * @es: where to return a copy of the first delayed entry
+ *
+ * Returns 1 if there is a delayed entry containing or following @lblk,
+ * and 0 otherwise.
+ */
+int ext4_es_find_delayed_extent(struct inode *inode, ext4_lblk_t lblk,
+				struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status *found;
+	int ret = 0;
+
+	read_lock(&ei->i_es_lock);
+	found = __es_tree_search(&ei->i_es_tree.root, lblk);
+	while (found && !ext4_es_is_delayed(found))
+		found = ext4_es_next(found);
+	if (found) {
+		es->es_lblk = found->es_lblk;
+		es->es_len = found->es_len;
+		es->es_pblk = found->es_pblk;
+		ret = 1;
+	}
+	read_unlock(&ei->i_es_lock);
+	return ret;
+}
+
+/* Called when the inode goes away */
+void ext4_es_drop_inode(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct rb_node *node;
+
+	spin_lock(&sbi->s_es_lru_lock);
+	list_del_init(&ei->i_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+
+	write_lock(&ei->i_es_lock);
+	while ((node = rb_first(&ei->i_es_tree.root)) != NULL)
+		__es_unlink(inode, rb_entry(node, struct extent_status,
+					    rb_node));
+	write_unlock(&ei->i_es_lock);
+}
+
+static int __es_try_to_reclaim_extents(struct inode *inode, int nr_to_scan)
+{
+	struct rb_node *node = rb_first(&EXT4_I(inode)->i_es_tree.root);
+	struct extent_status *es;
+	int nr_shrunk = 0;
+
+	while (node && nr_shrunk < nr_to_scan) {
+		es = rb_entry(node, struct extent_status, rb_node);
+		node = rb_next(node);
+		if (!ext4_es_is_delayed(es)) {
+			__es_unlink(inode, es);
+			nr_shrunk++;
+		}
+	}
+	return nr_shrunk;
+}
+
+/*
+ * Inodes are on the LRU in the order they got their first reclaimable
+ * entry.  Each one visited gives up as many entries as are still to be
+ * scanned, and goes to the back of the list if it has any left.
+ */
+static int ext4_es_shrink(struct shrinker *shrink, int nr_to_scan,
+			  gfp_t gfp_mask)
+{
+	struct ext4_sb_info *sbi = container_of(shrink, struct ext4_sb_info,
+						s_es_shrinker);
+	struct ext4_inode_info *ei, *tmp;
+	LIST_HEAD(scanned);
+	int nr;
+
+	if (nr_to_scan) {
+		spin_lock(&sbi->s_es_lru_lock);
+		list_for_each_entry_safe(ei, tmp, &sbi->s_es_lru, i_es_lru) {
+			if (nr_to_scan <= 0)
+				break;
+			if (!write_trylock(&ei->i_es_lock)) {
+				list_move_tail(&ei->i_es_lru, &scanned);
+				continue;
+			}
+			nr_to_scan -= __es_try_to_reclaim_extents(
+						&ei->vfs_inode, nr_to_scan);
+			if (ei->i_es_lru_nr)
+				list_move_tail(&ei->i_es_lru, &scanned);
+			else
+				list_del_init(&ei->i_es_lru);
+			write_unlock(&ei->i_es_lock);
+		}
+		list_splice_tail(&scanned, &sbi->s_es_lru);
+		spin_unlock(&sbi->s_es_lru_lock);
+	}
+
+	nr = percpu_counter_read_positive(&sbi->s_extent_cache_cnt);
+	return (nr / 100) * sysctl_vfs_cache_pressure;
+}
+
+void ext4_es_register_shrinker(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	sbi->s_es_shrinker.shrink = ext4_es_shrink;
+	sbi->s_es_shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&sbi->s_es_shrinker);
+}
+
+void ext4_es_unregister_shrinker(struct super_block *sb)
+{
+	unregister_shrinker(&EXT4_SB(sb)->s_es_shrinker);
+}
@@ -0,0 +1,450 @@
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ *  Fast commits: making fsync() of a single inode durable without
+ *  committing the running transaction.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  A fast commit writes one block to the jbd2 fast commit area holding
+ *  a copy of the on-disk inode.  That is enough as long as everything
+ *  the running transaction did to the metadata of the file is in the
+ *  inode itself: size, times, and extents in the inode's own i_block.
+ *  The block bitmaps and group descriptors covering those extents are
+ *  reconstructed from the inode at replay time.
+ *
+ *  Every other kind of metadata change (directory entries, inode and
+ *  block frees, extent tree blocks, xattr blocks, resize, ...) marks
+ *  the running transaction ineligible, and fsync falls back to a full
+ *  commit until that transaction is committed.
+ */
+
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/crc32.h>
+#include <linux/quotaops.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+#include "fast_commit.h"
+
+/* Room taken by a fast commit besides the raw inode */
+#define EXT4_FC_OVERHEAD	(3 * sizeof(struct ext4_fc_tl) +	\
+				 sizeof(struct ext4_fc_head) +		\
+				 sizeof(struct ext4_fc_inode) +		\
+				 sizeof(struct ext4_fc_tail))
+
+/*
+ * Flag the running transaction of @handle as one that cannot be fast
+ * committed.  Called for every metadata change the fast commit block
+ * does not describe.
+ */
+void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle)
+{
+	if (!test_opt(sb, FAST_COMMIT) || !ext4_handle_valid(handle))
+		return;
+	EXT4_SB(sb)->s_fc_ineligible_tid = handle->h_transaction->t_tid;
+}
+
+/* Append a record to the block at *pos and return where its value goes */
+static u8 *ext4_fc_add_tlv(u8 **pos, u16 tag, u16 len)
+{
+	struct ext4_fc_tl tl;
+	u8 *val = *pos + sizeof(tl);
+
+	tl.fc_tag = cpu_to_le16(tag);
+	tl.fc_len = cpu_to_le16(len);
+	memcpy(*pos, &tl, sizeof(tl));
+	*pos = val + len;
+	return val;
+}
+
+/*
+ * Return the value of the record at *pos and advance *pos past it, or
+ * NULL if the record does not fit in the block.
+ */
+static u8 *ext4_fc_next_tlv(struct buffer_head *bh, u8 **pos,
+			    u16 *tag, u16 *len)
+{
+	struct ext4_fc_tl tl;
+	u8 *end = (u8 *)bh->b_data + bh->b_size;
+	u8 *val = *pos + sizeof(tl);
+
+	if (val > end)
+		return NULL;
+	memcpy(&tl, *pos, sizeof(tl));
+	*tag = le16_to_cpu(tl.fc_tag);
+	*len = le16_to_cpu(tl.fc_len);
+	if (val + *len > end)
+		return NULL;
+	*pos = val + *len;
+	return val;
+}
+
+static u32 ext4_fc_crc(struct buffer_head *bh, u8 *tail)
+{
+	u8 *start = (u8 *)bh->b_data;
+
+	return crc32_be(~0, start,
+			tail + offsetof(struct ext4_fc_tail, fc_crc) - start);
+}
+
+static void ext4_fc_fill_block(struct buffer_head *bh, struct inode *inode,
+			       struct ext4_inode *raw_inode, tid_t tid)
+{
+	int inode_size = EXT4_INODE_SIZE(inode->i_sb);
+	struct ext4_fc_head head;
+	struct ext4_fc_tail tail;
+	__le32 ino = cpu_to_le32(inode->i_ino);
+	u8 *pos = (u8 *)bh->b_data;
+	u8 *val;
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, bh->b_size);
+
+	head.fc_features = cpu_to_le32(EXT4_FC_SUPPORTED_FEATURES);
+	head.fc_tid = cpu_to_le32(tid);
+	val = ext4_fc_add_tlv(&pos, EXT4_FC_TAG_HEAD, sizeof(head));
+	memcpy(val, &head, sizeof(head));
+
+	val = ext4_fc_add_tlv(&pos, EXT4_FC_TAG_INODE,
+			      sizeof(struct ext4_fc_inode) + inode_size);
+	memcpy(val, &ino, sizeof(ino));
+	memcpy(val + sizeof(struct ext4_fc_inode), raw_inode, inode_size);
+
+	val = ext4_fc_add_tlv(&pos, EXT4_FC_TAG_TAIL, sizeof(tail));
+	tail.fc_tid = cpu_to_le32(tid);
+	memcpy(val, &tail.fc_tid, sizeof(tail.fc_tid));
+	tail.fc_crc = cpu_to_le32(ext4_fc_crc(bh, val));
+	memcpy(val, &tail, sizeof(tail));
+
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+}
+
+/*
+ * Copy @inode into a fast commit block and write it out.  Called inside
+ * the fast commit window, so it must not start handles or wait for the
+ * transaction to commit: the commit waits for the window to close.
+ */
+static int ext4_fc_perform_commit(struct inode *inode, tid_t tid,
+				  struct ext4_iloc *iloc)
+{
+	struct super_block *sb = inode->i_sb;
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	struct address_space *mapping = inode->i_mapping;
+	struct buffer_head *bh = NULL;
+	int ret;
+
+	/*
+	 * The new size and extents must not expose blocks whose data is
+	 * not there yet: if anything was dirtied again since the caller
+	 * flushed the data, leave it to a full commit.
+	 */
+	if (EXT4_SB(sb)->s_fc_ineligible_tid == tid ||
+	    (ext4_should_order_data(inode) &&
+	     (mapping_tagged(mapping, PAGECACHE_TAG_DIRTY) ||
+	      mapping_tagged(mapping, PAGECACHE_TAG_WRITEBACK))))
+		ret = -EAGAIN;
+	else
+		ret = jbd2_fc_get_buf(journal, &bh);
+	if (!ret)
+		ext4_fc_fill_block(bh, inode, ext4_raw_inode(iloc), tid);
+	jbd2_journal_unlock_updates(journal);
+	if (ret)
+		return ret;
+
+	ret = jbd2_fc_write_bufs(journal, &bh, 1);
+	brelse(bh);
+	return ret;
+}
+
+/*
+ * Make the metadata of @inode changed in transaction @commit_tid
+ * durable with a fast commit.  Returns 0 if that worked, -EAGAIN if the
+ * caller has to commit the transaction in full, or another error if
+ * the data of the file could not be written.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t commit_tid)
+{
+	journal_t *journal = EXT4_SB(inode->i_sb)->s_journal;
+	struct ext4_iloc iloc;
+	int ret;
+
+	if (sb_any_quota_loaded(inode->i_sb))
+		return -EAGAIN;
+
+	/*
+	 * Writing back the data may start handles, which wait for the
+	 * commit of the running transaction if it is being locked down,
+	 * and that commit waits for any fast commit in progress.  So the
+	 * data has to be on disk before the fast commit begins.
+	 */
+	if (ext4_should_order_data(inode)) {
+		ret = filemap_write_and_wait(inode->i_mapping);
+		if (ret)
+			return ret;
+	}
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return -EAGAIN;
+
+	/*
+	 * Let the handles still running finish, so that the raw inode is
+	 * consistent and any change making the transaction ineligible has
+	 * been flagged, and keep new ones out while the inode is copied.
+	 * This is done before the fast commit begins, as the holder of the
+	 * barrier may itself be waiting for a full commit.
+	 */
+	jbd2_journal_lock_updates(journal);
+	do {
+		ret = jbd2_fc_begin_commit(journal, commit_tid);
+	} while (ret == -EAGAIN);
+	if (ret) {
+		jbd2_journal_unlock_updates(journal);
+		brelse(iloc.bh);
+		return -EAGAIN;
+	}
+
+	/* Drops the barrier once the inode is copied */
+	ret = ext4_fc_perform_commit(inode, commit_tid, &iloc);
+	jbd2_fc_end_commit(journal);
+	brelse(iloc.bh);
+	return ret ? -EAGAIN : 0;
+}
+
+/* Check a fast commit block written during transaction @tid */
+static int ext4_fc_block_valid(struct super_block *sb, struct buffer_head *bh,
+			       tid_t tid)
+{
+	struct ext4_fc_head head;
+	struct ext4_fc_tail tail;
+	u8 *pos = (u8 *)bh->b_data;
+	u8 *val;
+	u16 tag, len;
+
+	val = ext4_fc_next_tlv(bh, &pos, &tag, &len);
+	if (!val || tag != EXT4_FC_TAG_HEAD || len != sizeof(head))
+		return 0;
+	memcpy(&head, val, sizeof(head));
+	if (le32_to_cpu(head.fc_tid) != tid ||
+	    le32_to_cpu(head.fc_features) & ~EXT4_FC_SUPPORTED_FEATURES)
+		return 0;
+
+	while ((val = ext4_fc_next_tlv(bh, &pos, &tag, &len)) != NULL) {
+		switch (tag) {
+		case EXT4_FC_TAG_INODE:
+			if (len != sizeof(struct ext4_fc_inode) +
+				   EXT4_INODE_SIZE(sb))
+				return 0;
+			break;
+		case EXT4_FC_TAG_TAIL:
+			if (len != sizeof(tail))
+				return 0;
+			memcpy(&tail, val, sizeof(tail));
+			return le32_to_cpu(tail.fc_tid) == tid &&
+			       le32_to_cpu(tail.fc_crc) == ext4_fc_crc(bh, val);
+		default:
+			return 0;
+		}
+	}
+	return 0;
+}
+
+/* Mark @count blocks from @block in use in the bitmaps */
+static int ext4_fc_mark_used(struct super_block *sb, ext4_fsblk_t block,
+			     unsigned int count)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *gd_bh, *bitmap_bh;
+	ext4_group_t group;
+	ext4_grpblk_t bit;
+	unsigned int i, n, newly;
+
+	if (block < le32_to_cpu(sbi->s_es->s_first_data_block) ||
+	    block + count < block ||
+	    block + count > ext4_blocks_count(sbi->s_es))
+		return -EIO;
+
+	while (count) {
+		ext4_get_group_no_and_offset(sb, block, &group, &bit);
+		n = min_t(unsigned int, count, EXT4_BLOCKS_PER_GROUP(sb) - bit);
+		gdp = ext4_get_group_desc(sb, group, &gd_bh);
+		if (!gdp)
+			return -EIO;
+		/* Allocating from such a group is never fast committed */
+		if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT))
+			return -EIO;
+		bitmap_bh = sb_bread(sb, ext4_block_bitmap(sb, gdp));
+		if (!bitmap_bh)
+			return -EIO;
+
+		newly = 0;
+		lock_buffer(bitmap_bh);
+		for (i = 0; i < n; i++)
+			if (!ext4_set_bit(bit + i, bitmap_bh->b_data))
+				newly++;
+		unlock_buffer(bitmap_bh);
+		if (newly) {
+			mark_buffer_dirty(bitmap_bh);
+			ext4_free_blks_set(sb, gdp,
+					   ext4_free_blks_count(sb, gdp) - newly);
+			gdp->bg_checksum = ext4_group_desc_csum(sbi, group, gdp);
+			mark_buffer_dirty(gd_bh);
+		}
+		brelse(bitmap_bh);
+		block += n;
+		count -= n;
+	}
+	return 0;
+}
+
+static int ext4_fc_replay_extents(struct super_block *sb,
+				  struct ext4_inode *raw_inode)
+{
+	struct ext4_extent_header *eh;
+	struct ext4_extent *ex;
+	int i, ret;
+
+	if (!(le32_to_cpu(raw_inode->i_flags) & EXT4_EXTENTS_FL))
+		return 0;
+	eh = (struct ext4_extent_header *)raw_inode->i_block;
+	if (eh->eh_magic != EXT4_EXT_MAGIC ||
+	    le16_to_cpu(eh->eh_entries) > le16_to_cpu(eh->eh_max))
+		return -EIO;
+	/* Index blocks would have made the transaction ineligible */
+	if (eh->eh_depth)
+		return 0;
+
+	ex = EXT_FIRST_EXTENT(eh);
+	for (i = 0; i < le16_to_cpu(eh->eh_entries); i++, ex++) {
+		ret = ext4_fc_mark_used(sb, ext_pblock(ex),
+					ext4_ext_get_actual_len(ex));
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* Write the inode image at @val back to the inode table */
+static int ext4_fc_replay_inode(struct super_block *sb, u8 *val)
+{
+	int inode_size = EXT4_INODE_SIZE(sb);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	struct ext4_inode *raw_inode;
+	ext4_group_t group;
+	unsigned long ino, offset;
+	__le32 raw_ino;
+	int ret;
+
+	memcpy(&raw_ino, val, sizeof(raw_ino));
+	ino = le32_to_cpu(raw_ino);
+	if (!ext4_valid_inum(sb, ino) || ino == EXT4_JOURNAL_INO)
+		return -EIO;
+
+	group = (ino - 1) / EXT4_INODES_PER_GROUP(sb);
+	offset = ((ino - 1) % EXT4_INODES_PER_GROUP(sb)) * inode_size;
+	gdp = ext4_get_group_desc(sb, group, NULL);
+	if (!gdp)
+		return -EIO;
+	bh = sb_bread(sb, ext4_inode_table(sb, gdp) +
+		      (offset >> EXT4_BLOCK_SIZE_BITS(sb)));
+	if (!bh)
+		return -EIO;
+
+	raw_inode = (struct ext4_inode *)(bh->b_data +
+					  (offset & (sb->s_blocksize - 1)));
+	lock_buffer(bh);
+	memcpy(raw_inode, val + sizeof(struct ext4_fc_inode), inode_size);
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+
+	ret = ext4_fc_replay_extents(sb, raw_inode);
+	brelse(bh);
+	return ret;
+}
+
+static int ext4_fc_replay_block(struct super_block *sb, struct buffer_head *bh)
+{
+	u8 *pos = (u8 *)bh->b_data;
+	u8 *val;
+	u16 tag, len;
+	int ret;
+
+	/* The scan pass has checked the format */
+	while ((val = ext4_fc_next_tlv(bh, &pos, &tag, &len)) != NULL) {
+		switch (tag) {
+		case EXT4_FC_TAG_INODE:
+			ret = ext4_fc_replay_inode(sb, val);
+			if (ret)
+				return ret;
+			break;
+		case EXT4_FC_TAG_TAIL:
+			return 0;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Called by jbd2 recovery for each block of the fast commit area.  The
+ * scan pass finds how many blocks belong to the last transaction in
+ * the log, the replay pass applies them on top of it.
+ */
+static int ext4_fc_replay(journal_t *journal, struct buffer_head *bh,
+			  enum passtype pass, int off, tid_t expected_tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int ret;
+
+	switch (pass) {
+	case PASS_SCAN:
+		if (off == 0)
+			sbi->s_fc_replay_blks = 0;
+		if (!ext4_fc_block_valid(sb, bh, expected_tid))
+			return JBD2_FC_REPLAY_STOP;
+		sbi->s_fc_replay_blks = off + 1;
+		return JBD2_FC_REPLAY_CONTINUE;
+	case PASS_REPLAY:
+		if (off >= sbi->s_fc_replay_blks)
+			return JBD2_FC_REPLAY_STOP;
+		ret = ext4_fc_replay_block(sb, bh);
+		if (ret)
+			return ret;
+		if (off + 1 == sbi->s_fc_replay_blks)
+			ext4_msg(sb, KERN_INFO, "replayed %u fast commit blocks",
+				 sbi->s_fc_replay_blks);
+		return JBD2_FC_REPLAY_CONTINUE;
+	default:
+		return JBD2_FC_REPLAY_STOP;
+	}
+}
+
+/* Hook up fast commit replay before the journal is loaded */
+void ext4_fc_init(journal_t *journal)
+{
+	journal->j_fc_replay_callback = ext4_fc_replay;
+}
+
+/*
+ * Turn on fast commits for a mounted filesystem, adding the feature to
+ * the journal if needed.
+ */
+int ext4_fc_enable(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (EXT4_INODE_SIZE(sb) + EXT4_FC_OVERHEAD > sb->s_blocksize)
+		return -EINVAL;
+	if (!jbd2_journal_set_features(sbi->s_journal, 0, 0,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return -EINVAL;
+	sbi->s_fc_ineligible_tid = sbi->s_journal->j_commit_sequence;
+	return 0;
+}
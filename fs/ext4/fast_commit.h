@@ -0,0 +1,48 @@
+/*
+ *  linux/fs/ext4/fast_commit.h
+ *
+ *  On-disk format of ext4 fast commits.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#ifndef _EXT4_FAST_COMMIT_H
+#define _EXT4_FAST_COMMIT_H
+
+/*
+ * A fast commit is one block in the jbd2 fast commit area, holding a
+ * sequence of tag-length-value records: a HEAD, the changes, and a TAIL
+ * whose checksum covers everything in the block before it.  All fields
+ * are little endian, and records are not aligned.
+ */
+#define EXT4_FC_TAG_HEAD	0x0001	/* struct ext4_fc_head */
+#define EXT4_FC_TAG_INODE	0x0002	/* struct ext4_fc_inode */
+#define EXT4_FC_TAG_TAIL	0x0003	/* struct ext4_fc_tail */
+
+/* Features used by a fast commit: none defined yet */
+#define EXT4_FC_SUPPORTED_FEATURES	0x0
+
+struct ext4_fc_tl {
+	__le16	fc_tag;
+	__le16	fc_len;		/* bytes of value following this header */
+};
+
+struct ext4_fc_head {
+	__le32	fc_features;
+	__le32	fc_tid;		/* running transaction at the time */
+};
+
+/* The whole on-disk inode, EXT4_INODE_SIZE() bytes */
+struct ext4_fc_inode {
+	__le32	fc_ino;
+	__u8	fc_raw_inode[0];
+};
+
+struct ext4_fc_tail {
+	__le32	fc_tid;
+	__le32	fc_crc;		/* crc32_be of the block up to here */
+};
+
+#endif	/* _EXT4_FAST_COMMIT_H */
@@ -115,6 +115,17 @@ int ext4_sync_file(struct file *file, int datasync)
 		return ext4_force_commit(inode->i_sb);
 
 	commit_tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
+	/*
+	 * Writing out just this inode is much cheaper than committing the
+	 * whole transaction, unless the transaction holds changes a fast
+	 * commit cannot describe.
+	 */
+	if (test_opt(inode->i_sb, FAST_COMMIT)) {
+		ret = ext4_fc_commit(inode, commit_tid);
+		if (ret != -EAGAIN)
+			return ret;
+		ret = 0;
+	}
 	if (jbd2_log_start_commit(journal, commit_tid)) {
 		/*
 		 * When the journal is on a different device than the
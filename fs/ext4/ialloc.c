@@ -205,6 +205,7 @@ void ext4_free_inode(handle_t *handle, struct inode *inode)
 		return;
 	}
 	sbi = EXT4_SB(sb);
+	ext4_fc_mark_ineligible(sb, handle);
 
 	ino = inode->i_ino;
 	ext4_debug("freeing inode %lu\n", ino);
@@ -811,6 +812,7 @@ struct inode *ext4_new_inode(handle_t *handle, struct inode *dir, int mode,
 	sb = dir->i_sb;
 	ngroups = ext4_get_groups_count(sb);
 	trace_ext4_request_inode(dir, mode);
+	ext4_fc_mark_ineligible(sb, handle);
 	inode = new_inode(sb);
 	if (!inode)
 		return ERR_PTR(-ENOMEM);
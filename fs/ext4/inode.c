@@ -728,6 +728,8 @@ static int ext4_alloc_branch(handle_t *handle, struct inode *inode,
 	ext4_fsblk_t new_blocks[4];
 	ext4_fsblk_t current_block;
 
+	/* Fast commits only know how to replay extent mapped blocks */
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 	num = ext4_alloc_blocks(handle, inode, iblock, goal, indirect_blks,
 				*blks, new_blocks, &err);
 	if (err)
@@ -1221,16 +1223,39 @@ static pgoff_t ext4_num_dirty_pages(struct inode *inode, pgoff_t idx,
  * that casem, buffer head is unmapped
  *
  * It returns the error in case of allocation failure.
+ *
+ * The extent status tree is consulted first, so that blocks it knows
+ * about are looked up without taking i_data_sem or walking the on-disk
+ * mapping.
  */
 int ext4_map_blocks(handle_t *handle, struct inode *inode,
 		    struct ext4_map_blocks *map, int flags)
 {
+	struct extent_status es;
 	int retval;
 
 	map->m_flags = 0;
 	ext_debug("ext4_map_blocks(): inode %lu, flag %d, max_blocks %u,"
 		  "logical block %lu\n", inode->i_ino, flags, map->m_len,
 		  (unsigned long) map->m_lblk);
+
+	if (ext4_es_lookup_extent(inode, map->m_lblk, &es)) {
+		if (ext4_es_is_delayed(&es)) {
+			/* reserved, but not allocated yet */
+			retval = 0;
+		} else {
+			retval = es.es_lblk + es.es_len - map->m_lblk;
+			if (retval > map->m_len)
+				retval = map->m_len;
+			map->m_len = retval;
+			map->m_pblk = ext4_es_pblock(&es) +
+				      map->m_lblk - es.es_lblk;
+			map->m_flags |= ext4_es_is_written(&es) ?
+				EXT4_MAP_MAPPED : EXT4_MAP_UNWRITTEN;
+		}
+		goto found;
+	}
+
 	/*
 	 * Try to see if we can get the block without requesting a new
 	 * file system block.
@@ -1240,9 +1265,14 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 		retval = ext4_ext_map_blocks(handle, inode, map, 0);
 	} else {
 		retval = ext4_ind_map_blocks(handle, inode, map, 0);
+		if (retval > 0)
+			ext4_es_insert_extent(inode, map->m_lblk, retval,
+					      map->m_pblk,
+					      EXTENT_STATUS_WRITTEN);
 	}
 	up_read((&EXT4_I(inode)->i_data_sem));
 
+found:
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
 		int ret = check_block_validity(inode, __func__, map);
 		if (ret != 0)
@@ -1299,6 +1329,10 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 		retval = ext4_ext_map_blocks(handle, inode, map, flags);
 	} else {
 		retval = ext4_ind_map_blocks(handle, inode, map, flags);
+		if (retval > 0)
+			ext4_es_insert_extent(inode, map->m_lblk, retval,
+					      map->m_pblk,
+					      EXTENT_STATUS_WRITTEN);
 
 		if (retval > 0 && map->m_flags & EXT4_MAP_NEW) {
 			/*
@@ -1936,19 +1970,27 @@ static void ext4_da_page_release_reservation(struct page *page,
 	int to_release = 0;
 	struct buffer_head *head, *bh;
 	unsigned int curr_off = 0;
+	struct inode *inode = page->mapping->host;
+	ext4_lblk_t lblk, first = 0, last = 0;
 
+	lblk = page->index << (PAGE_CACHE_SHIFT - inode->i_blkbits);
 	head = page_buffers(page);
 	bh = head;
 	do {
 		unsigned int next_off = curr_off + bh->b_size;
 
 		if ((offset <= curr_off) && (buffer_delay(bh))) {
-			to_release++;
+			if (!to_release++)
+				first = lblk;
+			last = lblk;
 			clear_buffer_delay(bh);
 		}
 		curr_off = next_off;
+		lblk++;
 	} while ((bh = bh->b_this_page) != head);
-	ext4_da_release_space(page->mapping->host, to_release);
+	if (to_release)
+		ext4_es_remove_extent(inode, first, last - first + 1);
+	ext4_da_release_space(inode, to_release);
 }
 
 /*
@@ -2138,6 +2180,8 @@ static void ext4_da_block_invalidatepages(struct mpage_da_data *mpd,
 		index = pvec.pages[nr_pages - 1]->index + 1;
 		pagevec_release(&pvec);
 	}
+	/* The delayed extents went away with the pages */
+	ext4_es_remove_extent(inode, logical, blk_cnt);
 	return;
 }
 
@@ -2528,6 +2572,13 @@ static int ext4_da_get_block_prep(struct inode *inode, sector_t iblock,
 			/* not enough space to reserve */
 			return ret;
 
+		ret = ext4_es_insert_extent(inode, iblock, 1, ~0,
+					    EXTENT_STATUS_DELAYED);
+		if (ret) {
+			ext4_da_release_space(inode, 1);
+			return ret;
+		}
+
 		map_bh(bh, inode->i_sb, invalid_block);
 		set_buffer_new(bh);
 		set_buffer_delay(bh);
@@ -4678,6 +4729,7 @@ void ext4_truncate(struct inode *inode)
 	down_write(&ei->i_data_sem);
 
 	ext4_discard_preallocations(inode);
+	ext4_es_remove_extent(inode, last_block, EXT_MAX_BLOCK);
 
 	/*
 	 * The orphan list entry will now protect us from any crash which
@@ -5305,6 +5357,7 @@ static int ext4_do_update_inode(handle_t *handle,
 					EXT4_FEATURE_RO_COMPAT_LARGE_FILE);
 			sb->s_dirt = 1;
 			ext4_handle_sync(handle);
+			ext4_fc_mark_ineligible(sb, handle);
 			err = ext4_handle_dirty_metadata(handle, NULL,
 					EXT4_SB(sb)->s_sbh);
 		}
@@ -2785,6 +2785,7 @@ ext4_mb_mark_diskspace_used(struct ext4_allocation_context *ac,
 		ext4_free_blks_set(sb, gdp,
 					ext4_free_blocks_after_init(sb,
 					ac->ac_b_ex.fe_group, gdp));
+		ext4_fc_mark_ineligible(sb, handle);
 	}
 	len = ext4_free_blks_count(sb, gdp) - ac->ac_b_ex.fe_len;
 	ext4_free_blks_set(sb, gdp, len);
@@ -4514,6 +4515,7 @@ void ext4_free_blocks(handle_t *handle, struct inode *inode,
 
 	sbi = EXT4_SB(sb);
 	es = EXT4_SB(sb)->s_es;
+	ext4_fc_mark_ineligible(sb, handle);
 	if (!(flags & EXT4_FREE_BLOCKS_VALIDATED) &&
 	    !ext4_data_block_valid(sbi, block, count)) {
 		ext4_error(sb, "Freeing blocks not in datazone - "
@@ -1485,6 +1485,7 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	blocksize = sb->s_blocksize;
 	if (!dentry->d_name.len)
 		return -EINVAL;
+	ext4_fc_mark_ineligible(sb, handle);
 	if (is_dx(dir)) {
 		retval = ext4_dx_add_entry(handle, dentry, inode);
 		if (!retval || (retval != ERR_BAD_DX_DIR))
@@ -1669,6 +1670,7 @@ static int ext4_delete_entry(handle_t *handle,
 	unsigned int blocksize = dir->i_sb->s_blocksize;
 	int i;
 
+	ext4_fc_mark_ineligible(dir->i_sb, handle);
 	i = 0;
 	pde = NULL;
 	de = (struct ext4_dir_entry_2 *) bh->b_data;
@@ -1989,6 +1991,7 @@ int ext4_orphan_add(handle_t *handle, struct inode *inode)
 
 	if (!ext4_handle_valid(handle))
 		return 0;
+	ext4_fc_mark_ineligible(sb, handle);
 
 	mutex_lock(&EXT4_SB(sb)->s_orphan_lock);
 	if (!list_empty(&EXT4_I(inode)->i_orphan))
@@ -2071,6 +2074,7 @@ int ext4_orphan_del(handle_t *handle, struct inode *inode)
 	/* ext4_handle_valid() assumes a valid handle_t pointer */
 	if (handle && !ext4_handle_valid(handle))
 		return 0;
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 
 	mutex_lock(&EXT4_SB(inode->i_sb)->s_orphan_lock);
 	if (list_empty(&ei->i_orphan))
@@ -2389,6 +2393,7 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 
 	if (IS_DIRSYNC(old_dir) || IS_DIRSYNC(new_dir))
 		ext4_handle_sync(handle);
+	ext4_fc_mark_ineligible(old_dir->i_sb, handle);
 
 	old_bh = ext4_find_entry(old_dir, &old_dentry->d_name, &old_de);
 	/*
@@ -32,8 +32,25 @@ struct files_stat_struct files_stat = {
 	.max_files = NR_FILE
 };
 
-/* public. Not pretty! */
-__cacheline_aligned_in_smp DEFINE_SPINLOCK(files_lock);
+/*
+ * Open files are kept on per-superblock lists for the benefit of remount
+ * read-only.  On SMP each superblock has one list per cpu, and all of a
+ * cpu's lists share that cpu's files_lock: open and close only touch the
+ * lock and list of the cpu the file was opened on, and the rare walkers
+ * go through the cpus one at a time.  A file never changes lists, so a
+ * walk still sees every file that stays open while it runs.
+ */
+#ifdef CONFIG_SMP
+static DEFINE_PER_CPU(spinlock_t, files_lock);
+#define sb_files_lock(cpu)	(&per_cpu(files_lock, (cpu)))
+#define sb_files_list(sb, cpu)	per_cpu_ptr((sb)->s_files, (cpu))
+#define file_list_cpu(f)	((f)->f_sb_list_cpu)
+#else
+static DEFINE_SPINLOCK(files_lock);
+#define sb_files_lock(cpu)	(&files_lock)
+#define sb_files_list(sb, cpu)	(&(sb)->s_files)
+#define file_list_cpu(f)	0
+#endif
 
 /* SLAB cache for file structures */
 static struct kmem_cache *filp_cachep __read_mostly;
@@ -249,7 +266,7 @@ static void __fput(struct file *file)
 		cdev_put(inode->i_cdev);
 	fops_put(file->f_op);
 	put_pid(file->f_owner.pid);
-	file_kill(file);
+	file_sb_list_del(file);
 	if (file->f_mode & FMODE_WRITE)
 		drop_file_write_access(file);
 	file->f_path.dentry = NULL;
@@ -324,50 +341,74 @@ void put_filp(struct file *file)
 {
 	if (atomic_long_dec_and_test(&file->f_count)) {
 		security_file_free(file);
-		file_kill(file);
+		file_sb_list_del(file);
 		file_free(file);
 	}
 }
 
-void file_move(struct file *file, struct list_head *list)
+/**
+ *	file_sb_list_add - add a file to the sb's list of open files
+ *	@file: file to add
+ *	@sb: superblock the file belongs to
+ *
+ *	The file goes on the list of the current cpu.
+ */
+void file_sb_list_add(struct file *file, struct super_block *sb)
 {
-	if (!list)
-		return;
-	file_list_lock();
-	list_move(&file->f_u.fu_list, list);
-	file_list_unlock();
+	int cpu = get_cpu();
+	spinlock_t *lock = sb_files_lock(cpu);
+
+	spin_lock(lock);
+#ifdef CONFIG_SMP
+	file->f_sb_list_cpu = cpu;
+#endif
+	list_add(&file->f_u.fu_list, sb_files_list(sb, cpu));
+	spin_unlock(lock);
+	put_cpu();
 }
 
-void file_kill(struct file *file)
+/**
+ *	file_sb_list_del - remove a file from the sb's list of open files
+ *	@file: file to remove
+ */
+void file_sb_list_del(struct file *file)
 {
 	if (!list_empty(&file->f_u.fu_list)) {
-		file_list_lock();
+		spinlock_t *lock = sb_files_lock(file_list_cpu(file));
+
+		spin_lock(lock);
 		list_del_init(&file->f_u.fu_list);
-		file_list_unlock();
+		spin_unlock(lock);
 	}
 }
 
 int fs_may_remount_ro(struct super_block *sb)
 {
 	struct file *file;
+	int cpu;
 
 	/* Check that no files are currently opened for writing. */
-	file_list_lock();
-	list_for_each_entry(file, &sb->s_files, f_u.fu_list) {
-		struct inode *inode = file->f_path.dentry->d_inode;
+	for_each_possible_cpu(cpu) {
+		spinlock_t *lock = sb_files_lock(cpu);
 
-		/* File with pending delete? */
-		if (inode->i_nlink == 0)
-			goto too_bad;
+		spin_lock(lock);
+		list_for_each_entry(file, sb_files_list(sb, cpu), f_u.fu_list) {
+			struct inode *inode = file->f_path.dentry->d_inode;
 
-		/* Writeable file? */
-		if (S_ISREG(inode->i_mode) && (file->f_mode & FMODE_WRITE))
-			goto too_bad;
+			/* File with pending delete? */
+			if (inode->i_nlink == 0)
+				goto too_bad;
+
+			/* Writeable file? */
+			if (S_ISREG(inode->i_mode) &&
+			    (file->f_mode & FMODE_WRITE))
+				goto too_bad;
+		}
+		spin_unlock(lock);
 	}
-	file_list_unlock();
 	return 1; /* Tis' cool bro. */
 too_bad:
-	file_list_unlock();
+	spin_unlock(sb_files_lock(cpu));
 	return 0;
 }
 
@@ -381,39 +422,47 @@ too_bad:
 void mark_files_ro(struct super_block *sb)
 {
 	struct file *f;
+	int cpu;
 
 retry:
-	file_list_lock();
-	list_for_each_entry(f, &sb->s_files, f_u.fu_list) {
-		struct vfsmount *mnt;
-		if (!S_ISREG(f->f_path.dentry->d_inode->i_mode))
-		       continue;
-		if (!file_count(f))
-			continue;
-		if (!(f->f_mode & FMODE_WRITE))
-			continue;
-		spin_lock(&f->f_lock);
-		f->f_mode &= ~FMODE_WRITE;
-		spin_unlock(&f->f_lock);
-		if (file_check_writeable(f) != 0)
-			continue;
-		file_release_write(f);
-		mnt = mntget(f->f_path.mnt);
-		file_list_unlock();
-		/*
-		 * This can sleep, so we can't hold
-		 * the file_list_lock() spinlock.
-		 */
-		mnt_drop_write(mnt);
-		mntput(mnt);
-		goto retry;
+	for_each_possible_cpu(cpu) {
+		spinlock_t *lock = sb_files_lock(cpu);
+
+		spin_lock(lock);
+		list_for_each_entry(f, sb_files_list(sb, cpu), f_u.fu_list) {
+			struct vfsmount *mnt;
+			if (!S_ISREG(f->f_path.dentry->d_inode->i_mode))
+			       continue;
+			if (!file_count(f))
+				continue;
+			if (!(f->f_mode & FMODE_WRITE))
+				continue;
+			spin_lock(&f->f_lock);
+			f->f_mode &= ~FMODE_WRITE;
+			spin_unlock(&f->f_lock);
+			if (file_check_writeable(f) != 0)
+				continue;
+			file_release_write(f);
+			mnt = mntget(f->f_path.mnt);
+			spin_unlock(lock);
+			/*
+			 * This can sleep, so we can't hold
+			 * the files_lock spinlock.
+			 */
+			mnt_drop_write(mnt);
+			mntput(mnt);
+			goto retry;
+		}
+		spin_unlock(lock);
 	}
-	file_list_unlock();
 }
 
 void __init files_init(unsigned long mempages)
 { 
-	int n; 
+	int n, cpu;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(sb_files_lock(cpu));
 
 	filp_cachep = kmem_cache_create("filp", sizeof(struct file), 0,
 			SLAB_HWCACHE_ALIGN | SLAB_PANIC, NULL);
@@ -19,17 +19,20 @@
 #include <linux/pipe_fs_i.h>
 #include <linux/swap.h>
 #include <linux/splice.h>
+#include <linux/rcupdate.h>
+#include <linux/percpu.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_chan *fuse_get_chan(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount or cloning and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
@@ -227,63 +230,128 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
+/*
+ * Unique IDs are handed out per CPU, so that sending a request does
+ * not need any connection wide lock.  Zero is special, and never
+ * returned.
+ *
+ * Called with preemption disabled
+ */
 static u64 fuse_get_unique(struct fuse_conn *fc)
 {
-	fc->reqctr++;
-	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	struct fuse_conn_cpu *fcc = this_cpu_ptr(fc->cpu);
 
-	return fc->reqctr;
+	return ++fcc->reqctr * nr_cpu_ids + smp_processor_id();
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+/*
+ * Find the channel to queue a request on and lock it.  This is the
+ * channel last read on this CPU, or any other live channel if that
+ * one is gone.  Returns NULL if there are no live channels.
+ */
+static struct fuse_chan *fuse_chan_lock(struct fuse_conn *fc)
+{
+	struct fuse_conn_cpu *fcc;
+	struct fuse_chan *ch;
+
+	rcu_read_lock();
+	fcc = per_cpu_ptr(fc->cpu, raw_smp_processor_id());
+	ch = rcu_dereference(fcc->chan);
+	if (ch) {
+		spin_lock(&ch->lock);
+		if (ch->connected)
+			goto out;
+		spin_unlock(&ch->lock);
+	}
+	list_for_each_entry_rcu(ch, &fc->chans, entry) {
+		spin_lock(&ch->lock);
+		if (ch->connected)
+			goto out;
+		spin_unlock(&ch->lock);
+	}
+	ch = NULL;
+ out:
+	rcu_read_unlock();
+	return ch;
+}
+
+/*
+ * Lock the channel a request is queued on.  The request may be moved
+ * to another channel, if its channel is released before it is read.
+ * Returns NULL if the request is already finished.
+ */
+static struct fuse_chan *fuse_req_lock_chan(struct fuse_req *req)
 {
+	struct fuse_chan *ch;
+
+	rcu_read_lock();
+	for (;;) {
+		ch = rcu_dereference(req->chan);
+		if (!ch) {
+			/* pairs with smp_wmb() in request_end() */
+			smp_rmb();
+			break;
+		}
+		spin_lock(&ch->lock);
+		if (req->chan == ch)
+			break;
+		spin_unlock(&ch->lock);
+	}
+	rcu_read_unlock();
+	return ch;
+}
+
+/* Called with ch->lock */
+static void queue_request(struct fuse_chan *ch, struct fuse_req *req)
+{
+	struct fuse_conn *fc = ch->fc;
+
 	req->in.h.unique = fuse_get_unique(fc);
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &ch->pending);
+	rcu_assign_pointer(req->chan, ch);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	wake_up(&ch->waitq);
+	kill_fasync(&ch->fasync, SIGIO, POLL_IN);
 }
 
+/*
+ * Called with fc->lock.  If there are no channels left, the requests
+ * stay on bg_queue, for whoever took the channels down to end them.
+ */
 static void flush_bg_queue(struct fuse_conn *fc)
 {
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
+		struct fuse_chan *ch;
 		struct fuse_req *req;
 
+		ch = fuse_chan_lock(fc);
+		if (!ch)
+			break;
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		queue_request(fc, req);
+		queue_request(ch, req);
+		spin_unlock(&ch->lock);
 	}
 }
 
 /*
- * This function is called when a request is finished.  Either a reply
- * has arrived or it was aborted (and not yet sent) or some error
- * occurred during communication with userspace, or the device file
- * was closed.  The requester thread is woken up (if still waiting),
- * the 'end' callback is called if given, else the reference to the
- * request is released
- *
- * Called with fc->lock, unlocks it
+ * Second half of request_end(), called without locks.  Also used
+ * directly for requests which never made it to a channel.
  */
-static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(&fc->lock)
+static void request_finish(struct fuse_conn *fc, struct fuse_req *req)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
-	list_del(&req->list);
-	list_del(&req->intr_entry);
-	req->state = FUSE_REQ_FINISHED;
 	if (req->background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == fc->max_background) {
 			fc->blocked = 0;
 			wake_up_all(&fc->blocked_waitq);
@@ -296,50 +364,76 @@ __releases(&fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
 	fuse_put_request(fc, req);
 }
 
-static void wait_answer_interruptible(struct fuse_conn *fc,
-				      struct fuse_req *req)
-__releases(&fc->lock)
-__acquires(&fc->lock)
+/*
+ * This function is called when a request is finished.  Either a reply
+ * has arrived or it was aborted (and not yet sent) or some error
+ * occurred during communication with userspace, or the device file
+ * was closed.  The requester thread is woken up (if still waiting),
+ * the 'end' callback is called if given, else the reference to the
+ * request is released
+ *
+ * Called with ch->lock, unlocks it
+ */
+static void request_end(struct fuse_chan *ch, struct fuse_req *req)
+__releases(&ch->lock)
+{
+	struct fuse_conn *fc = ch->fc;
+
+	list_del(&req->list);
+	list_del(&req->intr_entry);
+	req->state = FUSE_REQ_FINISHED;
+	/* the reply must be visible before the request leaves the channel */
+	smp_wmb();
+	req->chan = NULL;
+	spin_unlock(&ch->lock);
+	request_finish(fc, req);
+}
+
+static void wait_answer_interruptible(struct fuse_req *req)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
 }
 
-static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
+/* Called with ch->lock */
+static void queue_interrupt(struct fuse_chan *ch, struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	list_add_tail(&req->intr_entry, &ch->interrupts);
+	wake_up(&ch->waitq);
+	kill_fasync(&ch->fasync, SIGIO, POLL_IN);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(&fc->lock)
-__acquires(&fc->lock)
 {
+	struct fuse_chan *ch;
+	int aborted;
+
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(req);
 
+		ch = fuse_req_lock_chan(req);
+		if (!ch)
+			return;
 		if (req->aborted)
-			goto aborted;
+			goto aborted_unlock;
 		if (req->state == FUSE_REQ_FINISHED)
-			return;
+			goto out_unlock;
 
 		req->interrupted = 1;
 		if (req->state == FUSE_REQ_SENT)
-			queue_interrupt(fc, req);
+			queue_interrupt(ch, req);
+		spin_unlock(&ch->lock);
 	}
 
 	if (!req->force) {
@@ -347,65 +441,82 @@ __acquires(&fc->lock)
 
 		/* Only fatal signals may interrupt this */
 		block_sigs(&oldset);
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(req);
 		restore_sigs(&oldset);
 
+		ch = fuse_req_lock_chan(req);
+		if (!ch)
+			return;
 		if (req->aborted)
-			goto aborted;
+			goto aborted_unlock;
 		if (req->state == FUSE_REQ_FINISHED)
-			return;
+			goto out_unlock;
 
 		/* Request is not yet in userspace, bail out */
 		if (req->state == FUSE_REQ_PENDING) {
 			list_del(&req->list);
+			req->chan = NULL;
+			spin_unlock(&ch->lock);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
 		}
+		spin_unlock(&ch->lock);
 	}
 
 	/*
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
 	wait_event(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
 
-	if (!req->aborted)
+	ch = fuse_req_lock_chan(req);
+	if (!ch)
+		return;
+	aborted = req->aborted;
+	spin_unlock(&ch->lock);
+	if (!aborted)
 		return;
+	goto aborted;
+
+ out_unlock:
+	spin_unlock(&ch->lock);
+	return;
 
+ aborted_unlock:
+	spin_unlock(&ch->lock);
  aborted:
 	BUG_ON(req->state != FUSE_REQ_FINISHED);
-	if (req->locked) {
-		/* This is uninterruptible sleep, because data is
-		   being copied to/from the buffers of req.  During
-		   locked state, there mustn't be any filesystem
-		   operation (e.g. page fault), since that could lead
-		   to deadlock */
-		spin_unlock(&fc->lock);
-		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
-	}
+	/* This is uninterruptible sleep, because data is
+	   being copied to/from the buffers of req.  During
+	   locked state, there mustn't be any filesystem
+	   operation (e.g. page fault), since that could lead
+	   to deadlock */
+	wait_event(req->waitq, !req->locked);
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_chan *ch;
+
 	req->isreply = 1;
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	ch = fuse_chan_lock(fc);
+	if (!ch || !fc->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
-		queue_request(fc, req);
+		queue_request(ch, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
+		spin_unlock(&ch->lock);
 
 		request_wait_answer(fc, req);
+		return;
 	}
-	spin_unlock(&fc->lock);
+	if (ch)
+		spin_unlock(&ch->lock);
 }
 EXPORT_SYMBOL_GPL(fuse_request_send);
 
@@ -432,8 +543,10 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
-		request_end(fc, req);
+		req->state = FUSE_REQ_FINISHED;
+		request_finish(fc, req);
 	}
 }
 
@@ -467,16 +580,16 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
  * anything that could cause a page-fault.  If the request was already
  * aborted bail out.
  */
-static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
+static int lock_request(struct fuse_chan *ch, struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&ch->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 	}
 	return err;
 }
@@ -486,19 +599,19 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
  * requester thread is currently waiting for it to be unlocked, so
  * wake it up.
  */
-static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
+static void unlock_request(struct fuse_chan *ch, struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&ch->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 	}
 }
 
 struct fuse_copy_state {
-	struct fuse_conn *fc;
+	struct fuse_chan *ch;
 	int write;
 	struct fuse_req *req;
 	const struct iovec *iov;
@@ -515,12 +628,12 @@ struct fuse_copy_state {
 	unsigned move_pages:1;
 };
 
-static void fuse_copy_init(struct fuse_copy_state *cs, struct fuse_conn *fc,
+static void fuse_copy_init(struct fuse_copy_state *cs, struct fuse_chan *ch,
 			   int write,
 			   const struct iovec *iov, unsigned long nr_segs)
 {
 	memset(cs, 0, sizeof(*cs));
-	cs->fc = fc;
+	cs->ch = ch;
 	cs->write = write;
 	cs->iov = iov;
 	cs->nr_segs = nr_segs;
@@ -560,7 +673,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 	unsigned long offset;
 	int err;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->ch, cs->req);
 	fuse_copy_finish(cs);
 	if (cs->pipebufs) {
 		struct pipe_buffer *buf = cs->pipebufs;
@@ -618,7 +731,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 		cs->addr += cs->len;
 	}
 
-	return lock_request(cs->fc, cs->req);
+	return lock_request(cs->ch, cs->req);
 }
 
 /* Do as much copy to/from userspace buffer as we can */
@@ -666,7 +779,7 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 	struct address_space *mapping;
 	pgoff_t index;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->ch, cs->req);
 	fuse_copy_finish(cs);
 
 	err = buf->ops->confirm(cs->pipe, buf);
@@ -725,12 +838,12 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 		lru_cache_add_file(newpage);
 
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->ch->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->ch->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -750,7 +863,7 @@ out_fallback:
 	cs->mapaddr = buf->ops->map(cs->pipe, buf, 1);
 	cs->buf = cs->mapaddr + buf->offset;
 
-	err = lock_request(cs->fc, cs->req);
+	err = lock_request(cs->ch, cs->req);
 	if (err)
 		return err;
 
@@ -765,7 +878,7 @@ static int fuse_ref_page(struct fuse_copy_state *cs, struct page *page,
 	if (cs->nr_segs == cs->pipe->buffers)
 		return -EIO;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->ch, cs->req);
 	fuse_copy_finish(cs);
 
 	buf = cs->pipebufs;
@@ -880,30 +993,44 @@ static int fuse_copy_args(struct fuse_copy_state *cs, unsigned numargs,
 	return err;
 }
 
-static int request_pending(struct fuse_conn *fc)
+static int request_pending(struct fuse_chan *ch)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts);
+	return !list_empty(&ch->pending) || !list_empty(&ch->interrupts);
 }
 
 /* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(&fc->lock)
-__acquires(&fc->lock)
+static void request_wait(struct fuse_chan *ch)
+__releases(&ch->lock)
+__acquires(&ch->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&ch->waitq, &wait);
+	while (ch->fc->connected && !request_pending(ch)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 		schedule();
-		spin_lock(&fc->lock);
+		spin_lock(&ch->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&ch->waitq, &wait);
+}
+
+/*
+ * Send the requests of this CPU to the channel it is reading.  Daemon
+ * threads that stay on a CPU and read their own channel thus get the
+ * requests sent from that CPU.
+ */
+static void fuse_chan_bind(struct fuse_chan *ch)
+{
+	struct fuse_conn_cpu *fcc;
+
+	fcc = per_cpu_ptr(ch->fc->cpu, raw_smp_processor_id());
+	if (fcc->chan != ch)
+		rcu_assign_pointer(fcc->chan, ch);
 }
 
 /*
@@ -912,11 +1039,11 @@ __acquires(&fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with ch->lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_interrupt(struct fuse_chan *ch, struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(&fc->lock)
+__releases(&ch->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -924,7 +1051,7 @@ __releases(&fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	req->intr_unique = fuse_get_unique(ch->fc);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -932,7 +1059,7 @@ __releases(&fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -953,38 +1080,40 @@ __releases(&fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_chan *ch, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
+	struct fuse_conn *fc = ch->fc;
 	int err;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
+	fuse_chan_bind(ch);
  restart:
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
+	    !request_pending(ch))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(ch);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
 	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	if (!request_pending(ch))
 		goto err_unlock;
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	if (!list_empty(&ch->interrupts)) {
+		req = list_entry(ch->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, cs, nbytes, req);
+		return fuse_read_interrupt(ch, cs, nbytes, req);
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = list_entry(ch->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &ch->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -994,40 +1123,40 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		/* SETXATTR is special, since it may contain too large data */
 		if (in->h.opcode == FUSE_SETXATTR)
 			req->out.h.error = -E2BIG;
-		request_end(fc, req);
+		request_end(ch, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	req->locked = 0;
 	if (req->aborted) {
-		request_end(fc, req);
+		request_end(ch, req);
 		return -ENODEV;
 	}
 	if (err) {
 		req->out.h.error = -EIO;
-		request_end(fc, req);
+		request_end(ch, req);
 		return err;
 	}
 	if (!req->isreply)
-		request_end(fc, req);
+		request_end(ch, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, &ch->processing);
 		if (req->interrupted)
-			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+			queue_interrupt(ch, req);
+		spin_unlock(&ch->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 	return err;
 }
 
@@ -1036,13 +1165,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_chan *ch = fuse_get_chan(file);
+	if (!ch)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, ch, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(ch, file, &cs, iov_length(iov, nr_segs));
 }
 
 static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -1070,18 +1199,18 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_chan *ch = fuse_get_chan(in);
+	if (!ch)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof (struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, ch, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(ch, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1251,11 +1380,11 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 }
 
 /* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static struct fuse_req *request_find(struct fuse_chan *ch, u64 unique)
 {
 	struct list_head *entry;
 
-	list_for_each(entry, &fc->processing) {
+	list_for_each(entry, &ch->processing) {
 		struct fuse_req *req;
 		req = list_entry(entry, struct fuse_req, list);
 		if (req->in.h.unique == unique || req->intr_unique == unique)
@@ -1290,13 +1419,14 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
 /*
  * Write a single reply to a request.  First the header is copied from
  * the write buffer.  The request is then searched on the processing
- * list by the unique ID found in the header.  If found, then remove
- * it from the list and copy the rest of the buffer to the request.
- * The request is finished by calling request_end()
+ * list of the channel by the unique ID found in the header.  If found,
+ * then remove it from the list and copy the rest of the buffer to the
+ * request.  The request is finished by calling request_end()
  */
-static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
+static ssize_t fuse_dev_do_write(struct fuse_chan *ch,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
+	struct fuse_conn *fc = ch->fc;
 	int err;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
@@ -1325,20 +1455,20 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	err = -ENOENT;
 	if (!fc->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(ch, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
-		request_end(fc, req);
+		spin_lock(&ch->lock);
+		request_end(ch, req);
 		return -ENOENT;
 	}
 	/* Is it an interrupt reply? */
@@ -1350,38 +1480,38 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(fc, req);
+			queue_interrupt(ch, req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &ch->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
 
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
 			err = -ENOENT;
 	} else if (!req->aborted)
 		req->out.h.error = -EIO;
-	request_end(fc, req);
+	request_end(ch, req);
 
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1391,13 +1521,13 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 			      unsigned long nr_segs, loff_t pos)
 {
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
+	struct fuse_chan *ch = fuse_get_chan(iocb->ki_filp);
+	if (!ch)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 0, iov, nr_segs);
+	fuse_copy_init(&cs, ch, 0, iov, nr_segs);
 
-	return fuse_dev_do_write(fc, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_write(ch, &cs, iov_length(iov, nr_segs));
 }
 
 static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
@@ -1408,12 +1538,12 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	unsigned idx;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc;
+	struct fuse_chan *ch;
 	size_t rem;
 	ssize_t ret;
 
-	fc = fuse_get_conn(out);
-	if (!fc)
+	ch = fuse_get_chan(out);
+	if (!ch)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof (struct pipe_buffer), GFP_KERNEL);
@@ -1460,14 +1590,14 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	}
 	pipe_unlock(pipe);
 
-	fuse_copy_init(&cs, fc, 0, NULL, nbuf);
+	fuse_copy_init(&cs, ch, 0, NULL, nbuf);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
 
 	if (flags & SPLICE_F_MOVE)
 		cs.move_pages = 1;
 
-	ret = fuse_dev_do_write(fc, &cs, len);
+	ret = fuse_dev_do_write(ch, &cs, len);
 
 	for (idx = 0; idx < nbuf; idx++) {
 		struct pipe_buffer *buf = &bufs[idx];
@@ -1481,18 +1611,18 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_chan *ch = fuse_get_chan(file);
+	if (!ch)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	poll_wait(file, &ch->waitq, wait);
 
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	spin_lock(&ch->lock);
+	if (!ch->fc->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(ch))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 
 	return mask;
 }
@@ -1500,18 +1630,18 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires ch->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(&fc->lock)
-__acquires(&fc->lock)
+static void end_requests(struct fuse_chan *ch, struct list_head *head)
+__releases(&ch->lock)
+__acquires(&ch->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
-		request_end(fc, req);
-		spin_lock(&fc->lock);
+		request_end(ch, req);
+		spin_lock(&ch->lock);
 	}
 }
 
@@ -1526,13 +1656,13 @@ __acquires(&fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(&fc->lock)
-__acquires(&fc->lock)
+static void end_io_requests(struct fuse_chan *ch)
+__releases(&ch->lock)
+__acquires(&ch->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&ch->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(ch->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -1543,21 +1673,39 @@ __acquires(&fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&ch->lock);
 			wait_event(req->waitq, !req->locked);
-			end(fc, req);
-			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			end(ch->fc, req);
+			fuse_put_request(ch->fc, req);
+			spin_lock(&ch->lock);
 		}
 	}
 }
 
-static void end_queued_requests(struct fuse_conn *fc)
+/*
+ * Take the background requests that were not queued on a channel yet,
+ * once the connection is going away.
+ *
+ * Called with fc->lock, after fc->connected was cleared
+ */
+static void take_bg_queue(struct fuse_conn *fc, struct list_head *head)
 {
-	fc->max_background = UINT_MAX;
-	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
+	while (!list_empty(&fc->bg_queue)) {
+		list_move_tail(fc->bg_queue.next, head);
+		fc->active_background++;
+	}
+}
+
+static void end_bg_requests(struct fuse_conn *fc, struct list_head *head)
+{
+	while (!list_empty(head)) {
+		struct fuse_req *req;
+		req = list_entry(head->next, struct fuse_req, list);
+		list_del_init(&req->list);
+		req->out.h.error = -ECONNABORTED;
+		req->state = FUSE_REQ_FINISHED;
+		request_finish(fc, req);
+	}
 }
 
 /*
@@ -1581,30 +1729,106 @@ static void end_queued_requests(struct fuse_conn *fc)
  */
 void fuse_abort_conn(struct fuse_conn *fc)
 {
+	struct fuse_chan *ch;
+	LIST_HEAD(bg);
+
+	mutex_lock(&fc->chan_mutex);
 	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_io_requests(fc);
-		end_queued_requests(fc);
-		wake_up_all(&fc->waitq);
-		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	if (!fc->connected) {
+		spin_unlock(&fc->lock);
+		mutex_unlock(&fc->chan_mutex);
+		return;
 	}
+	fc->connected = 0;
+	fc->blocked = 0;
+	take_bg_queue(fc, &bg);
+	wake_up_all(&fc->blocked_waitq);
 	spin_unlock(&fc->lock);
+
+	list_for_each_entry(ch, &fc->chans, entry) {
+		spin_lock(&ch->lock);
+		ch->connected = 0;
+		end_io_requests(ch);
+		end_requests(ch, &ch->pending);
+		end_requests(ch, &ch->processing);
+		wake_up_all(&ch->waitq);
+		kill_fasync(&ch->fasync, SIGIO, POLL_IN);
+		spin_unlock(&ch->lock);
+	}
+	mutex_unlock(&fc->chan_mutex);
+
+	end_bg_requests(fc, &bg);
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+/*
+ * Move the requests not yet read from a channel that is going away to
+ * another channel.  The channel is off fc->chans and the CPU map
+ * already, so fuse_chan_lock() can't find it.
+ *
+ * Called with ch->lock and fc->chan_mutex
+ */
+static void fuse_chan_requeue(struct fuse_chan *ch)
+{
+	struct fuse_chan *to;
+	struct fuse_req *req;
+
+	if (list_empty(&ch->pending))
+		return;
+
+	to = fuse_chan_lock(ch->fc);
+	if (!to)
+		return;
+
+	list_for_each_entry(req, &ch->pending, list)
+		rcu_assign_pointer(req->chan, to);
+	list_splice_tail_init(&ch->pending, &to->pending);
+	wake_up_all(&to->waitq);
+	kill_fasync(&to->fasync, SIGIO, POLL_IN);
+	spin_unlock(&to->lock);
+}
+
+static void fuse_chan_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct fuse_chan, rcu));
+}
+
+/*
+ * Requests already read from the channel can only be answered through
+ * it, so they are aborted.  Those not read yet are passed on to the
+ * other channels.  Closing the last channel kills the connection.
+ */
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_chan *ch = fuse_get_chan(file);
+	if (ch) {
+		struct fuse_conn *fc = ch->fc;
+		LIST_HEAD(bg);
+		int cpu;
+
+		mutex_lock(&fc->chan_mutex);
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		wake_up_all(&fc->blocked_waitq);
+		list_del_rcu(&ch->entry);
+		for_each_possible_cpu(cpu)
+			cmpxchg(&per_cpu_ptr(fc->cpu, cpu)->chan, ch, NULL);
+		if (list_empty(&fc->chans)) {
+			fc->connected = 0;
+			fc->blocked = 0;
+			take_bg_queue(fc, &bg);
+			wake_up_all(&fc->blocked_waitq);
+		}
 		spin_unlock(&fc->lock);
+
+		spin_lock(&ch->lock);
+		ch->connected = 0;
+		fuse_chan_requeue(ch);
+		end_requests(ch, &ch->pending);
+		end_requests(ch, &ch->processing);
+		spin_unlock(&ch->lock);
+		mutex_unlock(&fc->chan_mutex);
+
+		end_bg_requests(fc, &bg);
+		call_rcu(&ch->rcu, fuse_chan_free_rcu);
 		fuse_conn_put(fc);
 	}
 
@@ -1614,12 +1838,117 @@ EXPORT_SYMBOL_GPL(fuse_dev_release);
 
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_chan *ch = fuse_get_chan(file);
+	if (!ch)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fc->fasync);
+	return fasync_helper(fd, file, on, &ch->fasync);
+}
+
+struct fuse_chan *fuse_chan_alloc(struct fuse_conn *fc)
+{
+	struct fuse_chan *ch = kzalloc(sizeof(*ch), GFP_KERNEL);
+	if (ch) {
+		ch->fc = fc;
+		spin_lock_init(&ch->lock);
+		ch->connected = 1;
+		init_waitqueue_head(&ch->waitq);
+		INIT_LIST_HEAD(&ch->pending);
+		INIT_LIST_HEAD(&ch->processing);
+		INIT_LIST_HEAD(&ch->io);
+		INIT_LIST_HEAD(&ch->interrupts);
+		INIT_LIST_HEAD(&ch->entry);
+	}
+	return ch;
+}
+EXPORT_SYMBOL_GPL(fuse_chan_alloc);
+
+/*
+ * The channel holds a reference to the connection, until the device
+ * file is released
+ */
+void fuse_chan_attach(struct fuse_chan *ch)
+{
+	struct fuse_conn *fc = fuse_conn_get(ch->fc);
+
+	mutex_lock(&fc->chan_mutex);
+	spin_lock(&fc->lock);
+	list_add_tail_rcu(&ch->entry, &fc->chans);
+	spin_unlock(&fc->lock);
+	mutex_unlock(&fc->chan_mutex);
+}
+EXPORT_SYMBOL_GPL(fuse_chan_attach);
+
+void fuse_chan_wake_all(struct fuse_conn *fc)
+{
+	struct fuse_chan *ch;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ch, &fc->chans, entry) {
+		wake_up_all(&ch->waitq);
+		kill_fasync(&ch->fasync, SIGIO, POLL_IN);
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Attach a freshly opened device file to the connection of another
+ * one, as a new channel.
+ */
+static int fuse_dev_clone(struct file *file, struct file *old)
+{
+	struct fuse_chan *ch;
+	int err;
+
+	/*
+	 * Check against file->f_op, because CUSE uses its own fops,
+	 * and those files come with a connection of their own
+	 */
+	if (old->f_op != file->f_op || !fuse_get_chan(old))
+		return -EINVAL;
+
+	ch = fuse_chan_alloc(fuse_get_chan(old)->fc);
+	if (!ch)
+		return -ENOMEM;
+
+	mutex_lock(&fuse_mutex);
+	err = -EINVAL;
+	if (!file->private_data) {
+		fuse_chan_attach(ch);
+		file->private_data = ch;
+		err = 0;
+	}
+	mutex_unlock(&fuse_mutex);
+
+	if (err)
+		kfree(ch);
+	return err;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct file *old;
+	__u32 oldfd;
+	int err;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		if (get_user(oldfd, (__u32 __user *) arg))
+			return -EFAULT;
+
+		old = fget(oldfd);
+		if (!old)
+			return -EINVAL;
+
+		err = fuse_dev_clone(file, old);
+		fput(old);
+		return err;
+
+	default:
+		return -ENOTTY;
+	}
 }
 
 const struct file_operations fuse_dev_operations = {
@@ -1632,6 +1961,8 @@ const struct file_operations fuse_dev_operations = {
 	.aio_write	= fuse_dev_write,
 	.splice_write	= fuse_dev_splice_write,
 	.poll		= fuse_dev_poll,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
 };
@@ -1667,5 +1998,7 @@ int __init fuse_dev_init(void)
 void fuse_dev_cleanup(void)
 {
 	misc_deregister(&fuse_miscdevice);
+	/* wait for fuse_chan_free_rcu() */
+	rcu_barrier();
 	kmem_cache_destroy(fuse_req_cachep);
 }
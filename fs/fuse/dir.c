@@ -145,6 +145,17 @@ u64 fuse_get_attr_version(struct fuse_conn *fc)
 	return curr_version;
 }
 
+/*
+ * Ask for READDIRPLUS on the next read of the directory, because the
+ * attributes of its entries are being looked at
+ */
+static void fuse_advise_use_readdirplus(struct inode *dir)
+{
+	struct fuse_inode *fi = get_fuse_inode(dir);
+
+	set_bit(FUSE_I_ADVISE_RDPLUS, &fi->state);
+}
+
 /*
  * Check whether the dentry is still valid
  *
@@ -215,6 +226,13 @@ static int fuse_dentry_revalidate(struct dentry *entry, struct nameidata *nd)
 				       entry_attr_timeout(&outarg),
 				       attr_version);
 		fuse_change_entry_timeout(entry, &outarg);
+	} else if (inode &&
+		   test_and_clear_bit(FUSE_I_INIT_RDPLUS,
+				      &get_fuse_inode(inode)->state)) {
+		struct dentry *parent = dget_parent(entry);
+
+		fuse_advise_use_readdirplus(parent->d_inode);
+		dput(parent);
 	}
 	return 1;
 }
@@ -353,6 +371,7 @@ static struct dentry *fuse_lookup(struct inode *dir, struct dentry *entry,
 	else
 		fuse_invalidate_entry_cache(entry);
 
+	fuse_advise_use_readdirplus(dir);
 	return newent;
 
  out_iput:
@@ -767,6 +786,17 @@ static int fuse_link(struct dentry *entry, struct inode *newdir,
 static void fuse_fillattr(struct inode *inode, struct fuse_attr *attr,
 			  struct kstat *stat)
 {
+	struct fuse_conn *fc = get_fuse_conn(inode);
+
+	/* In writeback cache mode the kernel's size and times are newer */
+	if (fc->writeback_cache && S_ISREG(inode->i_mode)) {
+		attr->size = i_size_read(inode);
+		attr->mtime = inode->i_mtime.tv_sec;
+		attr->mtimensec = inode->i_mtime.tv_nsec;
+		attr->ctime = inode->i_ctime.tv_sec;
+		attr->ctimensec = inode->i_ctime.tv_nsec;
+	}
+
 	stat->dev = inode->i_sb->s_dev;
 	stat->ino = attr->ino;
 	stat->mode = (inode->i_mode & S_IFMT) | (attr->mode & 07777);
@@ -1056,14 +1086,177 @@ static int parse_dirfile(char *buf, size_t nbytes, struct file *file,
 	return 0;
 }
 
+static bool fuse_use_readdirplus(struct inode *dir, struct file *file)
+{
+	struct fuse_conn *fc = get_fuse_conn(dir);
+	struct fuse_inode *fi = get_fuse_inode(dir);
+
+	if (!fc->do_readdirplus)
+		return false;
+	if (!fc->readdirplus_auto)
+		return true;
+	if (test_and_clear_bit(FUSE_I_ADVISE_RDPLUS, &fi->state))
+		return true;
+	/* Nothing is known about the caller yet */
+	if (file->f_pos == 0)
+		return true;
+	return false;
+}
+
+/*
+ * Send a FORGET for an entry the filesystem looked up for READDIRPLUS,
+ * which is not going to be linked to an inode
+ */
+static void fuse_force_forget(struct fuse_conn *fc, u64 nodeid)
+{
+	struct fuse_req *req = fuse_request_alloc();
+
+	if (req)
+		fuse_send_forget(fc, req, nodeid, 1);
+}
+
+/*
+ * Instantiate a dentry and inode for an entry of READDIRPLUS, or
+ * refresh the existing ones.  Returns an error if the lookup count
+ * of the entry was not taken over by an inode.
+ *
+ * Called with the i_mutex of the directory, like ->lookup().
+ */
+static int fuse_direntplus_link(struct file *file,
+				struct fuse_direntplus *direntplus,
+				u64 attr_version)
+{
+	struct fuse_entry_out *o = &direntplus->entry_out;
+	struct fuse_dirent *dirent = &direntplus->dirent;
+	struct dentry *parent = file->f_path.dentry;
+	struct inode *dir = parent->d_inode;
+	struct fuse_conn *fc = get_fuse_conn(dir);
+	struct dentry *dentry;
+	struct dentry *alias;
+	struct inode *inode;
+	struct qstr name;
+
+	name.name = dirent->name;
+	name.len = dirent->namelen;
+	name.hash = full_name_hash(name.name, name.len);
+
+	dentry = d_lookup(parent, &name);
+	if (dentry) {
+		inode = dentry->d_inode;
+		if (inode && get_node_id(inode) == o->nodeid &&
+		    !((o->attr.mode ^ inode->i_mode) & S_IFMT)) {
+			struct fuse_inode *fi = get_fuse_inode(inode);
+
+			spin_lock(&fc->lock);
+			fi->nlookup++;
+			spin_unlock(&fc->lock);
+			goto found;
+		}
+		if (d_invalidate(dentry)) {
+			dput(dentry);
+			return -EBUSY;
+		}
+		dput(dentry);
+	}
+
+	if (!fuse_valid_type(o->attr.mode) || o->nodeid == FUSE_ROOT_ID)
+		return -EIO;
+
+	dentry = d_alloc(parent, &name);
+	if (!dentry)
+		return -ENOMEM;
+
+	inode = fuse_iget(dir->i_sb, o->nodeid, o->generation,
+			  &o->attr, entry_attr_timeout(o), attr_version);
+	if (!inode) {
+		dput(dentry);
+		return -ENOMEM;
+	}
+
+	/* From here on the lookup count belongs to the inode */
+	dentry->d_op = &fuse_dentry_operations;
+	if (S_ISDIR(inode->i_mode)) {
+		mutex_lock(&fc->inst_mutex);
+		alias = fuse_d_add_directory(dentry, inode);
+		mutex_unlock(&fc->inst_mutex);
+		if (IS_ERR(alias)) {
+			iput(inode);
+			dput(dentry);
+			return 0;
+		}
+	} else {
+		alias = d_splice_alias(inode, dentry);
+	}
+	if (alias) {
+		dput(dentry);
+		dentry = alias;
+	}
+
+ found:
+	set_bit(FUSE_I_INIT_RDPLUS, &get_fuse_inode(inode)->state);
+	fuse_change_attributes(inode, &o->attr, entry_attr_timeout(o),
+			       attr_version);
+	fuse_change_entry_timeout(dentry, o);
+	dput(dentry);
+	return 0;
+}
+
+static int parse_dirplusfile(char *buf, size_t nbytes, struct file *file,
+			     void *dstbuf, filldir_t filldir, u64 attr_version)
+{
+	struct fuse_conn *fc = get_fuse_conn(file->f_path.dentry->d_inode);
+	int over = 0;
+
+	while (nbytes >= FUSE_NAME_OFFSET_DIRENTPLUS) {
+		struct fuse_direntplus *direntplus =
+			(struct fuse_direntplus *) buf;
+		struct fuse_dirent *dirent = &direntplus->dirent;
+		size_t reclen = FUSE_DIRENTPLUS_SIZE(direntplus);
+		u64 nodeid = direntplus->entry_out.nodeid;
+
+		if (!dirent->namelen || dirent->namelen > FUSE_NAME_MAX)
+			return -EIO;
+		if (reclen > nbytes)
+			break;
+
+		if (!over) {
+			over = filldir(dstbuf, dirent->name, dirent->namelen,
+				       file->f_pos, dirent->ino, dirent->type);
+			if (!over)
+				file->f_pos = dirent->off;
+		}
+
+		/*
+		 * Entries that did not fit into the user's buffer are
+		 * still linked, otherwise they would need a FORGET.
+		 * "." and ".." are not looked up by the filesystem.
+		 */
+		if (nodeid && !(dirent->name[0] == '.' &&
+				(dirent->namelen == 1 ||
+				 (dirent->namelen == 2 &&
+				  dirent->name[1] == '.')))) {
+			if (fuse_direntplus_link(file, direntplus,
+						 attr_version))
+				fuse_force_forget(fc, nodeid);
+		}
+
+		buf += reclen;
+		nbytes -= reclen;
+	}
+
+	return 0;
+}
+
 static int fuse_readdir(struct file *file, void *dstbuf, filldir_t filldir)
 {
 	int err;
+	bool plus;
 	size_t nbytes;
 	struct page *page;
 	struct inode *inode = file->f_path.dentry->d_inode;
 	struct fuse_conn *fc = get_fuse_conn(inode);
 	struct fuse_req *req;
+	u64 attr_version = 0;
 
 	if (is_bad_inode(inode))
 		return -EIO;
@@ -1077,17 +1270,31 @@ static int fuse_readdir(struct file *file, void *dstbuf, filldir_t filldir)
 		fuse_put_request(fc, req);
 		return -ENOMEM;
 	}
+	plus = fuse_use_readdirplus(inode, file);
 	req->out.argpages = 1;
 	req->num_pages = 1;
 	req->pages[0] = page;
-	fuse_read_fill(req, file, file->f_pos, PAGE_SIZE, FUSE_READDIR);
+	if (plus) {
+		attr_version = fuse_get_attr_version(fc);
+		fuse_read_fill(req, file, file->f_pos, PAGE_SIZE,
+			       FUSE_READDIRPLUS);
+	} else {
+		fuse_read_fill(req, file, file->f_pos, PAGE_SIZE,
+			       FUSE_READDIR);
+	}
 	fuse_request_send(fc, req);
 	nbytes = req->out.args[0].size;
 	err = req->out.h.error;
 	fuse_put_request(fc, req);
-	if (!err)
-		err = parse_dirfile(page_address(page), nbytes, file, dstbuf,
-				    filldir);
+	if (!err) {
+		if (plus)
+			err = parse_dirplusfile(page_address(page), nbytes,
+						file, dstbuf, filldir,
+						attr_version);
+		else
+			err = parse_dirfile(page_address(page), nbytes, file,
+					    dstbuf, filldir);
+	}
 
 	__free_page(page);
 	fuse_invalidate_attr(inode); /* atime changed */
@@ -1264,7 +1471,8 @@ static int fuse_do_setattr(struct dentry *entry, struct iattr *attr,
 	struct fuse_setattr_in inarg;
 	struct fuse_attr_out outarg;
 	bool is_truncate = false;
-	loff_t oldsize;
+	bool is_wb = fc->writeback_cache && S_ISREG(inode->i_mode);
+	loff_t oldsize, newsize;
 	int err;
 
 	if (!fuse_allow_task(fc, current))
@@ -1336,7 +1544,15 @@ static int fuse_do_setattr(struct dentry *entry, struct iattr *attr,
 	fuse_change_attributes_common(inode, &outarg.attr,
 				      attr_timeout(&outarg));
 	oldsize = inode->i_size;
-	i_size_write(inode, outarg.attr.size);
+	newsize = outarg.attr.size;
+	if (is_wb) {
+		/* see the comment in fuse_change_attributes() */
+		if (!is_truncate)
+			newsize = oldsize;
+		if (attr->ia_valid & (ATTR_MTIME | ATTR_SIZE))
+			fuse_change_cmtime(inode, &outarg.attr);
+	}
+	i_size_write(inode, newsize);
 
 	if (is_truncate) {
 		/* NOTE: this may release/reacquire fc->lock */
@@ -1347,10 +1563,12 @@ static int fuse_do_setattr(struct dentry *entry, struct iattr *attr,
 	/*
 	 * Only call invalidate_inode_pages2() after removing
 	 * FUSE_NOWRITE, otherwise fuse_launder_page() would deadlock.
+	 * The page cache is authoritative in writeback cache mode.
 	 */
-	if (S_ISREG(inode->i_mode) && oldsize != outarg.attr.size) {
-		truncate_pagecache(inode, oldsize, outarg.attr.size);
-		invalidate_inode_pages2(inode->i_mapping);
+	if (S_ISREG(inode->i_mode) && oldsize != newsize) {
+		truncate_pagecache(inode, oldsize, newsize);
+		if (!is_wb)
+			invalidate_inode_pages2(inode->i_mapping);
 	}
 
 	return 0;
@@ -1362,6 +1580,45 @@ error:
 	return err;
 }
 
+/*
+ * The cached writes may not have reached the filesystem yet, so this
+ * is sent from ->write_inode(), after the pages were written back
+ */
+int fuse_flush_mtime(struct inode *inode)
+{
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_req *req;
+	struct fuse_setattr_in inarg;
+	struct fuse_attr_out outarg;
+	int err;
+
+	req = fuse_get_req(fc);
+	if (IS_ERR(req))
+		return PTR_ERR(req);
+
+	memset(&inarg, 0, sizeof(inarg));
+	memset(&outarg, 0, sizeof(outarg));
+	inarg.valid = FATTR_MTIME;
+	inarg.mtime = inode->i_mtime.tv_sec;
+	inarg.mtimensec = inode->i_mtime.tv_nsec;
+	req->in.h.opcode = FUSE_SETATTR;
+	req->in.h.nodeid = get_node_id(inode);
+	req->in.numargs = 1;
+	req->in.args[0].size = sizeof(inarg);
+	req->in.args[0].value = &inarg;
+	req->out.numargs = 1;
+	if (fc->minor < 9)
+		req->out.args[0].size = FUSE_COMPAT_ATTR_OUT_SIZE;
+	else
+		req->out.args[0].size = sizeof(outarg);
+	req->out.args[0].value = &outarg;
+	fuse_request_send(fc, req);
+	err = req->out.h.error;
+	fuse_put_request(fc, req);
+
+	return err;
+}
+
 static int fuse_setattr(struct dentry *entry, struct iattr *attr)
 {
 	if (attr->ia_valid & ATTR_FILE)
@@ -93,6 +93,17 @@ struct fuse_inode {
 
 	/** List of writepage requestst (pending or sent) */
 	struct list_head writepages;
+
+	/** Miscellaneous bits describing inode state */
+	unsigned long state;
+};
+
+/** FUSE inode state bits */
+enum {
+	/** Use READDIRPLUS for the next read of this directory */
+	FUSE_I_ADVISE_RDPLUS,
+	/** Set up by READDIRPLUS, and not looked at since */
+	FUSE_I_INIT_RDPLUS,
 };
 
 struct fuse_conn;
@@ -202,7 +213,7 @@ enum fuse_req_state {
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    fuse_chan */
 	struct list_head list;
 
 	/** Entry on the interrupts list  */
@@ -214,10 +225,14 @@ struct fuse_req {
 	/** Unique ID for the interrupt request */
 	u64 intr_unique;
 
+	/** Channel the request is queued on, NULL once it is finished.
+	    Changed under the lock of the channel, freed by RCU */
+	struct fuse_chan *chan;
+
 	/*
 	 * The following bitfields are either set once before the
 	 * request is queued or setting/clearing them is protected by
-	 * fuse_conn->lock
+	 * the lock of req->chan
 	 */
 
 	/** True if the request has reply */
@@ -300,12 +315,65 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * A channel of a Fuse connection: one open /dev/fuse file.
+ *
+ * The file the filesystem was mounted with is the first channel, more
+ * can be added with the FUSE_DEV_IOC_CLONE ioctl.  Each channel has
+ * its own request queues, and a request is queued on the channel that
+ * was last read on the CPU which sends it.  A reply must be written to
+ * the channel the request was read from.
+ */
+struct fuse_chan {
+	/** The connection this channel belongs to */
+	struct fuse_conn *fc;
+
+	/** Lock protecting the lists below, and the requests on them */
+	spinlock_t lock;
+
+	/** Cleared when the channel is released or aborted */
+	unsigned connected;
+
+	/** Readers of the channel are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** The list of requests being processed */
+	struct list_head processing;
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** Pending interrupts */
+	struct list_head interrupts;
+
+	/** O_ASYNC requests */
+	struct fasync_struct *fasync;
+
+	/** Entry on fuse_conn->chans */
+	struct list_head entry;
+
+	/** For freeing the channel after an RCU grace period */
+	struct rcu_head rcu;
+};
+
+/** Per-CPU part of a Fuse connection */
+struct fuse_conn_cpu {
+	/** Channel last read on this CPU, or NULL.  Read under RCU */
+	struct fuse_chan *chan;
+
+	/** Counter for the unique request IDs handed out on this CPU */
+	u64 reqctr;
+};
+
 /**
  * A Fuse connection.
  *
  * This structure is created, when the filesystem is mounted, and is
- * destroyed, when the client device is closed and the filesystem is
- * unmounted.
+ * destroyed, when the last channel of the client device is closed and
+ * the filesystem is unmounted.
  */
 struct fuse_conn {
 	/** Lock protecting accessess to  members of this structure */
@@ -314,6 +382,16 @@ struct fuse_conn {
 	/** Mutex protecting against directory alias creation */
 	struct mutex inst_mutex;
 
+	/** Mutex serializing the addition and removal of channels */
+	struct mutex chan_mutex;
+
+	/** Live channels.  Changed under both chan_mutex and lock,
+	    read under either of them or RCU */
+	struct list_head chans;
+
+	/** Per-CPU channel choice and request IDs */
+	struct fuse_conn_cpu __percpu *cpu;
+
 	/** Refcount */
 	atomic_t count;
 
@@ -332,18 +410,6 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
-
-	/** The list of pending requests */
-	struct list_head pending;
-
-	/** The list of requests being processed */
-	struct list_head processing;
-
-	/** The list of requests under I/O */
-	struct list_head io;
-
 	/** The next unique kernel file handle */
 	u64 khctr;
 
@@ -365,9 +431,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
 	/** Flag indicating if connection is blocked.  This will be
 	    the case before the INIT reply is received, and if there
 	    are too many outstading backgrounds requests */
@@ -379,9 +442,6 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
-
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
 	unsigned connected;
@@ -456,6 +516,16 @@ struct fuse_conn {
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
+	/** Cache writes in the page cache, size and mtime are kept
+	    by the kernel */
+	unsigned writeback_cache:1;
+
+	/** Use READDIRPLUS */
+	unsigned do_readdirplus:1;
+
+	/** Choose between READDIR and READDIRPLUS by usage */
+	unsigned readdirplus_auto:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -477,9 +547,6 @@ struct fuse_conn {
 	/** number of dentries used in the above array */
 	int ctl_ndents;
 
-	/** O_ASYNC requests */
-	struct fasync_struct *fasync;
-
 	/** Key for lock owner ID scrambling */
 	u32 scramble_key[4];
 
@@ -608,6 +675,11 @@ void fuse_change_attributes(struct inode *inode, struct fuse_attr *attr,
 void fuse_change_attributes_common(struct inode *inode, struct fuse_attr *attr,
 				   u64 attr_valid);
 
+/**
+ * Set mtime and ctime of an inode from the attributes
+ */
+void fuse_change_cmtime(struct inode *inode, struct fuse_attr *attr);
+
 /**
  * Initialize the client device
  */
@@ -687,7 +759,7 @@ void fuse_conn_kill(struct fuse_conn *fc);
 /**
  * Initialize fuse_conn
  */
-void fuse_conn_init(struct fuse_conn *fc);
+int fuse_conn_init(struct fuse_conn *fc);
 
 /**
  * Release reference to fuse_conn
@@ -724,6 +796,11 @@ void fuse_flush_writepages(struct inode *inode);
 void fuse_set_nowrite(struct inode *inode);
 void fuse_release_nowrite(struct inode *inode);
 
+/**
+ * Send the mtime of the inode to the filesystem (writeback cache mode)
+ */
+int fuse_flush_mtime(struct inode *inode);
+
 u64 fuse_get_attr_version(struct fuse_conn *fc);
 
 /**
@@ -748,4 +825,16 @@ long fuse_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg,
 unsigned fuse_file_poll(struct file *file, poll_table *wait);
 int fuse_dev_release(struct inode *inode, struct file *file);
 
+/**
+ * Allocate a channel for a connection, and add it to the connection
+ * once the device file is set up
+ */
+struct fuse_chan *fuse_chan_alloc(struct fuse_conn *fc);
+void fuse_chan_attach(struct fuse_chan *ch);
+
+/**
+ * Wake up the readers of all channels
+ */
+void fuse_chan_wake_all(struct fuse_conn *fc);
+
 #endif /* _FS_FUSE_I_H */
@@ -42,6 +42,7 @@
 #include <linux/log2.h>
 #include <linux/vmalloc.h>
 #include <linux/backing-dev.h>
+#include <linux/blkdev.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/jbd2.h>
@@ -91,6 +92,10 @@ EXPORT_SYMBOL(jbd2_journal_file_inode);
 EXPORT_SYMBOL(jbd2_journal_init_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_release_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_begin_ordered_truncate);
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+EXPORT_SYMBOL(jbd2_fc_write_bufs);
 
 static int journal_convert_superblock_v1(journal_t *, journal_superblock_t *);
 static void __journal_abort_soft (journal_t *journal, int errno);
@@ -691,6 +696,182 @@ struct journal_head *jbd2_journal_get_descriptor_buffer(journal_t *journal)
 	return jbd2_journal_add_journal_head(bh);
 }
 
+/*
+ * Fast commits.
+ *
+ * A fast commit lets the client log a compact description of its own
+ * changes to the fast commit area at the end of the journal, instead of
+ * committing the running transaction.  It is only valid on top of the
+ * transactions before the running one, so recovery replays it after the
+ * log and only if the log ends just before the transaction the fast
+ * commit was made in.  A full commit makes all earlier fast commits
+ * redundant and starts the area over.
+ *
+ * Fast and full commits exclude each other: a full commit waits for a
+ * fast commit in progress before it locks down the transaction, and a
+ * fast commit waits for a full commit in progress and then tells the
+ * caller to check again whether there is anything left to do.
+ */
+
+/**
+ * int jbd2_fc_begin_commit() - start a fast commit
+ * @journal: journal to act on
+ * @tid: the running transaction the fast commit is made in
+ *
+ * Returns 0 if the caller may go ahead with a fast commit and has to
+ * call jbd2_fc_end_commit() afterwards, -EALREADY if @tid is not the
+ * running transaction any more, -EAGAIN if a commit was in progress and
+ * the caller should look again, or another error if a fast commit
+ * cannot be done now and the caller has to fall back to a full commit.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	if (is_journal_aborted(journal))
+		return -EIO;
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return -EOPNOTSUPP;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_flags & (JBD2_FAST_COMMIT_ONGOING |
+				JBD2_FULL_COMMIT_ONGOING)) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		return -EAGAIN;
+	}
+	if (!journal->j_running_transaction ||
+	    journal->j_running_transaction->t_tid != tid) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+	/*
+	 * After a flush the superblock says the log is empty until the next
+	 * full commit, and recovery would never look at the fast commit.
+	 */
+	if (journal->j_flags & JBD2_FLUSHED) {
+		write_unlock(&journal->j_state_lock);
+		return -EINVAL;
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	return 0;
+}
+
+/**
+ * void jbd2_fc_end_commit() - finish a fast commit
+ * @journal: journal to act on
+ */
+void jbd2_fc_end_commit(journal_t *journal)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/**
+ * int jbd2_fc_get_buf() - get the next fast commit block
+ * @journal: journal to act on
+ * @bh_out: the buffer for the block
+ *
+ * Only to be called between jbd2_fc_begin_commit() and
+ * jbd2_fc_end_commit().  The caller fills the buffer, writes it out with
+ * jbd2_fc_write_bufs() and drops its reference.  Returns -ENOSPC once the
+ * fast commit area is full; only a full commit frees it up again.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	unsigned long blocknr;
+	struct buffer_head *bh;
+	int err;
+
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return -ENOSPC;
+	blocknr = journal->j_fc_first + journal->j_fc_off;
+
+	err = jbd2_journal_bmap(journal, blocknr, &pblock);
+	if (err)
+		return err;
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	journal->j_fc_off++;
+	*bh_out = bh;
+	return 0;
+}
+
+static void jbd2_fc_submit_buf(struct buffer_head *bh, int write_op)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(write_op, bh);
+}
+
+/**
+ * int jbd2_fc_write_bufs() - write out fast commit blocks
+ * @journal: journal to act on
+ * @bhs: blocks from jbd2_fc_get_buf(), in order
+ * @nr: number of blocks
+ *
+ * The last block is what makes the fast commit valid, so it goes out
+ * after the others have completed and, with barriers enabled, as a
+ * barrier: whatever the fast commit refers to has to be on stable
+ * storage before it, and it has to be there itself once we return.
+ */
+int jbd2_fc_write_bufs(journal_t *journal, struct buffer_head **bhs, int nr)
+{
+	struct buffer_head *bh;
+	int i, err = 0;
+
+	for (i = 0; i < nr - 1; i++)
+		jbd2_fc_submit_buf(bhs[i], WRITE_SYNC_PLUG);
+	for (i = 0; i < nr - 1; i++) {
+		wait_on_buffer(bhs[i]);
+		if (unlikely(!buffer_uptodate(bhs[i])))
+			err = -EIO;
+	}
+	if (err)
+		return err;
+
+	/* The client's data may live on another device than the journal */
+	if ((journal->j_flags & JBD2_BARRIER) &&
+	    journal->j_fs_dev != journal->j_dev)
+		blkdev_issue_flush(journal->j_fs_dev, GFP_KERNEL, NULL,
+				   BLKDEV_IFL_WAIT);
+
+	bh = bhs[nr - 1];
+	if (journal->j_flags & JBD2_BARRIER) {
+		jbd2_fc_submit_buf(bh, WRITE_SYNC | WRITE_BARRIER);
+		wait_on_buffer(bh);
+		if (!buffer_eopnotsupp(bh))
+			goto out;
+
+		printk(KERN_WARNING "JBD2: Disabling barriers on %s, "
+		       "not supported by device\n", journal->j_devname);
+		write_lock(&journal->j_state_lock);
+		journal->j_flags &= ~JBD2_BARRIER;
+		write_unlock(&journal->j_state_lock);
+		clear_buffer_eopnotsupp(bh);
+		clear_buffer_write_io_error(bh);
+	}
+	jbd2_fc_submit_buf(bh, WRITE_SYNC);
+	wait_on_buffer(bh);
+out:
+	if (unlikely(!buffer_uptodate(bh)))
+		return -EIO;
+	return 0;
+}
+
 struct jbd2_stats_proc_session {
 	journal_t *journal;
 	struct transaction_stats_s *stats;
@@ -841,6 +1022,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_checkpoint);
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1027,6 +1209,32 @@ static void journal_fail_superblock (journal_t *journal)
 	journal->j_sb_buffer = NULL;
 }
 
+/*
+ * With INCOMPAT_FAST_COMMIT the last blocks of the journal are set aside
+ * for fast commits and the log proper ends before them.  The caller has
+ * set up j_first and j_last for the whole journal.
+ */
+static int journal_init_fc_area(journal_t *journal)
+{
+	unsigned long num_fc_blks;
+
+	num_fc_blks = be32_to_cpu(journal->j_superblock->s_fc_blocks);
+	if (!num_fc_blks)
+		num_fc_blks = JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+	if (journal->j_first + JBD2_MIN_JOURNAL_BLOCKS + num_fc_blks >
+	    journal->j_last) {
+		printk(KERN_ERR "JBD: Journal too short for %lu fast commit "
+		       "blocks.\n", num_fc_blks);
+		return -EINVAL;
+	}
+
+	journal->j_fc_last = journal->j_last;
+	journal->j_last -= num_fc_blks;
+	journal->j_fc_first = journal->j_last;
+	journal->j_fc_off = 0;
+	return 0;
+}
+
 /*
  * Given a journal_t structure, initialise the various fields for
  * startup of a new journaling session.  We use this both when creating
@@ -1050,10 +1258,16 @@ static int journal_reset(journal_t *journal)
 
 	journal->j_first = first;
 	journal->j_last = last;
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    journal_init_fc_area(journal)) {
+		journal_fail_superblock(journal);
+		return -EINVAL;
+	}
 
 	journal->j_head = first;
 	journal->j_tail = first;
-	journal->j_free = last - first;
+	journal->j_free = journal->j_last - first;
 
 	journal->j_tail_sequence = journal->j_transaction_sequence;
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
@@ -1229,6 +1443,15 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		err = journal_init_fc_area(journal);
+		if (err) {
+			journal_fail_superblock(journal);
+			return err;
+		}
+	}
+
 	return 0;
 }
 
@@ -1341,6 +1564,9 @@ int jbd2_journal_destroy(journal_t *journal)
 			journal->j_tail = 0;
 			journal->j_tail_sequence =
 				++journal->j_transaction_sequence;
+			/* The final commit made any fast commit redundant */
+			journal->j_superblock->s_feature_incompat &=
+				~cpu_to_be32(JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
 			jbd2_journal_update_superblock(journal, 1);
 		} else {
 			err = -EIO;
@@ -1452,10 +1678,39 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 
 	sb = journal->j_superblock;
 
+	if ((incompat & JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    !JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		/*
+		 * The fast commit area is carved out of the end of the
+		 * log, which is only safe while the log is still empty,
+		 * i.e. right after jbd2_journal_load().
+		 */
+		write_lock(&journal->j_state_lock);
+		if (journal->j_running_transaction ||
+		    journal->j_committing_transaction ||
+		    journal->j_checkpoint_transactions ||
+		    journal->j_head != journal->j_first ||
+		    journal->j_tail != journal->j_first ||
+		    journal_init_fc_area(journal)) {
+			write_unlock(&journal->j_state_lock);
+			return 0;
+		}
+		journal->j_free = journal->j_last - journal->j_first;
+		write_unlock(&journal->j_state_lock);
+	}
+
 	sb->s_feature_compat    |= cpu_to_be32(compat);
 	sb->s_feature_ro_compat |= cpu_to_be32(ro);
 	sb->s_feature_incompat  |= cpu_to_be32(incompat);
 
+	/*
+	 * Recovery has to know about the fast commit area before the first
+	 * fast commit can be found in it.
+	 */
+	if (incompat & JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
+		jbd2_journal_update_superblock(journal, 1);
+
 	return 1;
 }
 
@@ -1468,21 +1723,47 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
  * @incompat: bitmask of incompatible features
  *
  * Clear a given journal feature as present on the
- * superblock.
+ * superblock.  The fast commit feature is only cleared while the log
+ * is empty, and is then cleared on disk right away, since the log
+ * grows into the fast commit area.
  */
 void jbd2_journal_clear_features(journal_t *journal, unsigned long compat,
 				unsigned long ro, unsigned long incompat)
 {
 	journal_superblock_t *sb;
+	int update = 0;
 
 	jbd_debug(1, "Clear features 0x%lx/0x%lx/0x%lx\n",
 		  compat, ro, incompat);
 
 	sb = journal->j_superblock;
 
+	if ((incompat & JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		write_lock(&journal->j_state_lock);
+		if (journal->j_running_transaction ||
+		    journal->j_committing_transaction ||
+		    journal->j_checkpoint_transactions ||
+		    journal->j_head != journal->j_first ||
+		    journal->j_tail != journal->j_first) {
+			incompat &= ~JBD2_FEATURE_INCOMPAT_FAST_COMMIT;
+		} else {
+			journal->j_last = journal->j_fc_last;
+			journal->j_free = journal->j_last - journal->j_first;
+			journal->j_fc_first = journal->j_fc_last = 0;
+			journal->j_fc_off = 0;
+			update = 1;
+		}
+		write_unlock(&journal->j_state_lock);
+	}
+
 	sb->s_feature_compat    &= ~cpu_to_be32(compat);
 	sb->s_feature_ro_compat &= ~cpu_to_be32(ro);
 	sb->s_feature_incompat  &= ~cpu_to_be32(incompat);
+
+	if (update)
+		jbd2_journal_update_superblock(journal, 1);
 }
 EXPORT_SYMBOL(jbd2_journal_clear_features);
 
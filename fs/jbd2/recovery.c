@@ -37,11 +37,12 @@ struct recovery_info
 	int		nr_revoke_hits;
 };
 
-enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
 static int do_one_pass(journal_t *journal,
 				struct recovery_info *info, enum passtype pass);
 static int scan_revoke_records(journal_t *, struct buffer_head *,
 				tid_t, struct recovery_info *);
+static int fc_do_one_pass(journal_t *journal,
+			  struct recovery_info *info, enum passtype pass);
 
 #ifdef __KERNEL__
 
@@ -220,7 +221,8 @@ do {									\
  * Recovery is done in three passes.  In the first pass, we look for the
  * end of the log.  In the second, we assemble the list of revoke
  * blocks.  In the third and final pass, we replay any un-revoked blocks
- * in the log.
+ * in the log.  The fast commit area, if any, is handed to the client
+ * in the first and in the last pass, after the log itself.
  */
 int jbd2_journal_recover(journal_t *journal)
 {
@@ -246,10 +248,14 @@ int jbd2_journal_recover(journal_t *journal)
 	}
 
 	err = do_one_pass(journal, &info, PASS_SCAN);
+	if (!err)
+		err = fc_do_one_pass(journal, &info, PASS_SCAN);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err)
+		err = fc_do_one_pass(journal, &info, PASS_REPLAY);
 
 	jbd_debug(1, "JBD: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
@@ -704,6 +710,45 @@ static int do_one_pass(journal_t *journal,
 }
 
 
+/*
+ * Walk the fast commit area.  Fast commits only describe changes made on
+ * top of the last transaction in the log, so the client is told which
+ * transaction ID they have to carry: the first one not found in the log.
+ * The client validates the blocks in the scan pass and applies them in
+ * the replay pass, and stops the walk at the first block it cannot use.
+ */
+static int fc_do_one_pass(journal_t *journal,
+			  struct recovery_info *info, enum passtype pass)
+{
+	unsigned long next;
+	struct buffer_head *bh;
+	int err = 0;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT) ||
+	    !journal->j_fc_replay_callback)
+		return 0;
+
+	for (next = journal->j_fc_first; next < journal->j_fc_last; next++) {
+		err = jread(&bh, journal, next);
+		if (err) {
+			printk(KERN_ERR "JBD: IO error %d recovering fast "
+			       "commit block %lu\n", err, next);
+			return err;
+		}
+		err = journal->j_fc_replay_callback(journal, bh, pass,
+					next - journal->j_fc_first,
+					info->end_transaction);
+		brelse(bh);
+		if (err != JBD2_FC_REPLAY_CONTINUE)
+			break;
+	}
+
+	jbd_debug(1, "JBD: fast commit pass %d ended at block %lu\n",
+		  pass, next);
+	return err < 0 ? err : 0;
+}
+
 /* Scan a revoke record, marking all blocks mentioned as revoked. */
 
 static int scan_revoke_records(journal_t *journal, struct buffer_head *bh,
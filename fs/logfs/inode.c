@@ -308,7 +308,7 @@ void destroy_meta_inode(struct inode *inode)
 	}
 }
 
-/* called with inode_lock held */
+/* called with inode->i_state_lock held */
 static void logfs_drop_inode(struct inode *inode)
 {
 	struct logfs_super *super = logfs_super(inode->i_sb);
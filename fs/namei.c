@@ -170,6 +170,7 @@ EXPORT_SYMBOL(putname);
  * This does basic POSIX ACL permission checking
  */
 static int acl_permission_check(struct inode *inode, int mask,
+		unsigned int flags,
 		int (*check_acl)(struct inode *inode, int mask))
 {
 	umode_t			mode = inode->i_mode;
@@ -180,7 +181,11 @@ static int acl_permission_check(struct inode *inode, int mask,
 		mode >>= 6;
 	else {
 		if (IS_POSIXACL(inode) && (mode & S_IRWXG) && check_acl) {
-			int error = check_acl(inode, mask);
+			int error;
+
+			if (flags & IPERM_FLAG_RCU)
+				return -ECHILD;
+			error = check_acl(inode, mask);
 			if (error != -EAGAIN)
 				return error;
 		}
@@ -216,7 +221,7 @@ int generic_permission(struct inode *inode, int mask,
 	/*
 	 * Do the basic POSIX ACL permission checks.
 	 */
-	ret = acl_permission_check(inode, mask, check_acl);
+	ret = acl_permission_check(inode, mask, 0, check_acl);
 	if (ret != -EACCES)
 		return ret;
 
@@ -459,27 +464,35 @@ force_reval_path(struct path *path, struct nameidata *nd)
  * If appropriate, check DAC only.  If not appropriate, or
  * short-cut DAC fails, then call ->permission() to do more
  * complete permission check.
+ *
+ * With IPERM_FLAG_RCU only the plain mode bits are checked, and
+ * anything else gives -ECHILD.
  */
-static int exec_permission(struct inode *inode)
+static int exec_permission(struct inode *inode, unsigned int flags)
 {
 	int ret;
 
 	if (inode->i_op->permission) {
+		if (flags & IPERM_FLAG_RCU)
+			return -ECHILD;
 		ret = inode->i_op->permission(inode, MAY_EXEC);
 		if (!ret)
 			goto ok;
 		return ret;
 	}
-	ret = acl_permission_check(inode, MAY_EXEC, inode->i_op->check_acl);
+	ret = acl_permission_check(inode, MAY_EXEC, flags,
+				   inode->i_op->check_acl);
 	if (!ret)
 		goto ok;
+	if (flags & IPERM_FLAG_RCU)
+		return -ECHILD;
 
 	if (capable(CAP_DAC_OVERRIDE) || capable(CAP_DAC_READ_SEARCH))
 		goto ok;
 
 	return ret;
 ok:
-	return security_inode_permission(inode, MAY_EXEC);
+	return security_inode_exec_permission(inode, flags);
 }
 
 static __always_inline void set_root(struct nameidata *nd)
@@ -835,7 +848,7 @@ static int link_path_walk(const char *name, struct nameidata *nd)
 		unsigned int c;
 
 		nd->flags |= LOOKUP_CONTINUE;
-		err = exec_permission(inode);
+		err = exec_permission(inode, 0);
  		if (err)
 			break;
 
@@ -1000,6 +1013,294 @@ static int path_walk(const char *name, struct nameidata *nd)
 	return result;
 }
 
+/*
+ * RCU path walk.
+ *
+ * Most lookups only ever meet dentries that are already in the dcache,
+ * and all they need in the end is a reference on the last one.
+ * path_walk_rcu() does that walk under rcu_read_lock() without touching
+ * the reference counts or locks of the dentries on the way.  Whatever is
+ * read from a dentry is checked with its ->d_seq afterwards, and a parent
+ * is rechecked once its child has been found, so a concurrent rename,
+ * unlink or d_drop() shows up as a sequence mismatch.  Only the final
+ * dentry is pinned, by d_get_rcu().
+ *
+ * Anything that may sleep or needs a reference is left to path_walk():
+ * ->permission(), ACLs, security modules, ->d_hash(), ->d_compare(),
+ * ->d_revalidate(), symlinks, dcache misses, ".." out of a mount, and
+ * filesystems whose inodes are not freed by RCU.  In those cases, and on
+ * any sequence mismatch, -ECHILD is returned with nothing held and the
+ * caller does the lookup again the old way.
+ *
+ * ->root and ->pwd stay pinned because current->fs->lock is read-held
+ * for the whole walk.  Mount points are crossed with lookup_mnt(), which
+ * does take a reference; those are kept and dropped after the walk.
+ */
+#define RCU_WALK_MNTS	4
+
+struct rcu_walk {
+	struct path	root;		/* no references held */
+	unsigned	seq;		/* ->d_seq of nd->path.dentry */
+	struct inode	*inode;		/* its ->d_inode, as of seq */
+	int		nr_mnts;
+	struct vfsmount	*mnts[RCU_WALK_MNTS];	/* from lookup_mnt() */
+};
+
+static inline int rcu_walk_sb_ok(struct super_block *sb)
+{
+	return !sb->s_op->destroy_inode ||
+		(sb->s_type->fs_flags & FS_RCU_FREE_INODES);
+}
+
+static int follow_mount_rcu(struct nameidata *nd, struct rcu_walk *rw)
+{
+	while (d_mountpoint(nd->path.dentry)) {
+		struct vfsmount *mounted;
+
+		if (rw->nr_mnts == RCU_WALK_MNTS)
+			return -ECHILD;
+		mounted = lookup_mnt(&nd->path);
+		if (!mounted)
+			break;
+		rw->mnts[rw->nr_mnts++] = mounted;
+		if (!rcu_walk_sb_ok(mounted->mnt_sb))
+			return -ECHILD;
+		nd->path.mnt = mounted;
+		nd->path.dentry = mounted->mnt_root;
+		rw->seq = read_seqcount_begin(&nd->path.dentry->d_seq);
+		rw->inode = nd->path.dentry->d_inode;
+	}
+	return 0;
+}
+
+static int follow_dotdot_rcu(struct nameidata *nd, struct rcu_walk *rw)
+{
+	struct dentry *dentry = nd->path.dentry;
+
+	if (dentry != rw->root.dentry || nd->path.mnt != rw->root.mnt) {
+		struct dentry *parent;
+		unsigned seq;
+
+		if (dentry == nd->path.mnt->mnt_root)
+			return -ECHILD;
+		parent = dentry->d_parent;
+		seq = read_seqcount_begin(&parent->d_seq);
+		if (read_seqcount_retry(&dentry->d_seq, rw->seq))
+			return -ECHILD;
+		nd->path.dentry = parent;
+		rw->seq = seq;
+		rw->inode = parent->d_inode;
+		if (!rw->inode)
+			return -ECHILD;
+	}
+	return follow_mount_rcu(nd, rw);
+}
+
+static int do_lookup_rcu(struct nameidata *nd, struct qstr *name,
+			 struct rcu_walk *rw)
+{
+	struct dentry *parent = nd->path.dentry;
+	struct dentry *dentry;
+	unsigned seq;
+
+	if (parent->d_op && (parent->d_op->d_hash || parent->d_op->d_compare))
+		return -ECHILD;
+	dentry = __d_lookup_rcu(parent, name, &seq);
+	if (!dentry)
+		return -ECHILD;
+	if (dentry->d_op && dentry->d_op->d_revalidate)
+		return -ECHILD;
+	rw->inode = dentry->d_inode;
+	if (read_seqcount_retry(&dentry->d_seq, seq))
+		return -ECHILD;
+	/* The child is only as good as the parent we found it in */
+	if (read_seqcount_retry(&parent->d_seq, rw->seq))
+		return -ECHILD;
+	nd->path.dentry = dentry;
+	rw->seq = seq;
+	return follow_mount_rcu(nd, rw);
+}
+
+/*
+ * Same contract as path_init() + path_walk(), except that -ECHILD means
+ * "not done, try path_walk()" with nothing in @nd held.
+ */
+static int path_walk_rcu(int dfd, const char *name, unsigned int flags,
+			 struct nameidata *nd)
+{
+	struct fs_struct *fs = current->fs;
+	unsigned int lookup_flags = flags;
+	struct file *file = NULL;
+	struct rcu_walk rw;
+	int fput_needed, err, i;
+
+	if (flags & (LOOKUP_REVAL | LOOKUP_OPEN | LOOKUP_CREATE |
+		     LOOKUP_EXCL | LOOKUP_RENAME_TARGET))
+		return -ECHILD;
+
+	nd->last_type = LAST_ROOT; /* if there are only slashes... */
+	nd->flags = flags;
+	nd->depth = 0;
+	nd->root.mnt = NULL;
+	rw.nr_mnts = 0;
+
+	if (*name != '/' && dfd != AT_FDCWD) {
+		file = fget_light(dfd, &fput_needed);
+		if (!file)
+			return -EBADF;
+		err = -ENOTDIR;
+		if (!S_ISDIR(file->f_path.dentry->d_inode->i_mode))
+			goto out_fput;
+		err = file_permission(file, MAY_EXEC);
+		if (err)
+			goto out_fput;
+	}
+
+	read_lock(&fs->lock);
+	rcu_read_lock();
+	rw.root = fs->root;
+	if (*name == '/')
+		nd->path = rw.root;
+	else if (file)
+		nd->path = file->f_path;
+	else
+		nd->path = fs->pwd;
+	rw.seq = read_seqcount_begin(&nd->path.dentry->d_seq);
+	rw.inode = nd->path.dentry->d_inode;
+
+	err = -ECHILD;
+	if (!rw.inode || !rcu_walk_sb_ok(nd->path.mnt->mnt_sb))
+		goto out_unlock;
+
+	while (*name == '/')
+		name++;
+	if (!*name)
+		goto return_reval;
+
+	for (;;) {
+		unsigned long hash;
+		struct qstr this;
+		unsigned int c;
+
+		err = exec_permission(rw.inode, IPERM_FLAG_RCU);
+		if (err)
+			break;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+
+		hash = init_name_hash();
+		do {
+			name++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)name;
+		} while (c && (c != '/'));
+		this.len = name - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		if (!c)
+			goto last_component;
+		while (*++name == '/');
+		if (!*name)
+			goto last_with_slashes;
+
+		if (this.name[0] == '.') switch (this.len) {
+			default:
+				break;
+			case 2:
+				if (this.name[1] != '.')
+					break;
+				err = follow_dotdot_rcu(nd, &rw);
+				if (err)
+					goto out_unlock;
+				/* fallthrough */
+			case 1:
+				continue;
+		}
+		err = do_lookup_rcu(nd, &this, &rw);
+		if (err)
+			break;
+		err = -ENOENT;
+		if (!rw.inode)
+			break;
+		err = -ECHILD;
+		if (rw.inode->i_op->follow_link)
+			break;
+		err = -ENOTDIR;
+		if (!rw.inode->i_op->lookup)
+			break;
+		continue;
+
+last_with_slashes:
+		lookup_flags |= LOOKUP_FOLLOW | LOOKUP_DIRECTORY;
+last_component:
+		if (lookup_flags & LOOKUP_PARENT)
+			goto lookup_parent;
+		if (this.name[0] == '.') switch (this.len) {
+			default:
+				break;
+			case 2:
+				if (this.name[1] != '.')
+					break;
+				err = follow_dotdot_rcu(nd, &rw);
+				if (err)
+					goto out_unlock;
+				/* fallthrough */
+			case 1:
+				goto return_reval;
+		}
+		err = do_lookup_rcu(nd, &this, &rw);
+		if (err)
+			break;
+		err = -ECHILD;
+		if (follow_on_final(rw.inode, lookup_flags))
+			break;
+		err = -ENOENT;
+		if (!rw.inode)
+			break;
+		if (lookup_flags & LOOKUP_DIRECTORY) {
+			err = -ENOTDIR;
+			if (!rw.inode->i_op->lookup)
+				break;
+		}
+		goto return_base;
+lookup_parent:
+		nd->last = this;
+		nd->last_type = LAST_NORM;
+		if (this.name[0] != '.')
+			goto return_base;
+		if (this.len == 1)
+			nd->last_type = LAST_DOT;
+		else if (this.len == 2 && this.name[1] == '.')
+			nd->last_type = LAST_DOTDOT;
+		else
+			goto return_base;
+return_reval:
+		err = -ECHILD;
+		if (nd->path.dentry->d_sb->s_type->fs_flags & FS_REVAL_DOT)
+			break;
+return_base:
+		err = -ECHILD;
+		if (!d_get_rcu(nd->path.dentry, rw.seq))
+			break;
+		if (rw.nr_mnts && rw.mnts[rw.nr_mnts - 1] == nd->path.mnt)
+			rw.nr_mnts--;	/* hand its reference over to nd */
+		else
+			mntget(nd->path.mnt);
+		err = 0;
+		break;
+	}
+out_unlock:
+	rcu_read_unlock();
+	read_unlock(&fs->lock);
+	for (i = 0; i < rw.nr_mnts; i++)
+		mntput(rw.mnts[i]);
+out_fput:
+	if (file)
+		fput_light(file, fput_needed);
+	return err;
+}
+
 static int path_init(int dfd, const char *name, unsigned int flags, struct nameidata *nd)
 {
 	int retval = 0;
@@ -1056,9 +1357,12 @@ out_fail:
 static int do_path_lookup(int dfd, const char *name,
 				unsigned int flags, struct nameidata *nd)
 {
-	int retval = path_init(dfd, name, flags, nd);
-	if (!retval)
-		retval = path_walk(name, nd);
+	int retval = path_walk_rcu(dfd, name, flags, nd);
+	if (retval == -ECHILD) {
+		retval = path_init(dfd, name, flags, nd);
+		if (!retval)
+			retval = path_walk(name, nd);
+	}
 	if (unlikely(!retval && !audit_dummy_context() && nd->path.dentry &&
 				nd->path.dentry->d_inode))
 		audit_inode(name, nd->path.dentry);
@@ -1182,7 +1486,7 @@ static struct dentry *lookup_hash(struct nameidata *nd)
 {
 	int err;
 
-	err = exec_permission(nd->path.dentry->d_inode);
+	err = exec_permission(nd->path.dentry->d_inode, 0);
 	if (err)
 		return ERR_PTR(err);
 	return __lookup_hash(&nd->last, nd->path.dentry, nd);
@@ -1232,7 +1536,7 @@ struct dentry *lookup_one_len(const char *name, struct dentry *base, int len)
 	if (err)
 		return ERR_PTR(err);
 
-	err = exec_permission(base->d_inode);
+	err = exec_permission(base->d_inode, 0);
 	if (err)
 		return ERR_PTR(err);
 	return __lookup_hash(&this, base, NULL);
@@ -1795,14 +2099,18 @@ struct file *do_filp_open(int dfd, const char *pathname,
 
 	/* find the parent */
 reval:
-	error = path_init(dfd, pathname, LOOKUP_PARENT, &nd);
-	if (error)
-		return ERR_PTR(error);
-	if (force_reval)
-		nd.flags |= LOOKUP_REVAL;
-
 	current->total_link_count = 0;
-	error = link_path_walk(pathname, &nd);
+	error = -ECHILD;
+	if (!force_reval)
+		error = path_walk_rcu(dfd, pathname, LOOKUP_PARENT, &nd);
+	if (error == -ECHILD) {
+		error = path_init(dfd, pathname, LOOKUP_PARENT, &nd);
+		if (error)
+			return ERR_PTR(error);
+		if (force_reval)
+			nd.flags |= LOOKUP_REVAL;
+		error = link_path_walk(pathname, &nd);
+	}
 	if (error) {
 		filp = ERR_PTR(error);
 		goto out;
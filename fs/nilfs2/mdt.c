@@ -503,12 +503,14 @@ nilfs_mdt_new_common(struct the_nilfs *nilfs, struct super_block *sb,
 #endif
 		inode->dirtied_when = 0;
 
-		INIT_LIST_HEAD(&inode->i_list);
+		INIT_LIST_HEAD(&inode->i_wb_list);
+		INIT_LIST_HEAD(&inode->i_lru);
 		INIT_LIST_HEAD(&inode->i_sb_list);
 		inode->i_state = 0;
 #endif
 
 		spin_lock_init(&inode->i_lock);
+		spin_lock_init(&inode->i_state_lock);
 		mutex_init(&inode->i_mutex);
 		init_rwsem(&inode->i_alloc_sem);
 
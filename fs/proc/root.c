@@ -99,6 +99,7 @@ static struct file_system_type proc_fs_type = {
 	.name		= "proc",
 	.get_sb		= proc_get_sb,
 	.kill_sb	= proc_kill_sb,
+	.fs_flags	= FS_RCU_FREE_INODES,
 };
 
 void __init proc_root_init(void)
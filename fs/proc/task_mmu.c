@@ -328,9 +328,35 @@ struct mem_size_stats {
 	unsigned long private_dirty;
 	unsigned long referenced;
 	unsigned long swap;
+	unsigned long anonymous_thp;
 	u64 pss;
 };
 
+static void smaps_account(struct mem_size_stats *mss, struct page *page,
+			  unsigned long size, int young, int dirty)
+{
+	int mapcount;
+
+	mss->resident += size;
+	/* Accumulate the size in pages that have been accessed. */
+	if (young || PageReferenced(page))
+		mss->referenced += size;
+	mapcount = page_mapcount(page);
+	if (mapcount >= 2) {
+		if (dirty)
+			mss->shared_dirty += size;
+		else
+			mss->shared_clean += size;
+		mss->pss += (size << PSS_SHIFT) / mapcount;
+	} else {
+		if (dirty)
+			mss->private_dirty += size;
+		else
+			mss->private_clean += size;
+		mss->pss += (size << PSS_SHIFT);
+	}
+}
+
 static int smaps_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 			   struct mm_walk *walk)
 {
@@ -339,7 +365,20 @@ static int smaps_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 	pte_t *pte, ptent;
 	spinlock_t *ptl;
 	struct page *page;
-	int mapcount;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	spin_lock(&walk->mm->page_table_lock);
+	if (pmd_trans_huge(*pmd)) {
+		smaps_account(mss, pmd_page(*pmd), end - addr,
+			      pmd_young(*pmd), pmd_dirty(*pmd));
+		mss->anonymous_thp += end - addr;
+		spin_unlock(&walk->mm->page_table_lock);
+		return 0;
+	}
+	spin_unlock(&walk->mm->page_table_lock);
+#endif
+	if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+		return 0;
 
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; pte++, addr += PAGE_SIZE) {
@@ -357,24 +396,8 @@ static int smaps_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 		if (!page)
 			continue;
 
-		mss->resident += PAGE_SIZE;
-		/* Accumulate the size in pages that have been accessed. */
-		if (pte_young(ptent) || PageReferenced(page))
-			mss->referenced += PAGE_SIZE;
-		mapcount = page_mapcount(page);
-		if (mapcount >= 2) {
-			if (pte_dirty(ptent))
-				mss->shared_dirty += PAGE_SIZE;
-			else
-				mss->shared_clean += PAGE_SIZE;
-			mss->pss += (PAGE_SIZE << PSS_SHIFT) / mapcount;
-		} else {
-			if (pte_dirty(ptent))
-				mss->private_dirty += PAGE_SIZE;
-			else
-				mss->private_clean += PAGE_SIZE;
-			mss->pss += (PAGE_SIZE << PSS_SHIFT);
-		}
+		smaps_account(mss, page, PAGE_SIZE, pte_young(ptent),
+			      pte_dirty(ptent));
 	}
 	pte_unmap_unlock(pte - 1, ptl);
 	cond_resched();
@@ -411,6 +434,7 @@ static int show_smap(struct seq_file *m, void *v)
 		   "Private_Dirty:  %8lu kB\n"
 		   "Referenced:     %8lu kB\n"
 		   "Swap:           %8lu kB\n"
+		   "AnonHugePages:  %8lu kB\n"
 		   "KernelPageSize: %8lu kB\n"
 		   "MMUPageSize:    %8lu kB\n",
 		   (vma->vm_end - vma->vm_start) >> 10,
@@ -422,6 +446,7 @@ static int show_smap(struct seq_file *m, void *v)
 		   mss.private_dirty >> 10,
 		   mss.referenced >> 10,
 		   mss.swap >> 10,
+		   mss.anonymous_thp >> 10,
 		   vma_kernel_pagesize(vma) >> 10,
 		   vma_mmu_pagesize(vma) >> 10);
 
@@ -457,6 +482,19 @@ static int clear_refs_pte_range(pmd_t *pmd, unsigned long addr,
 	spinlock_t *ptl;
 	struct page *page;
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	spin_lock(&walk->mm->page_table_lock);
+	if (pmd_trans_huge(*pmd)) {
+		pmdp_test_and_clear_young(vma, addr & HPAGE_PMD_MASK, pmd);
+		ClearPageReferenced(pmd_page(*pmd));
+		spin_unlock(&walk->mm->page_table_lock);
+		return 0;
+	}
+	spin_unlock(&walk->mm->page_table_lock);
+#endif
+	if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+		return 0;
+
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; pte++, addr += PAGE_SIZE) {
 		ptent = *pte;
@@ -604,6 +642,14 @@ static u64 pte_to_pagemap_entry(pte_t pte)
 	return pme;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static u64 thp_pmd_to_pagemap_entry(pmd_t pmd, int offset)
+{
+	return PM_PFRAME(pmd_pfn(pmd) + offset)
+		| PM_PSHIFT(PAGE_SHIFT) | PM_PRESENT;
+}
+#endif
+
 static int pagemap_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 			     struct mm_walk *walk)
 {
@@ -612,6 +658,25 @@ static int pagemap_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 	pte_t *pte;
 	int err = 0;
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	pmd_t pmdval = *pmd;
+
+	barrier();
+	/* a huge pmd keeps its pfn while it is being split */
+	if (pmd_trans_huge(pmdval)) {
+		for (; addr != end; addr += PAGE_SIZE) {
+			int offset = (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
+
+			err = add_to_pagemap(addr,
+				thp_pmd_to_pagemap_entry(pmdval, offset), pm);
+			if (err)
+				return err;
+		}
+		cond_resched();
+		return err;
+	}
+#endif
+
 	/* find the first VMA at or above 'addr' */
 	vma = find_vma(walk->mm, addr);
 	for (; addr != end; addr += PAGE_SIZE) {
@@ -24,6 +24,9 @@
 #include <linux/types.h>
 #include <linux/mutex.h>
 #include <linux/buffer_head.h>
+#include <linux/slab.h>
+#include <linux/cpumask.h>
+#include <linux/smp.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -40,9 +43,11 @@ static const struct squashfs_decompressor squashfs_lzma_unsupported_comp_ops = {
 	NULL, NULL, NULL, LZMA_COMPRESSION, "lzma", 0
 };
 
+#ifndef CONFIG_SQUASHFS_LZO
 static const struct squashfs_decompressor squashfs_lzo_unsupported_comp_ops = {
 	NULL, NULL, NULL, LZO_COMPRESSION, "lzo", 0
 };
+#endif
 
 static const struct squashfs_decompressor squashfs_unknown_comp_ops = {
 	NULL, NULL, NULL, 0, "unknown", 0
@@ -51,7 +56,11 @@ static const struct squashfs_decompressor squashfs_unknown_comp_ops = {
 static const struct squashfs_decompressor *decompressor[] = {
 	&squashfs_zlib_comp_ops,
 	&squashfs_lzma_unsupported_comp_ops,
+#ifdef CONFIG_SQUASHFS_LZO
+	&squashfs_lzo_comp_ops,
+#else
 	&squashfs_lzo_unsupported_comp_ops,
+#endif
 	&squashfs_unknown_comp_ops
 };
 
@@ -66,3 +75,83 @@ const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
 
 	return decompressor[i];
 }
+
+
+/*
+ * Each online cpu, up to SQUASHFS_MAX_DECOMP of them, gets its own
+ * decompressor stream, so that readers running on different cpus
+ * decompress blocks in parallel rather than queueing on a single stream.
+ * A reader picks its stream from the cpu it starts on; cpus beyond the
+ * number of streams share them.  A reader can sleep waiting for buffers
+ * and be migrated, so each stream is still protected by a mutex.
+ */
+struct squashfs_stream {
+	struct mutex	mutex;
+	void		*stream;
+};
+
+
+int squashfs_decompressor_create(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream;
+	int i;
+
+	msblk->nr_streams = min_t(int, num_online_cpus(), SQUASHFS_MAX_DECOMP);
+	msblk->stream = kcalloc(msblk->nr_streams, sizeof(*stream),
+		GFP_KERNEL);
+	if (msblk->stream == NULL)
+		goto failed;
+
+	for (i = 0; i < msblk->nr_streams; i++) {
+		stream = &msblk->stream[i];
+		mutex_init(&stream->mutex);
+		stream->stream = msblk->decompressor->init(msblk);
+		if (stream->stream == NULL)
+			goto failed;
+	}
+
+	return 0;
+
+failed:
+	ERROR("Failed to allocate %s decompressor streams\n",
+		msblk->decompressor->name);
+	squashfs_decompressor_destroy(msblk);
+	return -ENOMEM;
+}
+
+
+void squashfs_decompressor_destroy(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream;
+	int i;
+
+	if (msblk->stream == NULL)
+		return;
+
+	for (i = 0; i < msblk->nr_streams; i++) {
+		stream = &msblk->stream[i];
+		if (stream->stream)
+			msblk->decompressor->free(stream->stream);
+	}
+
+	kfree(msblk->stream);
+	msblk->stream = NULL;
+}
+
+
+int squashfs_decompress(struct squashfs_sb_info *msblk, void **buffer,
+	struct buffer_head **bh, int b, int offset, int length, int srclength,
+	int pages)
+{
+	struct squashfs_stream *stream;
+	int res;
+
+	stream = &msblk->stream[raw_smp_processor_id() % msblk->nr_streams];
+
+	mutex_lock(&stream->mutex);
+	res = msblk->decompressor->decompress(msblk, stream->stream, buffer,
+		bh, b, offset, length, srclength, pages);
+	mutex_unlock(&stream->mutex);
+
+	return res;
+}
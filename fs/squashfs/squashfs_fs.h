@@ -204,6 +204,9 @@
 /* cached data constants for filesystem */
 #define SQUASHFS_CACHED_BLKS		8
 
+/* most decompressor streams (and datablock cache entries) per filesystem */
+#define SQUASHFS_MAX_DECOMP		8
+
 #define SQUASHFS_MAX_FILE_SIZE_LOG	64
 
 #define SQUASHFS_MAX_FILE_SIZE		(1LL << \
@@ -103,6 +103,24 @@ static inline void ptep_set_wrprotect(struct mm_struct *mm, unsigned long addres
 #define pte_same(A,B)	(pte_val(A) == pte_val(B))
 #endif
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#ifndef __HAVE_ARCH_PMD_SAME
+#define pmd_same(A,B)	(pmd_val(A) == pmd_val(B))
+#endif
+#else
+static inline int pmd_trans_huge(pmd_t pmd)
+{
+	return 0;
+}
+
+/* only ever called on huge pmds */
+static inline int pmd_write(pmd_t pmd)
+{
+	BUG();
+	return 0;
+}
+#endif
+
 #ifndef __HAVE_ARCH_PAGE_TEST_DIRTY
 #define page_test_dirty(page)		(0)
 #endif
@@ -204,6 +222,27 @@ static inline int pmd_none_or_clear_bad(pmd_t *pmd)
 	return 0;
 }
 
+/*
+ * For walkers that only hold mmap_sem for reading: a transparent huge
+ * pmd can be faulted in under them at any time, so read the pmd once
+ * and treat a huge one like an empty one instead of clearing it as bad.
+ * Callers split or handle huge pmds before calling this.
+ */
+static inline int pmd_none_or_trans_huge_or_clear_bad(pmd_t *pmd)
+{
+	pmd_t pmdval = *pmd;
+
+	barrier();
+	if (pmd_none(pmdval))
+		return 1;
+	if (unlikely(pmd_bad(pmdval))) {
+		if (!pmd_trans_huge(pmdval))
+			pmd_clear_bad(pmd);
+		return 1;
+	}
+	return 0;
+}
+
 static inline pte_t __ptep_modify_prot_start(struct mm_struct *mm,
 					     unsigned long addr,
 					     pte_t *ptep)
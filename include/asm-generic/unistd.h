@@ -627,8 +627,16 @@ __SYSCALL(__NR_accept4, sys_accept4)
 #define __NR_recvmmsg 243
 __SYSCALL(__NR_recvmmsg, sys_recvmmsg)
 
+#define __NR_sendmmsg 244
+__SYSCALL(__NR_sendmmsg, sys_sendmmsg)
+
+#define __NR_process_vm_readv 245
+__SYSCALL(__NR_process_vm_readv, sys_process_vm_readv)
+#define __NR_process_vm_writev 246
+__SYSCALL(__NR_process_vm_writev, sys_process_vm_writev)
+
 #undef __NR_syscalls
-#define __NR_syscalls 244
+#define __NR_syscalls 247
 
 /*
  * All syscalls below here should go away really,
@@ -0,0 +1,115 @@
+#ifndef _LINUX_HUGE_MM_H
+#define _LINUX_HUGE_MM_H
+
+/*
+ * Transparent huge pages: anonymous memory mapped with one pmd per 2MB
+ * instead of a pte table, see Documentation/vm/transhuge.txt.
+ */
+
+struct mmu_gather;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+
+#define HPAGE_PMD_SHIFT	PMD_SHIFT
+#define HPAGE_PMD_SIZE	(1UL << HPAGE_PMD_SHIFT)
+#define HPAGE_PMD_MASK	(~(HPAGE_PMD_SIZE - 1))
+#define HPAGE_PMD_ORDER	(HPAGE_PMD_SHIFT - PAGE_SHIFT)
+#define HPAGE_PMD_NR	(1 << HPAGE_PMD_ORDER)
+
+enum transparent_hugepage_flag {
+	TRANSPARENT_HUGEPAGE_FLAG,
+	TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG,
+};
+
+extern unsigned long transparent_hugepage_flags;
+
+extern int transparent_hugepage_enabled(struct vm_area_struct *vma,
+					unsigned long address);
+
+extern int do_huge_pmd_anonymous_page(struct mm_struct *mm,
+				      struct vm_area_struct *vma,
+				      unsigned long address, pmd_t *pmd,
+				      unsigned int flags);
+extern int do_huge_pmd_wp_page(struct mm_struct *mm,
+			       struct vm_area_struct *vma,
+			       unsigned long address, pmd_t *pmd,
+			       pmd_t orig_pmd);
+extern int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
+			pmd_t *pmd);
+extern int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+			   unsigned long addr, pgprot_t newprot);
+
+extern void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd);
+
+/*
+ * Turn a transparent huge pmd back into a pte table mapping the same
+ * memory with small pages, for code that needs 4KB granularity.  This
+ * never fails and never sleeps; callers hold mmap_sem.
+ */
+#define split_huge_page_pmd(__mm, __pmd)				\
+	do {								\
+		if (unlikely(pmd_trans_huge(*(__pmd))))			\
+			__split_huge_page_pmd(__mm, __pmd);		\
+	} while (0)
+
+extern int hugepage_madvise(struct vm_area_struct *vma,
+			    unsigned long *vm_flags, int advice);
+
+#else /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+#define HPAGE_PMD_SHIFT	({ BUG(); 0; })
+#define HPAGE_PMD_SIZE	({ BUG(); 0; })
+#define HPAGE_PMD_MASK	({ BUG(); 0; })
+#define HPAGE_PMD_ORDER	({ BUG(); 0; })
+#define HPAGE_PMD_NR	({ BUG(); 0; })
+
+static inline int transparent_hugepage_enabled(struct vm_area_struct *vma,
+					       unsigned long address)
+{
+	return 0;
+}
+
+static inline int do_huge_pmd_anonymous_page(struct mm_struct *mm,
+					     struct vm_area_struct *vma,
+					     unsigned long address, pmd_t *pmd,
+					     unsigned int flags)
+{
+	return VM_FAULT_FALLBACK;
+}
+
+static inline int do_huge_pmd_wp_page(struct mm_struct *mm,
+				      struct vm_area_struct *vma,
+				      unsigned long address, pmd_t *pmd,
+				      pmd_t orig_pmd)
+{
+	BUG();
+	return 0;
+}
+
+static inline int zap_huge_pmd(struct mmu_gather *tlb,
+			       struct vm_area_struct *vma, pmd_t *pmd)
+{
+	return 0;
+}
+
+static inline int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+				  unsigned long addr, pgprot_t newprot)
+{
+	return 0;
+}
+
+#define split_huge_page_pmd(__mm, __pmd)	do { } while (0)
+
+static inline int hugepage_madvise(struct vm_area_struct *vma,
+				   unsigned long *vm_flags, int advice)
+{
+	BUG();
+	return 0;
+}
+
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+#endif /* _LINUX_HUGE_MM_H */
@@ -35,6 +35,9 @@ struct rpc_clnt {
 	struct list_head	cl_tasks;	/* List of tasks */
 	spinlock_t		cl_lock;	/* spinlock */
 	struct rpc_xprt *	cl_xprt;	/* transport */
+	struct rpc_xprt **	cl_xprts;	/* all transports, if nconnect > 1 */
+	unsigned int		cl_nconnect;	/* number of transports */
+	atomic_t		cl_xprt_next;	/* round-robin cursor */
 	struct rpc_procinfo *	cl_procinfo;	/* procedure info */
 	u32			cl_prog,	/* RPC program number */
 				cl_vers,	/* RPC version number */
@@ -115,6 +118,7 @@ struct rpc_create_args {
 	unsigned long		flags;
 	char			*client_name;
 	struct svc_xprt		*bc_xprt;	/* NFSv4.1 backchannel */
+	unsigned int		nconnect;	/* number of transports to open */
 };
 
 /* Values for "flags" field */
@@ -125,6 +129,9 @@ struct rpc_create_args {
 #define RPC_CLNT_CREATE_DISCRTRY	(1UL << 5)
 #define RPC_CLNT_CREATE_QUIET		(1UL << 6)
 
+/* Upper limit on rpc_create_args.nconnect */
+#define RPC_MAX_CONNECTIONS		16
+
 struct rpc_clnt *rpc_create(struct rpc_create_args *args);
 struct rpc_clnt	*rpc_bind_new_program(struct rpc_clnt *,
 				struct rpc_program *, u32);
@@ -163,6 +170,20 @@ char *		rpc_sockaddr2uaddr(const struct sockaddr *);
 size_t		rpc_uaddr2sockaddr(const char *, const size_t,
 				   struct sockaddr *, const size_t);
 
+/*
+ * Pick the transport a new task on this client is sent over.  Clients
+ * with several connections to the server hand them out in turn.
+ */
+static inline struct rpc_xprt *rpc_clnt_pick_xprt(struct rpc_clnt *clnt)
+{
+	unsigned int n;
+
+	if (likely(clnt->cl_nconnect <= 1))
+		return clnt->cl_xprt;
+	n = (unsigned int)atomic_inc_return(&clnt->cl_xprt_next);
+	return clnt->cl_xprts[n % clnt->cl_nconnect];
+}
+
 static inline unsigned short rpc_get_port(const struct sockaddr *sap)
 {
 	switch (sap->sa_family) {
@@ -44,6 +44,7 @@ struct rpc_task {
 	atomic_t		tk_count;	/* Reference count */
 	struct list_head	tk_task;	/* global list of tasks */
 	struct rpc_clnt *	tk_client;	/* RPC client */
+	struct rpc_xprt *	tk_xprt;	/* transport, one of tk_client's */
 	struct rpc_rqst *	tk_rqstp;	/* RPC request */
 
 	/*
@@ -86,7 +87,6 @@ struct rpc_task {
 				tk_garb_retry : 2,
 				tk_cred_retry : 2;
 };
-#define tk_xprt			tk_client->cl_xprt
 
 /* support walking a list of tasks on a wait queue */
 #define	task_for_each(task, pos, head) \
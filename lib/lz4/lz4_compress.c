@@ -0,0 +1,160 @@
+/*
+ *  LZ4 Compressor
+ *
+ *  Greedy parser over a hash table of the last position of each 4 byte
+ *  sequence, producing the LZ4 block format described in lz4defs.h.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/* Number of leading bytes that are equal in two words whose xor is diff */
+static inline unsigned int lz4_common_bytes(unsigned long diff)
+{
+#ifdef __LITTLE_ENDIAN
+	return __ffs(diff) >> 3;
+#else
+	return (BITS_PER_LONG - 1 - __fls(diff)) >> 3;
+#endif
+}
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - MFLIMIT;
+	const unsigned char * const matchlimit = iend - LASTLITERALS;
+	const unsigned char *ip = src, *anchor = src, *ref;
+	unsigned char * const oend = dst + *dst_len;
+	unsigned char *op = dst, *token;
+	u32 *table = wrkmem;
+	unsigned int searches;
+	size_t len;
+	u32 h;
+
+	BUILD_BUG_ON(LZ4_MEM_COMPRESS != (1 << LZ4_HASH_LOG) * sizeof(u32));
+
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+	/*
+	 * Stale entries are harmless: every candidate is checked against
+	 * the input, so the table only needs to hold offsets into src.
+	 */
+	memset(table, 0, LZ4_MEM_COMPRESS);
+	ip++;
+
+	for (;;) {
+		/* find the next match of at least MINMATCH bytes */
+		searches = 1 << SKIP_STRENGTH;
+		for (;;) {
+			h = LZ4_HASH(ip);
+			ref = src + table[h];
+			table[h] = ip - src;
+			if (ip - ref <= MAX_DISTANCE &&
+			    get_unaligned((const u32 *)ref) ==
+			    get_unaligned((const u32 *)ip))
+				break;
+			ip += searches++ >> SKIP_STRENGTH;
+			if (unlikely(ip > mflimit))
+				goto last_literals;
+		}
+
+		/* extend it backwards over the pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* literal run */
+		len = ip - anchor;
+		if (unlikely(op + 1 + len / 255 + 1 + len + 2 > oend))
+			return LZ4_E_OUTPUT_OVERRUN;
+		token = op++;
+		if (len >= RUN_MASK) {
+			*token = RUN_MASK << ML_BITS;
+			op = lz4_put_length(op, len - RUN_MASK);
+		} else
+			*token = len << ML_BITS;
+		if (likely(op + len + WILDCOPY_SLACK <= oend))
+			lz4_wildcopy(op, anchor, op + len);
+		else
+			memcpy(op, anchor, len);
+		op += len;
+
+		/* offset */
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		/* match length, compared a word at a time */
+		ip += MINMATCH;
+		ref += MINMATCH;
+		anchor = ip;
+		while (likely(ip + sizeof(long) <= matchlimit)) {
+			unsigned long diff =
+				get_unaligned((const unsigned long *)ref) ^
+				get_unaligned((const unsigned long *)ip);
+			if (diff) {
+				ip += lz4_common_bytes(diff);
+				goto count_done;
+			}
+			ip += sizeof(long);
+			ref += sizeof(long);
+		}
+		while (ip < matchlimit && *ip == *ref) {
+			ip++;
+			ref++;
+		}
+count_done:
+		len = ip - anchor;
+		if (unlikely(op + len / 255 + 1 > oend))
+			return LZ4_E_OUTPUT_OVERRUN;
+		if (len >= ML_MASK) {
+			*token += ML_MASK;
+			op = lz4_put_length(op, len - ML_MASK);
+		} else
+			*token += len;
+		anchor = ip;
+
+		if (ip > mflimit)
+			break;
+		/* the bytes just matched are a good bet for the next match */
+		table[LZ4_HASH(ip - 2)] = ip - 2 - src;
+	}
+
+last_literals:
+	len = iend - anchor;
+	if (unlikely(op + 1 + (len + 255 - RUN_MASK) / 255 + len > oend))
+		return LZ4_E_OUTPUT_OVERRUN;
+	if (len >= RUN_MASK) {
+		*op++ = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, len - RUN_MASK);
+	} else
+		*op++ = len << ML_BITS;
+	memcpy(op, anchor, len);
+	op += len;
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
@@ -0,0 +1,126 @@
+/*
+ *  LZ4 Decompressor
+ *
+ *  Every length and offset is checked against both buffers, so corrupt
+ *  or malicious input can not make it read or write out of bounds.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/* Smallest multiple of each offset below 8 that is at least 8 */
+static const u8 lz4_repeat_dist[sizeof(u64)] = { 0, 8, 8, 9, 8, 10, 12, 14 };
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len)
+{
+	const unsigned char * const iend = src + src_len;
+	unsigned char * const oend = dst + *dst_len;
+	const unsigned char *ip = src;
+	unsigned char *op = dst, *ref, *cpy;
+	unsigned int token, s, i;
+	size_t len, offset;
+
+	for (;;) {
+		if (unlikely(ip >= iend))
+			goto input_overrun;
+		token = *ip++;
+
+		/* literal run */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK) {
+			do {
+				if (unlikely(ip >= iend))
+					goto input_overrun;
+				s = *ip++;
+				len += s;
+			} while (s == 255);
+		}
+		if (unlikely(len > iend - ip))
+			goto input_overrun;
+		if (unlikely(len > oend - op))
+			goto output_overrun;
+		if (likely(len + WILDCOPY_SLACK <= iend - ip &&
+			   len + WILDCOPY_SLACK <= oend - op))
+			lz4_wildcopy(op, ip, op + len);
+		else
+			memcpy(op, ip, len);
+		ip += len;
+		op += len;
+
+		/* a block ends with a literal run */
+		if (ip == iend)
+			break;
+
+		if (unlikely(iend - ip < 2))
+			goto input_overrun;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(offset == 0 || offset > op - dst))
+			goto lookbehind_overrun;
+		ref = op - offset;
+
+		len = token & ML_MASK;
+		if (len == ML_MASK) {
+			do {
+				if (unlikely(ip >= iend))
+					goto input_overrun;
+				s = *ip++;
+				len += s;
+			} while (s == 255);
+		}
+		len += MINMATCH;
+		if (unlikely(len > oend - op))
+			goto output_overrun;
+
+		if (unlikely(len + WILDCOPY_SLACK > oend - op)) {
+			/* close to the end of the output, go byte by byte */
+			while (len--)
+				*op++ = *ref++;
+			continue;
+		}
+
+		/*
+		 * The match may overlap the bytes it produces.  For an offset
+		 * below a word, lay down the first word byte by byte and then
+		 * continue from an earlier repetition of the pattern that is
+		 * at least a word behind.
+		 */
+		cpy = op + len;
+		if (unlikely(offset < sizeof(u64))) {
+			for (i = 0; i < sizeof(u64); i++)
+				op[i] = ref[i];
+			op += sizeof(u64);
+			ref = op - lz4_repeat_dist[offset];
+		}
+		lz4_wildcopy(op, ref, cpy);
+		op = cpy;
+	}
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+
+input_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_INPUT_OVERRUN;
+
+output_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_OUTPUT_OVERRUN;
+
+lookbehind_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_LOOKBEHIND_OVERRUN;
+}
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
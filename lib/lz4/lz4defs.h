@@ -0,0 +1,60 @@
+/*
+ *  lz4defs.h -- common definitions of the LZ4 block format
+ *
+ *  A compressed block is a sequence of
+ *
+ *	token | [literal length bytes] | literals | offset | [match length bytes]
+ *
+ *  The high nibble of the token is the literal run length and the low
+ *  nibble the match length minus MINMATCH; a nibble of 15 is followed by
+ *  bytes that are added to it, up to and including the first byte that is
+ *  not 255.  The offset is a little endian 16 bit distance back into the
+ *  output.  The last sequence of a block has literals only, and the last
+ *  LASTLITERALS bytes of the input are always literals, so a decompressor
+ *  can stop as soon as the input is consumed.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#define MINMATCH	4
+#define LASTLITERALS	5
+#define MFLIMIT		12	/* a match may not start in the last 12 bytes */
+#define MINLENGTH	(MFLIMIT + 1)
+#define MAX_DISTANCE	65535
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+/*
+ * The compressor remembers the last position of each 4 byte sequence in
+ * a table of 1 << LZ4_HASH_LOG input offsets.  When a search misses, it
+ * moves forward faster and faster through incompressible data: by one
+ * byte for the first 1 << SKIP_STRENGTH attempts, then by two, ...
+ */
+#define LZ4_HASH_LOG	12
+#define SKIP_STRENGTH	6
+
+#define LZ4_HASH(p) \
+	((get_unaligned((const u32 *)(p)) * 2654435761U) >> (32 - LZ4_HASH_LOG))
+
+/*
+ * Copy a word at a time up to and possibly past end, by less than
+ * WILDCOPY_SLACK bytes.  Faster than memcpy() for the short runs that
+ * make up most of a block, but the caller must ensure the slack exists
+ * on both sides and that src is at least a word behind dst.
+ */
+#define WILDCOPY_SLACK	sizeof(u64)
+
+static inline void lz4_wildcopy(unsigned char *dst, const unsigned char *src,
+				const unsigned char *end)
+{
+	while (dst < end) {
+		put_unaligned(get_unaligned((const u64 *)src), (u64 *)dst);
+		dst += sizeof(u64);
+		src += sizeof(u64);
+	}
+}
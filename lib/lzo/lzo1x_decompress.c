@@ -26,6 +26,21 @@
 
 #define COPY4(dst, src)	\
 		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
+#if defined(__x86_64__)
+#define COPY8(dst, src)	\
+		put_unaligned(get_unaligned((const u64 *)(src)), (u64 *)(dst))
+#else
+#define COPY8(dst, src)	\
+		do { COPY4(dst, src); COPY4((dst) + 4, (src) + 4); } while (0)
+#endif
+
+/*
+ * Where unaligned loads and stores are cheap, literal runs and matches
+ * are copied 16 bytes at a time whenever both buffers have at least 15
+ * bytes of room past the end of the copy.  The extra bytes written are
+ * overwritten by what follows, or lie beyond the end of the output;
+ * every check the byte-wise paths make is still done before the copy.
+ */
 
 int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
 			unsigned char *out, size_t *out_len)
@@ -38,6 +53,10 @@ int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
 
 	*out_len = 0;
 
+	/* even an empty stream has its three byte end marker */
+	if (in_len < 3)
+		goto input_overrun;
+
 	if (*ip > 17) {
 		t = *ip++ - 17;
 		if (t < 4)
@@ -67,6 +86,23 @@ int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
 			}
 			t += 15 + *ip++;
 		}
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+		if (!HAVE_OP(t + 3 + 15, op_end, op) &&
+		    !HAVE_IP(t + 3 + 15, ip_end, ip)) {
+			const unsigned char *ie = ip + t + 3;
+			unsigned char *oe = op + t + 3;
+
+			do {
+				COPY8(op, ip);
+				COPY8(op + 8, ip + 8);
+				op += 16;
+				ip += 16;
+			} while (ip < ie);
+			ip = ie;
+			op = oe;
+			goto first_literal_run;
+		}
+#endif
 		if (HAVE_OP(t + 3, op_end, op))
 			goto output_overrun;
 		if (HAVE_IP(t + 4, ip_end, ip))
@@ -99,6 +135,8 @@ first_literal_run:
 		t = *ip++;
 		if (t >= 16)
 			goto match;
+		if (HAVE_IP(1, ip_end, ip))
+			goto input_overrun;
 		m_pos = op - (1 + M2_MAX_OFFSET);
 		m_pos -= t >> 2;
 		m_pos -= *ip++ << 2;
@@ -117,15 +155,12 @@ first_literal_run:
 		do {
 match:
 			if (t >= 64) {
+				if (HAVE_IP(1, ip_end, ip))
+					goto input_overrun;
 				m_pos = op - 1;
 				m_pos -= (t >> 2) & 7;
 				m_pos -= *ip++ << 3;
 				t = (t >> 5) - 1;
-				if (HAVE_LB(m_pos, out, op))
-					goto lookbehind_overrun;
-				if (HAVE_OP(t + 3 - 1, op_end, op))
-					goto output_overrun;
-				goto copy_match;
 			} else if (t >= 32) {
 				t &= 31;
 				if (t == 0) {
@@ -139,6 +174,8 @@ match:
 					}
 					t += 31 + *ip++;
 				}
+				if (HAVE_IP(2, ip_end, ip))
+					goto input_overrun;
 				m_pos = op - 1;
 				m_pos -= get_unaligned_le16(ip) >> 2;
 				ip += 2;
@@ -158,12 +195,16 @@ match:
 					}
 					t += 7 + *ip++;
 				}
+				if (HAVE_IP(2, ip_end, ip))
+					goto input_overrun;
 				m_pos -= get_unaligned_le16(ip) >> 2;
 				ip += 2;
 				if (m_pos == op)
 					goto eof_found;
 				m_pos -= 0x4000;
 			} else {
+				if (HAVE_IP(1, ip_end, ip))
+					goto input_overrun;
 				m_pos = op - 1;
 				m_pos -= t >> 2;
 				m_pos -= *ip++ << 2;
@@ -183,6 +224,22 @@ match:
 			if (HAVE_OP(t + 3 - 1, op_end, op))
 				goto output_overrun;
 
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+			/* an overlap of 8 or more is safe to copy in words */
+			if (op - m_pos >= 8 &&
+			    !HAVE_OP(t + 3 - 1 + 15, op_end, op)) {
+				unsigned char *oe = op + t + 3 - 1;
+
+				do {
+					COPY8(op, m_pos);
+					COPY8(op + 8, m_pos + 8);
+					op += 16;
+					m_pos += 16;
+				} while (op < oe);
+				op = oe;
+				goto match_done;
+			}
+#endif
 			if (t >= 2 * 4 - (3 - 1) && (op - m_pos) >= 4) {
 				COPY4(op, m_pos);
 				op += 4;
@@ -199,7 +256,6 @@ match:
 						*op++ = *m_pos++;
 					} while (--t > 0);
 			} else {
-copy_match:
 				*op++ = *m_pos++;
 				*op++ = *m_pos++;
 				do {
@@ -211,6 +267,15 @@ match_done:
 			if (t == 0)
 				break;
 match_next:
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+			if (!HAVE_OP(4, op_end, op) && !HAVE_IP(4, ip_end, ip)) {
+				COPY4(op, ip);
+				op += t;
+				ip += t;
+				t = *ip++;
+				continue;
+			}
+#endif
 			if (HAVE_OP(t, op_end, op))
 				goto output_overrun;
 			if (HAVE_IP(t + 1, ip_end, ip))
@@ -0,0 +1,1451 @@
+/*
+ *  mm/huge_memory.c
+ *
+ *  Transparent huge pages for anonymous memory.
+ *
+ *  Anonymous vmas that cover a whole, aligned 2MB range get a single
+ *  compound page mapped by a pmd on the first fault in that range,
+ *  instead of a pte table and 512 small pages.  Code that needs to
+ *  look at single ptes splits the huge pmd back into a pte table
+ *  first, which never fails: the pte table is allocated at fault
+ *  time and kept aside in mm->pmd_huge_pte for that.
+ *
+ *  Huge pages are not on the LRU lists.  A shrinker splits them when
+ *  memory is short, after which reclaim and swap see small pages as
+ *  usual.  khugepaged scans the registered mms in the background and
+ *  collapses ranges of small pages back into huge pages.
+ *
+ *  See Documentation/vm/transhuge.txt.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/mmu_notifier.h>
+#include <linux/rmap.h>
+#include <linux/swap.h>
+#include <linux/mempolicy.h>
+#include <linux/memcontrol.h>
+#include <linux/pagemap.h>
+#include <linux/kthread.h>
+#include <linux/khugepaged.h>
+#include <linux/mman.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <asm/tlb.h>
+#include <asm/pgalloc.h>
+#include "internal.h"
+
+/*
+ * By default transparent hugepages are used in every eligible vma and
+ * both the page fault and khugepaged may compact memory to get them.
+ * "transparent_hugepage=madvise" on the command line (or the sysfs
+ * knob) restricts them to MADV_HUGEPAGE regions.
+ */
+unsigned long transparent_hugepage_flags __read_mostly =
+	(1<<TRANSPARENT_HUGEPAGE_FLAG)|
+	(1<<TRANSPARENT_HUGEPAGE_DEFRAG_FLAG)|
+	(1<<TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG);
+
+#define GFP_TRANSHUGE	(GFP_HIGHUSER_MOVABLE | __GFP_COMP | \
+			 __GFP_NOMEMALLOC | __GFP_NORETRY | __GFP_NOWARN)
+
+/* vmas with any of these flags never get huge pages */
+#define VM_NO_THP	(VM_NOHUGEPAGE | VM_HUGETLB | VM_SHARED | VM_MAYSHARE | \
+			 VM_PFNMAP | VM_IO | VM_MIXEDMAP | VM_GROWSDOWN | \
+			 VM_GROWSUP | VM_MERGEABLE)
+
+/* khugepaged tunables, see the sysfs files below */
+static unsigned int khugepaged_pages_to_scan __read_mostly = HPAGE_PMD_NR*8;
+static unsigned int khugepaged_pages_collapsed;
+static unsigned int khugepaged_full_scans;
+static unsigned int khugepaged_scan_sleep_millisecs __read_mostly = 10000;
+/* during fragmentation poll the hugepage allocator once every minute */
+static unsigned int khugepaged_alloc_sleep_millisecs __read_mostly = 60000;
+static unsigned int khugepaged_max_ptes_none __read_mostly = HPAGE_PMD_NR-1;
+
+static struct task_struct *khugepaged_thread __read_mostly;
+static DEFINE_SPINLOCK(khugepaged_mm_lock);
+static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
+
+#define MM_SLOTS_HASH_HEADS 1024
+static struct hlist_head *mm_slots_hash __read_mostly;
+static struct kmem_cache *mm_slot_cache __read_mostly;
+
+/**
+ * struct mm_slot - hash lookup from mm to mm_slot
+ * @hash: hash collision list
+ * @mm_node: khugepaged scan list headed in khugepaged_scan.mm_head
+ * @mm: the mm that this information is valid for
+ */
+struct mm_slot {
+	struct hlist_node hash;
+	struct list_head mm_node;
+	struct mm_struct *mm;
+};
+
+/**
+ * struct khugepaged_scan - cursor for scanning
+ * @mm_head: the head of the mm list to scan
+ * @mm_slot: the current mm_slot we are scanning
+ * @address: the next address inside that to be scanned
+ *
+ * There is only the one khugepaged_scan instance of this cursor structure.
+ */
+struct khugepaged_scan {
+	struct list_head mm_head;
+	struct mm_slot *mm_slot;
+	unsigned long address;
+};
+
+static struct khugepaged_scan khugepaged_scan = {
+	.mm_head = LIST_HEAD_INIT(khugepaged_scan.mm_head),
+};
+
+/*
+ * All mapped huge pages, linked through the head page's lru, for the
+ * shrinker to pick from.  Huge pages are never on the LRU lists, so
+ * the field is free for this.
+ */
+static DEFINE_SPINLOCK(thp_list_lock);
+static LIST_HEAD(thp_list);
+static unsigned long nr_thp;
+
+static void thp_list_add(struct page *page)
+{
+	spin_lock(&thp_list_lock);
+	list_add(&page->lru, &thp_list);
+	nr_thp++;
+	spin_unlock(&thp_list_lock);
+}
+
+static void thp_list_del(struct page *page)
+{
+	spin_lock(&thp_list_lock);
+	list_del(&page->lru);
+	nr_thp--;
+	spin_unlock(&thp_list_lock);
+}
+
+static inline int khugepaged_enabled(void)
+{
+	return transparent_hugepage_flags &
+		((1<<TRANSPARENT_HUGEPAGE_FLAG) |
+		 (1<<TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG));
+}
+
+static inline int khugepaged_defrag(void)
+{
+	return test_bit(TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG,
+			&transparent_hugepage_flags);
+}
+
+static inline int fault_defrag(struct vm_area_struct *vma)
+{
+	if (test_bit(TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+		     &transparent_hugepage_flags))
+		return 1;
+	return test_bit(TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG,
+			&transparent_hugepage_flags) &&
+		(vma->vm_flags & VM_HUGEPAGE);
+}
+
+static inline struct page *alloc_hugepage(int defrag)
+{
+	return alloc_pages(GFP_TRANSHUGE & ~(defrag ? 0 : __GFP_WAIT),
+			   HPAGE_PMD_ORDER);
+}
+
+/*
+ * Only plain private anonymous memory is eligible.  Memory cgroups
+ * charge and reclaim in small pages, and vma mempolicies are applied
+ * per small page, so either of them keeps huge pages out for now.
+ * The root memory cgroup has no limit, so tasks in it are not held
+ * back.
+ */
+static int hugepage_vma_check(struct vm_area_struct *vma)
+{
+	if (vma->vm_ops || vma->vm_file)
+		return 0;
+	if (vma->vm_flags & VM_NO_THP)
+		return 0;
+	if (vma_policy(vma) || mm_in_child_mem_cgroup(vma->vm_mm))
+		return 0;
+	if (test_bit(TRANSPARENT_HUGEPAGE_FLAG, &transparent_hugepage_flags))
+		return 1;
+	return test_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+			&transparent_hugepage_flags) &&
+		(vma->vm_flags & VM_HUGEPAGE);
+}
+
+int transparent_hugepage_enabled(struct vm_area_struct *vma,
+				 unsigned long address)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return 0;
+	return hugepage_vma_check(vma);
+}
+
+static void pgtable_deposit(struct mm_struct *mm, pgtable_t pgtable)
+{
+	assert_spin_locked(&mm->page_table_lock);
+	list_add(&pgtable->lru, &mm->pmd_huge_pte);
+}
+
+static pgtable_t pgtable_withdraw(struct mm_struct *mm)
+{
+	pgtable_t pgtable;
+
+	assert_spin_locked(&mm->page_table_lock);
+	VM_BUG_ON(list_empty(&mm->pmd_huge_pte));
+	pgtable = list_first_entry(&mm->pmd_huge_pte, struct page, lru);
+	list_del(&pgtable->lru);
+	return pgtable;
+}
+
+static pmd_t mk_huge_pmd(struct page *page, struct vm_area_struct *vma)
+{
+	pmd_t entry;
+
+	entry = pmd_mkyoung(pmd_mkhuge(mk_pmd(page, vma->vm_page_prot)));
+	if (likely(vma->vm_flags & VM_WRITE))
+		entry = pmd_mkwrite(pmd_mkdirty(entry));
+	return entry;
+}
+
+/*
+ * The huge page counterpart of page_add_new_anon_rmap(): the page is
+ * accounted as HPAGE_PMD_NR anonymous pages but kept off the LRU.
+ */
+static void page_add_new_huge_rmap(struct page *page,
+				   struct vm_area_struct *vma,
+				   unsigned long haddr)
+{
+	struct anon_vma *anon_vma = vma->anon_vma;
+
+	SetPageSwapBacked(page);
+	atomic_set(&page->_mapcount, 0);
+	page->mapping = (struct address_space *)
+		((void *)anon_vma + PAGE_MAPPING_ANON);
+	page->index = linear_page_index(vma, haddr);
+	__mod_zone_page_state(page_zone(page), NR_ANON_PAGES, HPAGE_PMD_NR);
+	__inc_zone_page_state(page, NR_ANON_TRANSPARENT_HUGEPAGES);
+}
+
+int do_huge_pmd_anonymous_page(struct mm_struct *mm,
+			       struct vm_area_struct *vma,
+			       unsigned long address, pmd_t *pmd,
+			       unsigned int flags)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgtable_t pgtable;
+	struct page *page;
+	int i;
+
+	if (unlikely(anon_vma_prepare(vma)))
+		return VM_FAULT_OOM;
+	if (unlikely(khugepaged_enter(vma)))
+		return VM_FAULT_OOM;
+
+	page = alloc_hugepage(fault_defrag(vma));
+	if (unlikely(!page)) {
+		count_vm_event(THP_FAULT_FALLBACK);
+		return VM_FAULT_FALLBACK;
+	}
+	count_vm_event(THP_FAULT_ALLOC);
+
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable)) {
+		put_page(page);
+		return VM_FAULT_OOM;
+	}
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		clear_user_highpage(page + i, haddr + i * PAGE_SIZE);
+		__SetPageUptodate(page + i);
+		cond_resched();
+	}
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		/* somebody else faulted this range in meanwhile */
+		spin_unlock(&mm->page_table_lock);
+		put_page(page);
+		pte_free(mm, pgtable);
+		return 0;
+	}
+	page_add_new_huge_rmap(page, vma, haddr);
+	set_pmd_at(mm, haddr, pmd, mk_huge_pmd(page, vma));
+	pgtable_deposit(mm, pgtable);
+	mm->nr_ptes++;
+	add_mm_counter(mm, MM_ANONPAGES, HPAGE_PMD_NR);
+	thp_list_add(page);
+	spin_unlock(&mm->page_table_lock);
+
+	return 0;
+}
+
+/*
+ * Write fault on a write protected huge pmd, after mprotect() took
+ * write permission away and gave it back.  Huge pages are never shared
+ * (fork splits them), so there is nothing to copy.
+ */
+int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			unsigned long address, pmd_t *pmd, pmd_t orig_pmd)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pmd_t entry;
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_same(*pmd, orig_pmd))) {
+		entry = pmd_mkyoung(pmd_mkdirty(pmd_mkwrite(orig_pmd)));
+		pmdp_set_access_flags(vma, haddr, pmd, entry, 1);
+	}
+	spin_unlock(&mm->page_table_lock);
+
+	return VM_FAULT_WRITE;
+}
+
+/*
+ * Returns 1 if a huge pmd was unmapped, 0 if the pmd was split
+ * meanwhile and the caller has to zap the ptes instead.
+ */
+int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
+		 pmd_t *pmd)
+{
+	struct mm_struct *mm = tlb->mm;
+	pgtable_t pgtable;
+	struct page *page;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return 0;
+	}
+	page = pmd_page(pmdp_get_and_clear(mm, 0, pmd));
+	thp_list_del(page);
+	atomic_set(&page->_mapcount, -1);
+	__mod_zone_page_state(page_zone(page), NR_ANON_PAGES, -HPAGE_PMD_NR);
+	__dec_zone_page_state(page, NR_ANON_TRANSPARENT_HUGEPAGES);
+	add_mm_counter(mm, MM_ANONPAGES, -HPAGE_PMD_NR);
+	pgtable = pgtable_withdraw(mm);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+
+	tlb_remove_page(tlb, page);
+	pte_free(mm, pgtable);
+	return 1;
+}
+
+/*
+ * Returns 1 if the protection of the huge pmd was changed, 0 if the
+ * caller has to split it and change the ptes: PROT_NONE pmds would not
+ * be present, which is what a huge pmd being split looks like.
+ */
+int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+		    unsigned long addr, pgprot_t newprot)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	int ret = 0;
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd)) &&
+	    pmd_present(pmd_modify(*pmd, newprot))) {
+		pmd_t entry;
+
+		entry = pmdp_get_and_clear(mm, addr, pmd);
+		entry = pmd_modify(entry, newprot);
+		set_pmd_at(mm, addr, pmd, entry);
+		ret = 1;
+	}
+	spin_unlock(&mm->page_table_lock);
+
+	return ret;
+}
+
+static pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+	return pmd_offset(pud, address);
+}
+
+/*
+ * Replace a huge pmd by a pte table mapping the same 512 pages, which
+ * become independent small pages on the LRU.  The pmd is made
+ * non-present and flushed first, so that no CPU can use the 2MB and
+ * 4KB translations at the same time; page table walkers holding only
+ * mmap_sem for reading keep seeing a huge pmd until the pte table is
+ * in place.
+ */
+static void __split_huge_page_pmd_locked(struct mm_struct *mm, pmd_t *pmd)
+{
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t old;
+	pte_t *pte;
+	int i;
+
+	assert_spin_locked(&mm->page_table_lock);
+
+	old = pmdp_invalidate(mm, pmd);
+	page = pmd_page(old);
+	thp_list_del(page);
+
+	pgtable = pgtable_withdraw(mm);
+	pte = page_address(pgtable);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		struct page *p = page + i;
+
+		if (i) {
+			__ClearPageTail(p);
+			set_page_private(p, 0);
+			p->mapping = page->mapping;
+			p->index = page->index + i;
+			atomic_set(&p->_mapcount, 0);
+			atomic_set(&p->_count, 1);
+			SetPageSwapBacked(p);
+		}
+		set_pte(pte + i, mk_pte(p, pmd_pgprot(old)));
+	}
+	__ClearPageHead(page);
+
+	/* the tail pages must look like small pages before they are mapped */
+	smp_wmb();
+	pmd_populate(mm, pmd, pgtable);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		lru_cache_add_lru(page + i, LRU_ACTIVE_ANON);
+
+	__dec_zone_page_state(page, NR_ANON_TRANSPARENT_HUGEPAGES);
+	count_vm_event(THP_SPLIT);
+}
+
+void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+{
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd)))
+		__split_huge_page_pmd_locked(mm, pmd);
+	spin_unlock(&mm->page_table_lock);
+}
+
+/*
+ * Split a huge page found without any mmap_sem held, through the anon
+ * rmap.  The caller holds a reference on the head page.
+ */
+static void split_huge_page(struct page *page)
+{
+	struct anon_vma *anon_vma;
+	struct anon_vma_chain *avc;
+
+	anon_vma = page_lock_anon_vma(page);
+	if (!anon_vma)
+		return;
+
+	list_for_each_entry(avc, &anon_vma->head, same_anon_vma) {
+		struct vm_area_struct *vma = avc->vma;
+		struct mm_struct *mm = vma->vm_mm;
+		unsigned long address;
+		int done = 0;
+		pmd_t *pmd;
+
+		address = vma->vm_start +
+			((page->index - vma->vm_pgoff) << PAGE_SHIFT);
+		if (address < vma->vm_start || address >= vma->vm_end)
+			continue;
+
+		pmd = mm_find_pmd(mm, address);
+		if (!pmd)
+			continue;
+
+		spin_lock(&mm->page_table_lock);
+		if (pmd_trans_huge(*pmd) && pmd_page(*pmd) == page) {
+			__split_huge_page_pmd_locked(mm, pmd);
+			done = 1;
+		}
+		spin_unlock(&mm->page_table_lock);
+		if (done)
+			break;
+	}
+
+	page_unlock_anon_vma(anon_vma);
+}
+
+/*
+ * Huge pages are invisible to reclaim: split the least recently
+ * mapped ones when the VM asks, so that their small pages can be
+ * aged and swapped like any other.
+ */
+static int shrink_huge_pages(struct shrinker *shrink, int nr_to_scan,
+			     gfp_t gfp_mask)
+{
+	int nr = DIV_ROUND_UP(nr_to_scan, HPAGE_PMD_NR);
+
+	while (nr-- > 0) {
+		struct page *page;
+
+		spin_lock(&thp_list_lock);
+		if (list_empty(&thp_list)) {
+			spin_unlock(&thp_list_lock);
+			break;
+		}
+		page = list_entry(thp_list.prev, struct page, lru);
+		/* rotate, in case this one cannot be split right now */
+		list_move(&page->lru, &thp_list);
+		get_page(page);
+		spin_unlock(&thp_list_lock);
+
+		split_huge_page(page);
+		put_page(page);
+	}
+
+	return nr_thp * HPAGE_PMD_NR;
+}
+
+static struct shrinker huge_page_shrinker = {
+	.shrink = shrink_huge_pages,
+	.seeks = DEFAULT_SEEKS,
+};
+
+int hugepage_madvise(struct vm_area_struct *vma,
+		     unsigned long *vm_flags, int advice)
+{
+	switch (advice) {
+	case MADV_HUGEPAGE:
+		if (*vm_flags & (VM_NO_THP & ~VM_NOHUGEPAGE))
+			return -EINVAL;
+		*vm_flags &= ~VM_NOHUGEPAGE;
+		*vm_flags |= VM_HUGEPAGE;
+		/*
+		 * Register the mm with khugepaged now, a page fault in
+		 * this range may never come if it is already populated.
+		 */
+		if (unlikely(khugepaged_enter(vma)))
+			return -ENOMEM;
+		break;
+	case MADV_NOHUGEPAGE:
+		if (*vm_flags & (VM_NO_THP & ~VM_NOHUGEPAGE))
+			return -EINVAL;
+		*vm_flags &= ~VM_HUGEPAGE;
+		*vm_flags |= VM_NOHUGEPAGE;
+		break;
+	}
+
+	return 0;
+}
+
+static inline struct mm_slot *alloc_mm_slot(void)
+{
+	return kmem_cache_zalloc(mm_slot_cache, GFP_KERNEL);
+}
+
+static inline void free_mm_slot(struct mm_slot *mm_slot)
+{
+	kmem_cache_free(mm_slot_cache, mm_slot);
+}
+
+static struct mm_slot *get_mm_slot(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	struct hlist_head *bucket;
+	struct hlist_node *node;
+
+	bucket = &mm_slots_hash[((unsigned long)mm / sizeof(struct mm_struct))
+				% MM_SLOTS_HASH_HEADS];
+	hlist_for_each_entry(mm_slot, node, bucket, hash) {
+		if (mm == mm_slot->mm)
+			return mm_slot;
+	}
+	return NULL;
+}
+
+static void insert_to_mm_slots_hash(struct mm_struct *mm,
+				    struct mm_slot *mm_slot)
+{
+	struct hlist_head *bucket;
+
+	bucket = &mm_slots_hash[((unsigned long)mm / sizeof(struct mm_struct))
+				% MM_SLOTS_HASH_HEADS];
+	mm_slot->mm = mm;
+	hlist_add_head(&mm_slot->hash, bucket);
+}
+
+static inline int khugepaged_test_exit(struct mm_struct *mm)
+{
+	return atomic_read(&mm->mm_users) == 0;
+}
+
+int __khugepaged_enter(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int wakeup;
+
+	if (unlikely(!mm_slot_cache))	/* hugepage_init() failed */
+		return 0;
+
+	mm_slot = alloc_mm_slot();
+	if (!mm_slot)
+		return -ENOMEM;
+
+	/* __khugepaged_exit() must not run from under us */
+	VM_BUG_ON(khugepaged_test_exit(mm));
+	if (unlikely(test_and_set_bit(MMF_VM_HUGEPAGE, &mm->flags))) {
+		free_mm_slot(mm_slot);
+		return 0;
+	}
+
+	spin_lock(&khugepaged_mm_lock);
+	insert_to_mm_slots_hash(mm, mm_slot);
+	wakeup = list_empty(&khugepaged_scan.mm_head);
+	list_add_tail(&mm_slot->mm_node, &khugepaged_scan.mm_head);
+	spin_unlock(&khugepaged_mm_lock);
+
+	atomic_inc(&mm->mm_count);
+	if (wakeup)
+		wake_up_interruptible(&khugepaged_wait);
+
+	return 0;
+}
+
+void __khugepaged_exit(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int easy_to_free = 0;
+
+	spin_lock(&khugepaged_mm_lock);
+	mm_slot = get_mm_slot(mm);
+	if (mm_slot && khugepaged_scan.mm_slot != mm_slot) {
+		hlist_del(&mm_slot->hash);
+		list_del(&mm_slot->mm_node);
+		easy_to_free = 1;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	if (easy_to_free) {
+		clear_bit(MMF_VM_HUGEPAGE, &mm->flags);
+		free_mm_slot(mm_slot);
+		mmdrop(mm);
+	} else if (mm_slot) {
+		/*
+		 * khugepaged is working on this mm: it frees the mm_slot
+		 * once it sees mm_users at zero.  Wait for it to drop
+		 * mmap_sem, so that it is done with the page tables before
+		 * exit_mmap() tears them down.
+		 */
+		down_write(&mm->mmap_sem);
+		up_write(&mm->mmap_sem);
+	}
+}
+
+static void collect_mm_slot(struct mm_slot *mm_slot)
+{
+	struct mm_struct *mm = mm_slot->mm;
+
+	VM_BUG_ON(!spin_is_locked(&khugepaged_mm_lock));
+
+	if (khugepaged_test_exit(mm)) {
+		hlist_del(&mm_slot->hash);
+		list_del(&mm_slot->mm_node);
+		clear_bit(MMF_VM_HUGEPAGE, &mm->flags);
+		free_mm_slot(mm_slot);
+		mmdrop(mm);
+	}
+}
+
+static void release_pte_page(struct page *page)
+{
+	dec_zone_page_state(page, NR_ISOLATED_ANON);
+	unlock_page(page);
+	putback_lru_page(page);
+}
+
+static void release_pte_pages(pte_t *pte, pte_t *_pte)
+{
+	while (--_pte >= pte) {
+		pte_t pteval = *_pte;
+		if (!pte_none(pteval))
+			release_pte_page(pte_page(pteval));
+	}
+}
+
+/*
+ * Lock and isolate every page mapped by the pte table, so that neither
+ * reclaim nor the rmap walkers can get at them while they are copied.
+ * Pages pinned by anybody but this mapping make the collapse fail.
+ */
+static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
+					unsigned long address, pte_t *pte)
+{
+	struct page *page;
+	pte_t *_pte;
+	int none = 0;
+
+	for (_pte = pte; _pte < pte + HPAGE_PMD_NR;
+	     _pte++, address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+
+		if (pte_none(pteval)) {
+			if (++none <= khugepaged_max_ptes_none)
+				continue;
+			goto out;
+		}
+		if (!pte_present(pteval))
+			goto out;
+		page = vm_normal_page(vma, address, pteval);
+		if (unlikely(!page))
+			goto out;
+		VM_BUG_ON(PageCompound(page));
+		if (!PageAnon(page) || page_mapcount(page) != 1 ||
+		    page_count(page) != 1)
+			goto out;
+		if (!trylock_page(page))
+			goto out;
+		if (isolate_lru_page(page)) {
+			unlock_page(page);
+			goto out;
+		}
+		inc_zone_page_state(page, NR_ISOLATED_ANON);
+	}
+	return 1;
+
+out:
+	release_pte_pages(pte, _pte);
+	return 0;
+}
+
+/*
+ * Copy the isolated small pages into the huge page and free them.
+ * Returns the number of pte_none entries, which become newly
+ * allocated (zeroed) memory of the process.
+ */
+static int __collapse_huge_page_copy(pte_t *pte, struct page *page,
+				     struct vm_area_struct *vma,
+				     unsigned long address, spinlock_t *ptl)
+{
+	pte_t *_pte;
+	int none = 0;
+
+	for (_pte = pte; _pte < pte + HPAGE_PMD_NR;
+	     _pte++, page++, address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+		struct page *src_page;
+
+		if (pte_none(pteval)) {
+			clear_user_highpage(page, address);
+			none++;
+		} else {
+			src_page = pte_page(pteval);
+			copy_user_highpage(page, src_page, address, vma);
+			VM_BUG_ON(page_mapcount(src_page) != 1);
+			VM_BUG_ON(page_count(src_page) != 2);
+			/*
+			 * The pte lock is not needed to exclude anybody,
+			 * but page_remove_rmap() updates per-cpu stats.
+			 */
+			spin_lock(ptl);
+			pte_clear(vma->vm_mm, address, _pte);
+			page_remove_rmap(src_page);
+			spin_unlock(ptl);
+			dec_zone_page_state(src_page, NR_ISOLATED_ANON);
+			/* isolate_lru_page() leaves PG_active set */
+			ClearPageActive(src_page);
+			unlock_page(src_page);
+			/* drop the isolation and the mapping references */
+			put_page(src_page);
+			put_page(src_page);
+		}
+		__SetPageUptodate(page);
+	}
+
+	return none;
+}
+
+/*
+ * Called with mmap_sem held for reading, returns with it released.
+ * The huge page is allocated outside of mmap_sem, as that may have to
+ * wait for compaction, and the vma is looked up again afterwards.
+ */
+static void collapse_huge_page(struct mm_struct *mm, unsigned long address,
+			       struct page **hpage)
+{
+	struct vm_area_struct *vma;
+	struct page *new_page;
+	pgtable_t pgtable;
+	pmd_t *pmd, _pmd;
+	spinlock_t *ptl;
+	pte_t *pte;
+	int none;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+	up_read(&mm->mmap_sem);
+
+	new_page = *hpage;
+	if (!new_page) {
+		new_page = alloc_hugepage(khugepaged_defrag());
+		if (unlikely(!new_page)) {
+			count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+			*hpage = ERR_PTR(-ENOMEM);
+			return;
+		}
+		count_vm_event(THP_COLLAPSE_ALLOC);
+		*hpage = new_page;
+	}
+
+	down_write(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		goto out;
+
+	vma = find_vma(mm, address);
+	if (!vma || address < vma->vm_start ||
+	    address + HPAGE_PMD_SIZE > vma->vm_end)
+		goto out;
+	if (!hugepage_vma_check(vma) || (vma->vm_flags & VM_LOCKED))
+		goto out;
+	if (!vma->anon_vma || !list_is_singular(&vma->anon_vma_chain))
+		goto out;
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || !pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		goto out;
+
+	mmu_notifier_invalidate_range_start(mm, address,
+					    address + HPAGE_PMD_SIZE);
+
+	/* keep the rmap walkers away until the pages are isolated */
+	anon_vma_lock(vma);
+
+	pte = pte_offset_map(pmd, address);
+	ptl = pte_lockptr(mm, pmd);
+
+	/*
+	 * Unhook the pte table and flush the TLBs, so that nobody can
+	 * reach the small pages through it anymore, not even
+	 * get_user_pages_fast().
+	 */
+	spin_lock(&mm->page_table_lock);
+	_pmd = pmdp_get_and_clear(mm, address, pmd);
+	spin_unlock(&mm->page_table_lock);
+	flush_tlb_range(vma, address, address + HPAGE_PMD_SIZE);
+
+	spin_lock(ptl);
+	if (unlikely(!__collapse_huge_page_isolate(vma, address, pte))) {
+		spin_unlock(ptl);
+		pte_unmap(pte);
+		spin_lock(&mm->page_table_lock);
+		BUG_ON(!pmd_none(*pmd));
+		pmd_populate(mm, pmd, pmd_pgtable(_pmd));
+		spin_unlock(&mm->page_table_lock);
+		anon_vma_unlock(vma);
+		mmu_notifier_invalidate_range_end(mm, address,
+						  address + HPAGE_PMD_SIZE);
+		goto out;
+	}
+	spin_unlock(ptl);
+
+	/* the pages are isolated and locked, rmap cannot find them now */
+	anon_vma_unlock(vma);
+	mmu_notifier_invalidate_range_end(mm, address,
+					  address + HPAGE_PMD_SIZE);
+
+	none = __collapse_huge_page_copy(pte, new_page, vma, address, ptl);
+	pte_unmap(pte);
+	pgtable = pmd_pgtable(_pmd);
+
+	spin_lock(&mm->page_table_lock);
+	BUG_ON(!pmd_none(*pmd));
+	page_add_new_huge_rmap(new_page, vma, address);
+	set_pmd_at(mm, address, pmd, mk_huge_pmd(new_page, vma));
+	/* the emptied pte table is kept for splitting the pmd again */
+	pgtable_deposit(mm, pgtable);
+	add_mm_counter(mm, MM_ANONPAGES, none);
+	thp_list_add(new_page);
+	spin_unlock(&mm->page_table_lock);
+
+	*hpage = NULL;
+	khugepaged_pages_collapsed++;
+out:
+	up_write(&mm->mmap_sem);
+}
+
+/*
+ * Look at one pmd worth of ptes.  Returns 1 if a collapse was
+ * attempted, in which case mmap_sem has been released.
+ */
+static int khugepaged_scan_pmd(struct mm_struct *mm,
+			       struct vm_area_struct *vma,
+			       unsigned long address,
+			       struct page **hpage)
+{
+	int ret = 0, referenced = 0, none = 0;
+	unsigned long _address;
+	struct page *page;
+	pte_t *pte, *_pte;
+	spinlock_t *ptl;
+	pmd_t *pmd;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || !pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return 0;
+
+	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+	for (_address = address, _pte = pte; _pte < pte + HPAGE_PMD_NR;
+	     _pte++, _address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+
+		if (pte_none(pteval)) {
+			if (++none <= khugepaged_max_ptes_none)
+				continue;
+			goto out_unmap;
+		}
+		if (!pte_present(pteval))
+			goto out_unmap;
+		page = vm_normal_page(vma, _address, pteval);
+		if (unlikely(!page))
+			goto out_unmap;
+		VM_BUG_ON(PageCompound(page));
+		if (!PageLRU(page) || PageLocked(page) || !PageAnon(page))
+			goto out_unmap;
+		/* shared, swap cached or pinned pages stay as they are */
+		if (page_mapcount(page) != 1 || page_count(page) != 1)
+			goto out_unmap;
+		if (pte_young(pteval) || PageReferenced(page))
+			referenced = 1;
+	}
+	/* only collapse ranges that are actually in use */
+	if (referenced)
+		ret = 1;
+out_unmap:
+	pte_unmap_unlock(pte, ptl);
+	if (ret)
+		collapse_huge_page(mm, address, hpage);
+	return ret;
+}
+
+/*
+ * Scan up to @pages ptes of the current mm_slot.  Called and returns
+ * with khugepaged_mm_lock held, drops it while scanning.
+ */
+static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
+					    struct page **hpage)
+{
+	struct mm_slot *mm_slot;
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	unsigned int progress = 0;
+
+	VM_BUG_ON(!pages);
+	VM_BUG_ON(!spin_is_locked(&khugepaged_mm_lock));
+
+	if (khugepaged_scan.mm_slot)
+		mm_slot = khugepaged_scan.mm_slot;
+	else {
+		mm_slot = list_entry(khugepaged_scan.mm_head.next,
+				     struct mm_slot, mm_node);
+		khugepaged_scan.address = 0;
+		khugepaged_scan.mm_slot = mm_slot;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	mm = mm_slot->mm;
+	down_read(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		vma = NULL;
+	else
+		vma = find_vma(mm, khugepaged_scan.address);
+
+	progress++;
+	for (; vma; vma = vma->vm_next) {
+		unsigned long hstart, hend;
+
+		cond_resched();
+		if (unlikely(khugepaged_test_exit(mm))) {
+			progress++;
+			break;
+		}
+
+		if (!hugepage_vma_check(vma) || (vma->vm_flags & VM_LOCKED) ||
+		    !vma->anon_vma ||
+		    !list_is_singular(&vma->anon_vma_chain)) {
+			progress++;
+			continue;
+		}
+		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+		hend = vma->vm_end & HPAGE_PMD_MASK;
+		if (hstart >= hend) {
+			progress++;
+			continue;
+		}
+		if (khugepaged_scan.address < hstart)
+			khugepaged_scan.address = hstart;
+		if (khugepaged_scan.address >= hend) {
+			progress++;
+			continue;
+		}
+
+		while (khugepaged_scan.address < hend) {
+			int ret;
+
+			cond_resched();
+			if (unlikely(khugepaged_test_exit(mm)))
+				goto breakouterloop;
+
+			ret = khugepaged_scan_pmd(mm, vma,
+						  khugepaged_scan.address,
+						  hpage);
+			khugepaged_scan.address += HPAGE_PMD_SIZE;
+			progress += HPAGE_PMD_NR;
+			if (ret)
+				/* mmap_sem was released, vma is stale */
+				goto breakouterloop_mmap_sem;
+			if (progress >= pages)
+				goto breakouterloop;
+		}
+	}
+breakouterloop:
+	up_read(&mm->mmap_sem);
+breakouterloop_mmap_sem:
+
+	spin_lock(&khugepaged_mm_lock);
+	VM_BUG_ON(khugepaged_scan.mm_slot != mm_slot);
+	/*
+	 * Move on to the next mm_slot if this mm is exiting or all of
+	 * its vmas have been scanned.
+	 */
+	if (khugepaged_test_exit(mm) || !vma) {
+		/*
+		 * Step away from this mm_slot before collecting it, so
+		 * that __khugepaged_exit() finds it unused.
+		 */
+		if (mm_slot->mm_node.next != &khugepaged_scan.mm_head) {
+			khugepaged_scan.mm_slot = list_entry(
+				mm_slot->mm_node.next,
+				struct mm_slot, mm_node);
+			khugepaged_scan.address = 0;
+		} else {
+			khugepaged_scan.mm_slot = NULL;
+			khugepaged_full_scans++;
+		}
+
+		collect_mm_slot(mm_slot);
+	}
+
+	return progress;
+}
+
+static int khugepaged_has_work(void)
+{
+	return !list_empty(&khugepaged_scan.mm_head) &&
+		khugepaged_enabled();
+}
+
+static int khugepaged_wait_event(void)
+{
+	return khugepaged_has_work() || kthread_should_stop();
+}
+
+static void khugepaged_do_scan(struct page **hpage)
+{
+	unsigned int progress = 0, pass_through_head = 0;
+	unsigned int pages = khugepaged_pages_to_scan;
+
+	barrier(); /* write khugepaged_pages_to_scan to local stack */
+
+	while (progress < pages) {
+		cond_resched();
+
+		if (IS_ERR(*hpage) || kthread_should_stop())
+			break;
+
+		spin_lock(&khugepaged_mm_lock);
+		if (!khugepaged_scan.mm_slot)
+			pass_through_head++;
+		if (khugepaged_has_work() && pass_through_head < 2)
+			progress += khugepaged_scan_mm_slot(pages - progress,
+							    hpage);
+		else
+			progress = pages;
+		spin_unlock(&khugepaged_mm_lock);
+	}
+}
+
+static int khugepaged(void *none)
+{
+	struct page *hpage = NULL;
+
+	set_user_nice(current, 19);
+
+	while (!kthread_should_stop()) {
+		khugepaged_do_scan(&hpage);
+
+		if (IS_ERR(hpage)) {
+			/* no huge page to be had, try again later */
+			hpage = NULL;
+			schedule_timeout_interruptible(
+				msecs_to_jiffies(
+					khugepaged_alloc_sleep_millisecs));
+			continue;
+		}
+		/* don't sit on a huge page while sleeping */
+		if (hpage) {
+			put_page(hpage);
+			hpage = NULL;
+		}
+
+		if (khugepaged_has_work())
+			schedule_timeout_interruptible(
+				msecs_to_jiffies(
+					khugepaged_scan_sleep_millisecs));
+		else
+			wait_event_interruptible(khugepaged_wait,
+						 khugepaged_wait_event());
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_SYSFS
+/*
+ * This all compiles without CONFIG_SYSFS, but is a waste of space.
+ */
+
+#define THP_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+
+#define THP_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static ssize_t double_flag_show(char *buf,
+				enum transparent_hugepage_flag enabled,
+				enum transparent_hugepage_flag req_madv)
+{
+	if (test_bit(enabled, &transparent_hugepage_flags)) {
+		VM_BUG_ON(test_bit(req_madv, &transparent_hugepage_flags));
+		return sprintf(buf, "[always] madvise never\n");
+	} else if (test_bit(req_madv, &transparent_hugepage_flags))
+		return sprintf(buf, "always [madvise] never\n");
+	else
+		return sprintf(buf, "always madvise [never]\n");
+}
+
+static ssize_t double_flag_store(const char *buf, size_t count,
+				 enum transparent_hugepage_flag enabled,
+				 enum transparent_hugepage_flag req_madv)
+{
+	if (!memcmp("always", buf, min(sizeof("always")-1, count))) {
+		set_bit(enabled, &transparent_hugepage_flags);
+		clear_bit(req_madv, &transparent_hugepage_flags);
+	} else if (!memcmp("madvise", buf,
+			   min(sizeof("madvise")-1, count))) {
+		clear_bit(enabled, &transparent_hugepage_flags);
+		set_bit(req_madv, &transparent_hugepage_flags);
+	} else if (!memcmp("never", buf, min(sizeof("never")-1, count))) {
+		clear_bit(enabled, &transparent_hugepage_flags);
+		clear_bit(req_madv, &transparent_hugepage_flags);
+	} else
+		return -EINVAL;
+
+	return count;
+}
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return double_flag_show(buf, TRANSPARENT_HUGEPAGE_FLAG,
+				TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	ssize_t ret;
+
+	ret = double_flag_store(buf, count, TRANSPARENT_HUGEPAGE_FLAG,
+				TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG);
+	if (ret > 0 && khugepaged_enabled())
+		wake_up_interruptible(&khugepaged_wait);
+
+	return ret;
+}
+THP_ATTR(enabled);
+
+static ssize_t defrag_show(struct kobject *kobj,
+			   struct kobj_attribute *attr, char *buf)
+{
+	return double_flag_show(buf, TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+				TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG);
+}
+
+static ssize_t defrag_store(struct kobject *kobj,
+			    struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	return double_flag_store(buf, count, TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+				 TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG);
+}
+THP_ATTR(defrag);
+
+static struct attribute *hugepage_attrs[] = {
+	&enabled_attr.attr,
+	&defrag_attr.attr,
+	NULL,
+};
+
+static struct attribute_group hugepage_attr_group = {
+	.attrs = hugepage_attrs,
+};
+
+static ssize_t uint_show(char *buf, unsigned int val)
+{
+	return sprintf(buf, "%u\n", val);
+}
+
+static ssize_t uint_store(const char *buf, size_t count,
+			  unsigned int *val, unsigned long max)
+{
+	unsigned long v;
+	int err;
+
+	err = strict_strtoul(buf, 10, &v);
+	if (err || v > max)
+		return -EINVAL;
+
+	*val = v;
+	return count;
+}
+
+static ssize_t scan_sleep_millisecs_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	return uint_show(buf, khugepaged_scan_sleep_millisecs);
+}
+
+static ssize_t scan_sleep_millisecs_store(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  const char *buf, size_t count)
+{
+	ssize_t ret;
+
+	ret = uint_store(buf, count, &khugepaged_scan_sleep_millisecs,
+			 UINT_MAX);
+	if (ret > 0)
+		wake_up_interruptible(&khugepaged_wait);
+	return ret;
+}
+THP_ATTR(scan_sleep_millisecs);
+
+static ssize_t alloc_sleep_millisecs_show(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  char *buf)
+{
+	return uint_show(buf, khugepaged_alloc_sleep_millisecs);
+}
+
+static ssize_t alloc_sleep_millisecs_store(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   const char *buf, size_t count)
+{
+	return uint_store(buf, count, &khugepaged_alloc_sleep_millisecs,
+			  UINT_MAX);
+}
+THP_ATTR(alloc_sleep_millisecs);
+
+static ssize_t pages_to_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return uint_show(buf, khugepaged_pages_to_scan);
+}
+
+static ssize_t pages_to_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned int pages = khugepaged_pages_to_scan;
+	ssize_t ret;
+
+	ret = uint_store(buf, count, &pages, UINT_MAX);
+	if (ret > 0) {
+		if (!pages)
+			return -EINVAL;
+		khugepaged_pages_to_scan = pages;
+	}
+	return ret;
+}
+THP_ATTR(pages_to_scan);
+
+static ssize_t max_ptes_none_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return uint_show(buf, khugepaged_max_ptes_none);
+}
+
+static ssize_t max_ptes_none_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	return uint_store(buf, count, &khugepaged_max_ptes_none,
+			  HPAGE_PMD_NR - 1);
+}
+THP_ATTR(max_ptes_none);
+
+static ssize_t khugepaged_defrag_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return uint_show(buf, khugepaged_defrag());
+}
+
+static ssize_t khugepaged_defrag_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	unsigned int defrag;
+	ssize_t ret;
+
+	ret = uint_store(buf, count, &defrag, 1);
+	if (ret > 0) {
+		if (defrag)
+			set_bit(TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG,
+				&transparent_hugepage_flags);
+		else
+			clear_bit(TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG,
+				  &transparent_hugepage_flags);
+	}
+	return ret;
+}
+static struct kobj_attribute khugepaged_defrag_attr =
+	__ATTR(defrag, 0644, khugepaged_defrag_show,
+	       khugepaged_defrag_store);
+
+static ssize_t pages_collapsed_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return uint_show(buf, khugepaged_pages_collapsed);
+}
+THP_ATTR_RO(pages_collapsed);
+
+static ssize_t full_scans_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return uint_show(buf, khugepaged_full_scans);
+}
+THP_ATTR_RO(full_scans);
+
+static struct attribute *khugepaged_attrs[] = {
+	&khugepaged_defrag_attr.attr,
+	&max_ptes_none_attr.attr,
+	&pages_to_scan_attr.attr,
+	&pages_collapsed_attr.attr,
+	&full_scans_attr.attr,
+	&scan_sleep_millisecs_attr.attr,
+	&alloc_sleep_millisecs_attr.attr,
+	NULL,
+};
+
+static struct attribute_group khugepaged_attr_group = {
+	.attrs = khugepaged_attrs,
+	.name = "khugepaged",
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init setup_transparent_hugepage(char *str)
+{
+	if (!str)
+		return 0;
+	if (!strcmp(str, "always")) {
+		set_bit(TRANSPARENT_HUGEPAGE_FLAG,
+			&transparent_hugepage_flags);
+		clear_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+			  &transparent_hugepage_flags);
+	} else if (!strcmp(str, "madvise")) {
+		clear_bit(TRANSPARENT_HUGEPAGE_FLAG,
+			  &transparent_hugepage_flags);
+		set_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+			&transparent_hugepage_flags);
+	} else if (!strcmp(str, "never")) {
+		clear_bit(TRANSPARENT_HUGEPAGE_FLAG,
+			  &transparent_hugepage_flags);
+		clear_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+			  &transparent_hugepage_flags);
+	} else {
+		printk(KERN_WARNING
+		       "transparent_hugepage= cannot parse, ignored\n");
+		return 0;
+	}
+	return 1;
+}
+__setup("transparent_hugepage=", setup_transparent_hugepage);
+
+static int __init hugepage_init(void)
+{
+#ifdef CONFIG_SYSFS
+	struct kobject *hugepage_kobj;
+	int err;
+#endif
+
+	if (!has_transparent_hugepage()) {
+		transparent_hugepage_flags = 0;
+		return -EINVAL;
+	}
+
+	mm_slots_hash = kzalloc(MM_SLOTS_HASH_HEADS * sizeof(struct hlist_head),
+				GFP_KERNEL);
+	if (!mm_slots_hash)
+		goto out_nomem;
+	mm_slot_cache = KMEM_CACHE(mm_slot, 0);
+	if (!mm_slot_cache)
+		goto out_free_hash;
+
+#ifdef CONFIG_SYSFS
+	hugepage_kobj = kobject_create_and_add("transparent_hugepage",
+					       mm_kobj);
+	if (unlikely(!hugepage_kobj)) {
+		printk(KERN_ERR "hugepage: failed kobject create\n");
+		goto out_free_cache;
+	}
+
+	err = sysfs_create_group(hugepage_kobj, &hugepage_attr_group);
+	if (!err)
+		err = sysfs_create_group(hugepage_kobj,
+					 &khugepaged_attr_group);
+	if (err) {
+		printk(KERN_ERR "hugepage: failed register sysfs group\n");
+		kobject_put(hugepage_kobj);
+		goto out_free_cache;
+	}
+#endif
+
+	khugepaged_thread = kthread_run(khugepaged, NULL, "khugepaged");
+	if (IS_ERR(khugepaged_thread)) {
+		printk(KERN_ERR "hugepage: creating kthread failed\n");
+		khugepaged_thread = NULL;
+	}
+
+	register_shrinker(&huge_page_shrinker);
+	return 0;
+
+#ifdef CONFIG_SYSFS
+out_free_cache:
+	kmem_cache_destroy(mm_slot_cache);
+	mm_slot_cache = NULL;
+#endif
+out_free_hash:
+	kfree(mm_slots_hash);
+out_nomem:
+	transparent_hugepage_flags = 0;
+	return -ENOMEM;
+}
+module_init(hugepage_init)
@@ -0,0 +1,369 @@
+/*
+ *	linux/mm/process_vm_access.c
+ *
+ * process_vm_readv() and process_vm_writev(): copy data between the
+ * address space of the caller and that of another process in a single
+ * copy.  The pages of the remote process are pinned with
+ * get_user_pages() and copied to or from the caller's buffers directly,
+ * instead of going through a pipe or word by word through ptrace.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/uio.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/ptrace.h>
+#include <linux/slab.h>
+#include <linux/syscalls.h>
+
+#ifdef CONFIG_COMPAT
+#include <linux/compat.h>
+#endif
+
+/* Remote pages pinned at a time when the array is on the stack */
+#define PVM_MAX_PP_ARRAY_COUNT	16
+
+/* Largest page array kmalloc()ed for bigger remote iovecs, in bytes */
+#define PVM_MAX_KMALLOC_PAGES	(PAGE_SIZE * 2)
+
+/* Where the copy has got to in the caller's iovecs */
+struct pvm_local {
+	const struct iovec *iov;
+	unsigned long nr_segs;
+	unsigned long seg;
+	size_t offset;
+};
+
+/*
+ * Copy @len bytes at @offset in @page to or from the caller's iovecs.
+ * Returns the number of bytes copied, which is short if the iovecs run
+ * out or a fault stops the copy; -EFAULT if nothing could be copied.
+ */
+static ssize_t process_vm_copy_page(struct page *page, unsigned long offset,
+				    size_t len, struct pvm_local *local,
+				    int vm_write)
+{
+	char *kaddr = kmap(page) + offset;
+	size_t copied = 0;
+
+	while (copied < len && local->seg < local->nr_segs) {
+		const struct iovec *iov = &local->iov[local->seg];
+		void __user *uaddr = iov->iov_base + local->offset;
+		size_t bytes = min(len - copied, iov->iov_len - local->offset);
+		size_t left;
+
+		if (vm_write)
+			left = copy_from_user(kaddr + copied, uaddr, bytes);
+		else
+			left = copy_to_user(uaddr, kaddr + copied, bytes);
+
+		copied += bytes - left;
+		local->offset += bytes - left;
+		if (left)
+			break;
+		if (local->offset == iov->iov_len) {
+			local->seg++;
+			local->offset = 0;
+		}
+	}
+	kunmap(page);
+
+	if (!copied && len && local->seg < local->nr_segs)
+		return -EFAULT;
+	return copied;
+}
+
+/*
+ * Copy one remote iovec, pinning at most @max_pages remote pages at a
+ * time.  The remote mmap_sem is dropped before copying, since the
+ * caller's buffers may fault, and may be in the same mm.
+ */
+static ssize_t process_vm_rw_single_vec(unsigned long addr, unsigned long len,
+					struct pvm_local *local,
+					struct page **process_pages,
+					unsigned long max_pages,
+					struct mm_struct *mm,
+					struct task_struct *task,
+					int vm_write)
+{
+	unsigned long pa = addr & PAGE_MASK;
+	unsigned long offset = addr - pa;
+	unsigned long nr_pages;
+	ssize_t copied = 0;
+	ssize_t rc = 0;
+
+	if (!len)
+		return 0;
+	nr_pages = (addr + len - 1) / PAGE_SIZE - addr / PAGE_SIZE + 1;
+
+	while (nr_pages && local->seg < local->nr_segs) {
+		int pinned, i;
+
+		down_read(&mm->mmap_sem);
+		pinned = get_user_pages(task, mm, pa, min(nr_pages, max_pages),
+					vm_write, 0, process_pages, NULL);
+		up_read(&mm->mmap_sem);
+		if (pinned <= 0) {
+			rc = pinned ? pinned : -EFAULT;
+			break;
+		}
+
+		for (i = 0; i < pinned; i++) {
+			struct page *page = process_pages[i];
+			size_t bytes = min(PAGE_SIZE - offset, len - copied);
+
+			if (!rc) {
+				rc = process_vm_copy_page(page, offset, bytes,
+							  local, vm_write);
+				if (rc > 0) {
+					if (vm_write)
+						set_page_dirty_lock(page);
+					copied += rc;
+					/* short copy: stop after this page */
+					rc = rc < bytes ? -EFAULT : 0;
+				}
+				offset = 0;
+			}
+			put_page(page);
+		}
+		if (rc)
+			break;
+
+		nr_pages -= pinned;
+		pa += pinned * PAGE_SIZE;
+	}
+
+	return copied ? copied : rc;
+}
+
+static ssize_t process_vm_rw_core(pid_t pid, const struct iovec *lvec,
+				  unsigned long liovcnt,
+				  const struct iovec *rvec,
+				  unsigned long riovcnt, int vm_write)
+{
+	struct page *pp_stack[PVM_MAX_PP_ARRAY_COUNT];
+	struct page **process_pages = pp_stack;
+	struct pvm_local local = {
+		.iov = lvec,
+		.nr_segs = liovcnt,
+	};
+	struct task_struct *task;
+	struct mm_struct *mm;
+	unsigned long max_pages = 0;
+	unsigned long seg;
+	ssize_t copied = 0;
+	ssize_t rc = 0;
+
+	/* Size the page array for the largest remote iovec */
+	for (seg = 0; seg < riovcnt; seg++) {
+		unsigned long start = (unsigned long)rvec[seg].iov_base;
+		unsigned long len = rvec[seg].iov_len;
+
+		if (!len)
+			continue;
+		if (start + len < start)
+			return -EFAULT;
+		max_pages = max(max_pages, (start + len - 1) / PAGE_SIZE -
+					   start / PAGE_SIZE + 1);
+	}
+	if (!max_pages)
+		return 0;
+
+	if (max_pages > PVM_MAX_PP_ARRAY_COUNT) {
+		max_pages = min_t(unsigned long, max_pages,
+				  PVM_MAX_KMALLOC_PAGES / sizeof(struct page *));
+		process_pages = kmalloc(max_pages * sizeof(struct page *),
+					GFP_KERNEL);
+		if (!process_pages)
+			return -ENOMEM;
+	} else
+		max_pages = PVM_MAX_PP_ARRAY_COUNT;
+
+	rcu_read_lock();
+	task = find_task_by_vpid(pid);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+	if (!task) {
+		rc = -ESRCH;
+		goto free_proc_pages;
+	}
+
+	/*
+	 * Same rules as attaching with ptrace, which could do the same.
+	 * cred_guard_mutex keeps an execve from switching to a new mm
+	 * between the check and taking a reference on the mm.
+	 */
+	if (mutex_lock_killable(&task->cred_guard_mutex)) {
+		rc = -EINTR;
+		goto put_task_struct;
+	}
+	task_lock(task);
+	if (__ptrace_may_access(task, PTRACE_MODE_ATTACH)) {
+		task_unlock(task);
+		mutex_unlock(&task->cred_guard_mutex);
+		rc = -EPERM;
+		goto put_task_struct;
+	}
+	mm = task->mm;
+	if (!mm || (task->flags & PF_KTHREAD)) {
+		task_unlock(task);
+		mutex_unlock(&task->cred_guard_mutex);
+		rc = -EINVAL;
+		goto put_task_struct;
+	}
+	atomic_inc(&mm->mm_users);
+	task_unlock(task);
+	mutex_unlock(&task->cred_guard_mutex);
+
+	for (seg = 0; seg < riovcnt && local.seg < liovcnt; seg++) {
+		rc = process_vm_rw_single_vec(
+				(unsigned long)rvec[seg].iov_base,
+				rvec[seg].iov_len, &local, process_pages,
+				max_pages, mm, task, vm_write);
+		if (rc < 0)
+			break;
+		copied += rc;
+		if (rc < rvec[seg].iov_len)
+			break;
+	}
+	if (copied)
+		rc = copied;
+
+	mmput(mm);
+put_task_struct:
+	put_task_struct(task);
+free_proc_pages:
+	if (process_pages != pp_stack)
+		kfree(process_pages);
+	return rc;
+}
+
+static ssize_t process_vm_rw(pid_t pid,
+			     const struct iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t rc;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	/* Local buffers are written by a read, and read by a write */
+	rc = rw_copy_check_uvector(vm_write ? WRITE : READ, lvec, liovcnt,
+				   UIO_FASTIOV, iovstack_l, &iov_l, 1);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	/* Remote buffers are checked by get_user_pages() on their mm */
+	rc = rw_copy_check_uvector(READ, rvec, riovcnt, UIO_FASTIOV,
+				   iovstack_r, &iov_r, 0);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt,
+				vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+	return rc;
+}
+
+SYSCALL_DEFINE6(process_vm_readv, pid_t, pid, const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 0);
+}
+
+SYSCALL_DEFINE6(process_vm_writev, pid_t, pid,
+		const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 1);
+}
+
+#ifdef CONFIG_COMPAT
+
+static ssize_t
+compat_process_vm_rw(compat_pid_t pid,
+		     const struct compat_iovec __user *lvec,
+		     unsigned long liovcnt,
+		     const struct compat_iovec __user *rvec,
+		     unsigned long riovcnt,
+		     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t rc = -EFAULT;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	if (!access_ok(VERIFY_READ, lvec, liovcnt * sizeof(*lvec)))
+		goto out;
+	if (!access_ok(VERIFY_READ, rvec, riovcnt * sizeof(*rvec)))
+		goto out;
+
+	rc = compat_rw_copy_check_uvector(vm_write ? WRITE : READ, lvec,
+					  liovcnt, UIO_FASTIOV, iovstack_l,
+					  &iov_l, 1);
+	if (rc <= 0)
+		goto free_iovecs;
+	rc = compat_rw_copy_check_uvector(READ, rvec, riovcnt, UIO_FASTIOV,
+					  iovstack_r, &iov_r, 0);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt,
+				vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+out:
+	return rc;
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_readv(compat_pid_t pid,
+			    const struct compat_iovec __user *lvec,
+			    unsigned long liovcnt,
+			    const struct compat_iovec __user *rvec,
+			    unsigned long riovcnt,
+			    unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 0);
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_writev(compat_pid_t pid,
+			     const struct compat_iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct compat_iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 1);
+}
+
+#endif
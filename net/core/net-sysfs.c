@@ -743,10 +743,6 @@ static int rx_queue_register_kobjects(struct net_device *net)
 	int i;
 	int error = 0;
 
-	net->queues_kset = kset_create_and_add("queues",
-	    NULL, &net->dev.kobj);
-	if (!net->queues_kset)
-		return -ENOMEM;
 	for (i = 0; i < net->num_rx_queues; i++) {
 		error = rx_queue_add_kobject(net, i);
 		if (error)
@@ -766,10 +762,368 @@ static void rx_queue_remove_kobjects(struct net_device *net)
 
 	for (i = 0; i < net->num_rx_queues; i++)
 		kobject_put(&net->_rx[i].kobj);
-	kset_unregister(net->queues_kset);
 }
 #endif /* CONFIG_RPS */
 
+#ifdef CONFIG_XPS
+/*
+ * TX queue sysfs structures and functions.
+ */
+struct netdev_queue_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct netdev_queue *queue,
+	    struct netdev_queue_attribute *attr, char *buf);
+	ssize_t (*store)(struct netdev_queue *queue,
+	    struct netdev_queue_attribute *attr, const char *buf, size_t len);
+};
+#define to_netdev_queue_attr(_attr) container_of(_attr,		\
+    struct netdev_queue_attribute, attr)
+
+#define to_netdev_queue(obj) container_of(obj, struct netdev_queue, kobj)
+
+static ssize_t netdev_queue_attr_show(struct kobject *kobj,
+				      struct attribute *attr, char *buf)
+{
+	struct netdev_queue_attribute *attribute = to_netdev_queue_attr(attr);
+	struct netdev_queue *queue = to_netdev_queue(kobj);
+
+	if (!attribute->show)
+		return -EIO;
+
+	return attribute->show(queue, attribute, buf);
+}
+
+static ssize_t netdev_queue_attr_store(struct kobject *kobj,
+				       struct attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct netdev_queue_attribute *attribute = to_netdev_queue_attr(attr);
+	struct netdev_queue *queue = to_netdev_queue(kobj);
+
+	if (!attribute->store)
+		return -EIO;
+
+	return attribute->store(queue, attribute, buf, count);
+}
+
+static struct sysfs_ops netdev_queue_sysfs_ops = {
+	.show = netdev_queue_attr_show,
+	.store = netdev_queue_attr_store,
+};
+
+static inline unsigned int get_netdev_queue_index(struct netdev_queue *queue)
+{
+	return queue - queue->dev->_tx;
+}
+
+/* Serializes updates of dev->xps_maps for all devices */
+static DEFINE_MUTEX(xps_map_mutex);
+#define xmap_dereference(P)		\
+	rcu_dereference_protected((P), lockdep_is_held(&xps_map_mutex))
+
+static ssize_t show_xps_map(struct netdev_queue *queue,
+			    struct netdev_queue_attribute *attribute, char *buf)
+{
+	struct net_device *dev = queue->dev;
+	struct xps_dev_maps *dev_maps;
+	struct xps_map *map;
+	unsigned int index;
+	cpumask_var_t mask;
+	size_t len = 0;
+	int cpu, i;
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	index = get_netdev_queue_index(queue);
+
+	rcu_read_lock();
+	dev_maps = rcu_dereference(dev->xps_maps);
+	if (dev_maps) {
+		for_each_possible_cpu(cpu) {
+			map = rcu_dereference(dev_maps->cpu_map[cpu]);
+			if (!map)
+				continue;
+			for (i = 0; i < map->len; i++) {
+				if (map->queues[i] == index) {
+					cpumask_set_cpu(cpu, mask);
+					break;
+				}
+			}
+		}
+	}
+	rcu_read_unlock();
+
+	len += cpumask_scnprintf(buf + len, PAGE_SIZE, mask);
+	if (PAGE_SIZE - len < 3) {
+		free_cpumask_var(mask);
+		return -EINVAL;
+	}
+
+	free_cpumask_var(mask);
+	len += sprintf(buf + len, "\n");
+	return len;
+}
+
+static void xps_map_release(struct rcu_head *rcu)
+{
+	struct xps_map *map = container_of(rcu, struct xps_map, rcu);
+
+	kfree(map);
+}
+
+static void xps_dev_maps_release(struct rcu_head *rcu)
+{
+	struct xps_dev_maps *dev_maps =
+	    container_of(rcu, struct xps_dev_maps, rcu);
+
+	kfree(dev_maps);
+}
+
+/*
+ * Maps are never modified once published: every CPU whose queue set
+ * changes gets a freshly allocated map, and a new xps_dev_maps array is
+ * swapped in under RCU.  Readers in dev_pick_tx() thus always see a
+ * consistent queue list for their CPU.
+ */
+static ssize_t store_xps_map(struct netdev_queue *queue,
+		      struct netdev_queue_attribute *attribute,
+		      const char *buf, size_t len)
+{
+	struct net_device *dev = queue->dev;
+	struct xps_dev_maps *dev_maps, *new_dev_maps;
+	struct xps_map *map, *new_map;
+	unsigned int index;
+	cpumask_var_t mask;
+	int err, cpu, pos, i;
+	int need_set, nonempty = 0;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	index = get_netdev_queue_index(queue);
+
+	err = bitmap_parse(buf, len, cpumask_bits(mask), nr_cpumask_bits);
+	if (err) {
+		free_cpumask_var(mask);
+		return err;
+	}
+
+	new_dev_maps = kzalloc(max_t(unsigned,
+	    XPS_DEV_MAPS_SIZE, L1_CACHE_BYTES), GFP_KERNEL);
+	if (!new_dev_maps) {
+		free_cpumask_var(mask);
+		return -ENOMEM;
+	}
+
+	mutex_lock(&xps_map_mutex);
+
+	dev_maps = xmap_dereference(dev->xps_maps);
+
+	for_each_possible_cpu(cpu) {
+		map = dev_maps ?
+		    xmap_dereference(dev_maps->cpu_map[cpu]) : NULL;
+		new_map = map;
+
+		pos = 0;
+		if (map)
+			while (pos < map->len && map->queues[pos] != index)
+				pos++;
+
+		need_set = cpumask_test_cpu(cpu, mask) && cpu_online(cpu);
+
+		if (need_set && (!map || pos == map->len)) {
+			/* Add queue to this CPU's map */
+			i = map ? map->len : 0;
+			new_map = kzalloc_node(max_t(unsigned,
+			    XPS_MAP_SIZE(i + 1), L1_CACHE_BYTES),
+			    GFP_KERNEL, cpu_to_node(cpu));
+			if (!new_map)
+				goto error;
+			if (map)
+				memcpy(new_map->queues, map->queues,
+				    i * sizeof(u16));
+			new_map->queues[i] = index;
+			new_map->len = i + 1;
+		} else if (!need_set && map && pos < map->len) {
+			/* Remove queue from this CPU's map */
+			if (map->len > 1) {
+				new_map = kzalloc_node(max_t(unsigned,
+				    XPS_MAP_SIZE(map->len - 1),
+				    L1_CACHE_BYTES),
+				    GFP_KERNEL, cpu_to_node(cpu));
+				if (!new_map)
+					goto error;
+				for (i = 0; i < map->len; i++)
+					if (i != pos)
+						new_map->queues[new_map->len++] =
+						    map->queues[i];
+			} else
+				new_map = NULL;
+		}
+
+		new_dev_maps->cpu_map[cpu] = new_map;
+		if (new_map)
+			nonempty = 1;
+	}
+
+	/* Release the maps that were replaced */
+	if (dev_maps) {
+		for_each_possible_cpu(cpu) {
+			map = xmap_dereference(dev_maps->cpu_map[cpu]);
+			if (map && map != new_dev_maps->cpu_map[cpu])
+				call_rcu(&map->rcu, xps_map_release);
+		}
+	}
+
+	if (nonempty)
+		rcu_assign_pointer(dev->xps_maps, new_dev_maps);
+	else {
+		kfree(new_dev_maps);
+		rcu_assign_pointer(dev->xps_maps, NULL);
+	}
+
+	if (dev_maps)
+		call_rcu(&dev_maps->rcu, xps_dev_maps_release);
+
+	mutex_unlock(&xps_map_mutex);
+
+	free_cpumask_var(mask);
+	return len;
+
+error:
+	/* Only free what we allocated; shared maps still belong to dev_maps */
+	for_each_possible_cpu(cpu) {
+		map = dev_maps ?
+		    xmap_dereference(dev_maps->cpu_map[cpu]) : NULL;
+		if (new_dev_maps->cpu_map[cpu] != map)
+			kfree(new_dev_maps->cpu_map[cpu]);
+	}
+	mutex_unlock(&xps_map_mutex);
+
+	kfree(new_dev_maps);
+	free_cpumask_var(mask);
+	return -ENOMEM;
+}
+
+static struct netdev_queue_attribute xps_cpus_attribute =
+	__ATTR(xps_cpus, S_IRUGO | S_IWUSR, show_xps_map, store_xps_map);
+
+static struct attribute *netdev_queue_default_attrs[] = {
+	&xps_cpus_attribute.attr,
+	NULL
+};
+
+static void netdev_queue_release(struct kobject *kobj)
+{
+	struct netdev_queue *queue = to_netdev_queue(kobj);
+
+	dev_put(queue->dev);
+}
+
+static struct kobj_type netdev_queue_ktype = {
+	.sysfs_ops = &netdev_queue_sysfs_ops,
+	.release = netdev_queue_release,
+	.default_attrs = netdev_queue_default_attrs,
+};
+
+static int netdev_queue_add_kobject(struct net_device *net, int index)
+{
+	struct netdev_queue *queue = net->_tx + index;
+	struct kobject *kobj = &queue->kobj;
+	int error = 0;
+
+	kobj->kset = net->queues_kset;
+	error = kobject_init_and_add(kobj, &netdev_queue_ktype, NULL,
+	    "tx-%u", index);
+	if (error) {
+		kobject_put(kobj);
+		return error;
+	}
+
+	kobject_uevent(kobj, KOBJ_ADD);
+	dev_hold(queue->dev);
+
+	return error;
+}
+
+static int netdev_queue_register_kobjects(struct net_device *net)
+{
+	int i;
+	int error = 0;
+
+	for (i = 0; i < net->num_tx_queues; i++) {
+		error = netdev_queue_add_kobject(net, i);
+		if (error)
+			break;
+	}
+
+	if (error)
+		while (--i >= 0)
+			kobject_put(&net->_tx[i].kobj);
+
+	return error;
+}
+
+static void netdev_queue_remove_kobjects(struct net_device *net)
+{
+	int i;
+
+	for (i = 0; i < net->num_tx_queues; i++)
+		kobject_put(&net->_tx[i].kobj);
+}
+#endif /* CONFIG_XPS */
+
+#if defined(CONFIG_RPS) || defined(CONFIG_XPS)
+static int register_queue_kobjects(struct net_device *net)
+{
+	int error = 0;
+
+	net->queues_kset = kset_create_and_add("queues",
+	    NULL, &net->dev.kobj);
+	if (!net->queues_kset)
+		return -ENOMEM;
+
+#ifdef CONFIG_RPS
+	error = rx_queue_register_kobjects(net);
+	if (error)
+		goto err_kset;
+#endif
+
+#ifdef CONFIG_XPS
+	error = netdev_queue_register_kobjects(net);
+	if (error)
+		goto err_rx;
+#endif
+
+	return 0;
+
+#ifdef CONFIG_XPS
+err_rx:
+#endif
+#ifdef CONFIG_RPS
+	rx_queue_remove_kobjects(net);
+err_kset:
+#endif
+	kset_unregister(net->queues_kset);
+	return error;
+}
+
+static void remove_queue_kobjects(struct net_device *net)
+{
+#ifdef CONFIG_RPS
+	rx_queue_remove_kobjects(net);
+#endif
+#ifdef CONFIG_XPS
+	netdev_queue_remove_kobjects(net);
+#endif
+	kset_unregister(net->queues_kset);
+}
+#endif /* CONFIG_RPS || CONFIG_XPS */
+
 static const void *net_current_ns(void)
 {
 	return current->nsproxy->net_ns;
@@ -866,8 +1220,8 @@ void netdev_unregister_kobject(struct net_device * net)
 
 	kobject_get(&dev->kobj);
 
-#ifdef CONFIG_RPS
-	rx_queue_remove_kobjects(net);
+#if defined(CONFIG_RPS) || defined(CONFIG_XPS)
+	remove_queue_kobjects(net);
 #endif
 
 	device_del(dev);
@@ -907,8 +1261,8 @@ int netdev_register_kobject(struct net_device *net)
 	if (error)
 		return error;
 
-#ifdef CONFIG_RPS
-	error = rx_queue_register_kobjects(net);
+#if defined(CONFIG_RPS) || defined(CONFIG_XPS)
+	error = register_queue_kobjects(net);
 	if (error) {
 		device_del(dev);
 		return error;
@@ -269,6 +269,58 @@ out_no_rpciod:
 	return ERR_PTR(err);
 }
 
+/*
+ * Open the extra transports of a client that was asked for more than one
+ * connection to the server.  They share the address and settings of the
+ * client's first transport, which stays cl_xprt and is the one reported by
+ * rpc_peeraddr() and used for the NFSv4.1 backchannel.
+ */
+static int rpc_clnt_add_xprts(struct rpc_clnt *clnt,
+			      struct xprt_create *xprtargs,
+			      unsigned int nconnect)
+{
+	struct rpc_xprt **xprts;
+	struct rpc_xprt *xprt;
+	unsigned int i;
+	int err;
+
+	xprts = kcalloc(nconnect, sizeof(*xprts), GFP_KERNEL);
+	if (xprts == NULL)
+		return -ENOMEM;
+
+	xprts[0] = clnt->cl_xprt;
+	for (i = 1; i < nconnect; i++) {
+		xprt = xprt_create_transport(xprtargs);
+		if (IS_ERR(xprt)) {
+			err = PTR_ERR(xprt);
+			goto out_put;
+		}
+		xprt->resvport = clnt->cl_xprt->resvport;
+		xprts[i] = xprt;
+	}
+
+	clnt->cl_xprts = xprts;
+	clnt->cl_nconnect = nconnect;
+	return 0;
+
+out_put:
+	while (--i > 0)
+		xprt_put(xprts[i]);
+	kfree(xprts);
+	return err;
+}
+
+static void rpc_clnt_put_xprts(struct rpc_clnt *clnt)
+{
+	unsigned int i;
+
+	for (i = 1; i < clnt->cl_nconnect; i++)
+		xprt_put(clnt->cl_xprts[i]);
+	kfree(clnt->cl_xprts);
+	clnt->cl_xprts = NULL;
+	clnt->cl_nconnect = 0;
+}
+
 /*
  * rpc_create - create an RPC client and transport with one call
  * @args: rpc_clnt create argument structure
@@ -278,6 +330,9 @@ out_no_rpciod:
  * It can ping the server in order to determine if it is up, and to see if
  * it supports this program and version.  RPC_CLNT_CREATE_NOPING disables
  * this behavior so asynchronous tasks can also use rpc_create.
+ *
+ * If args->nconnect is more than one, that many transports are opened to
+ * the server and the client's tasks are spread over them in turn.
  */
 struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 {
@@ -339,6 +394,16 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (IS_ERR(clnt))
 		return clnt;
 
+	if (args->nconnect > 1 && args->bc_xprt == NULL) {
+		int err = rpc_clnt_add_xprts(clnt, &xprtargs,
+				min_t(unsigned int, args->nconnect,
+				      RPC_MAX_CONNECTIONS));
+		if (err != 0) {
+			rpc_shutdown_client(clnt);
+			return ERR_PTR(err);
+		}
+	}
+
 	if (!(args->flags & RPC_CLNT_CREATE_NOPING)) {
 		int err = rpc_ping(clnt);
 		if (err != 0) {
@@ -365,7 +430,8 @@ EXPORT_SYMBOL_GPL(rpc_create);
 /*
  * This function clones the RPC client structure. It allows us to share the
  * same transport while varying parameters such as the authentication
- * flavour.
+ * flavour.  Any extra transports stay owned by the parent, which the
+ * clone holds a reference to.
  */
 struct rpc_clnt *
 rpc_clone_client(struct rpc_clnt *clnt)
@@ -452,6 +518,7 @@ rpc_free_client(struct kref *kref)
 	}
 	if (clnt->cl_server != clnt->cl_inline_name)
 		kfree(clnt->cl_server);
+	rpc_clnt_put_xprts(clnt);
 out_free:
 	rpc_unregister_client(clnt);
 	rpc_free_iostats(clnt->cl_metrics);
@@ -717,13 +784,22 @@ const char *rpc_peeraddr2str(struct rpc_clnt *clnt,
 }
 EXPORT_SYMBOL_GPL(rpc_peeraddr2str);
 
-void
-rpc_setbufsize(struct rpc_clnt *clnt, unsigned int sndsize, unsigned int rcvsize)
+static void
+rpc_xprt_setbufsize(struct rpc_xprt *xprt, unsigned int sndsize, unsigned int rcvsize)
 {
-	struct rpc_xprt *xprt = clnt->cl_xprt;
 	if (xprt->ops->set_buffer_size)
 		xprt->ops->set_buffer_size(xprt, sndsize, rcvsize);
 }
+
+void
+rpc_setbufsize(struct rpc_clnt *clnt, unsigned int sndsize, unsigned int rcvsize)
+{
+	unsigned int i;
+
+	rpc_xprt_setbufsize(clnt->cl_xprt, sndsize, rcvsize);
+	for (i = 1; i < clnt->cl_nconnect; i++)
+		rpc_xprt_setbufsize(clnt->cl_xprts[i], sndsize, rcvsize);
+}
 EXPORT_SYMBOL_GPL(rpc_setbufsize);
 
 /*
@@ -747,8 +823,13 @@ EXPORT_SYMBOL_GPL(rpc_max_payload);
  */
 void rpc_force_rebind(struct rpc_clnt *clnt)
 {
-	if (clnt->cl_autobind)
-		xprt_clear_bound(clnt->cl_xprt);
+	unsigned int i;
+
+	if (!clnt->cl_autobind)
+		return;
+	xprt_clear_bound(clnt->cl_xprt);
+	for (i = 1; i < clnt->cl_nconnect; i++)
+		xprt_clear_bound(clnt->cl_xprts[i]);
 }
 EXPORT_SYMBOL_GPL(rpc_force_rebind);
 
@@ -811,6 +811,7 @@ static void rpc_init_task(struct rpc_task *task, const struct rpc_task_setup *ta
 	task->tk_client = task_setup_data->rpc_client;
 	if (task->tk_client != NULL) {
 		kref_get(&task->tk_client->cl_kref);
+		task->tk_xprt = rpc_clnt_pick_xprt(task->tk_client);
 		if (task->tk_client->cl_softrtry)
 			task->tk_flags |= RPC_TASK_SOFT;
 	}
@@ -900,6 +901,7 @@ void rpc_put_task(struct rpc_task *task)
 	if (task->tk_client) {
 		rpc_release_client(task->tk_client);
 		task->tk_client = NULL;
+		task->tk_xprt = NULL;
 	}
 	if (task->tk_workqueue != NULL) {
 		INIT_WORK(&task->u.tk_work, rpc_async_release);
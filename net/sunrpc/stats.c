@@ -184,6 +184,7 @@ void rpc_print_iostats(struct seq_file *seq, struct rpc_clnt *clnt)
 	struct rpc_iostats *stats = clnt->cl_metrics;
 	struct rpc_xprt *xprt = clnt->cl_xprt;
 	unsigned int op, maxproc = clnt->cl_maxproc;
+	unsigned int i;
 
 	if (!stats)
 		return;
@@ -194,6 +195,11 @@ void rpc_print_iostats(struct seq_file *seq, struct rpc_clnt *clnt)
 
 	if (xprt)
 		xprt->ops->print_stats(xprt, seq);
+	/* one line for each extra connection */
+	for (i = 1; i < clnt->cl_nconnect; i++) {
+		xprt = clnt->cl_xprts[i];
+		xprt->ops->print_stats(xprt, seq);
+	}
 
 	seq_printf(seq, "\tper-op statistics\n");
 	for (op = 0; op < maxproc; op++) {
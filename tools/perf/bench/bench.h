@@ -4,6 +4,20 @@
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_randaccess(int argc, const char **argv, const char *prefix);
+extern int bench_mem_xfer(int argc, const char **argv, const char *prefix);
+extern int bench_mem_swapstress(int argc, const char **argv, const char *prefix);
+extern int bench_net_sendmmsg(int argc, const char **argv, const char *prefix);
+extern int bench_fs_stat(int argc, const char **argv, const char *prefix);
+extern int bench_fs_create(int argc, const char **argv, const char *prefix);
+extern int bench_fs_randread(int argc, const char **argv, const char *prefix);
+extern int bench_fs_seqwrite(int argc, const char **argv, const char *prefix);
+extern int bench_fs_lsdir(int argc, const char **argv, const char *prefix);
+extern int bench_fs_fsync(int argc, const char **argv, const char *prefix);
+
+/* fuse-memfs.c: FUSE filesystem for the fs suites */
+extern void fuse_memfs_mount(const char *dir, bool writeback_cache);
+extern void fuse_memfs_umount(const char *dir);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
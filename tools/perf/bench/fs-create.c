@@ -0,0 +1,187 @@
+/*
+ *
+ * fs-create.c
+ *
+ * create: Benchmark for parallel inode creation and deletion
+ *
+ * A number of processes each create a batch of empty files in a
+ * directory of their own and unlink them again, over and over.  Every
+ * file costs an inode allocation, hashing, a trip onto the superblock
+ * and writeback lists and a final iput(), so this is mostly a test of
+ * inode cache scalability.  Point it at tmpfs to leave the disk out of
+ * it.  Reports the aggregate number of create+unlink pairs per second.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define LOOPS_DEFAULT		10000
+#define FILES_DEFAULT		16
+
+static int loops = LOOPS_DEFAULT;
+static int nr_procs;
+static int nr_files = FILES_DEFAULT;
+static const char *base_dir = ".";
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of create/unlink rounds per process"),
+	OPT_INTEGER('p', "procs", &nr_procs,
+		    "Specify number of processes (default: online CPUs)"),
+	OPT_INTEGER('n', "nr-files", &nr_files,
+		    "Specify number of files created per round"),
+	OPT_STRING('d', "dir", &base_dir, "path",
+		   "Create the scratch directories below this directory"),
+	OPT_END()
+};
+
+static const char * const bench_fs_create_usage[] = {
+	"perf bench fs create <options>",
+	NULL
+};
+
+static void worker(int nr, int ready, int go)
+{
+	char dir[PATH_MAX], path[PATH_MAX + 16];
+	char c = 0;
+	int i, j, fd, ret;
+
+	snprintf(dir, sizeof(dir), "%s/perf-bench-create.%d.%d",
+		 base_dir, getppid(), nr);
+	if (mkdir(dir, 0755) < 0)
+		die("mkdir(%s) failed: %s\n", dir, strerror(errno));
+
+	ret = write(ready, &c, 1);
+	ret = read(go, &c, 1);
+	(void)ret;
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < nr_files; j++) {
+			snprintf(path, sizeof(path), "%s/%d", dir, j);
+			fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+			if (fd < 0)
+				die("creat(%s) failed: %s\n",
+				    path, strerror(errno));
+			close(fd);
+		}
+		for (j = 0; j < nr_files; j++) {
+			snprintf(path, sizeof(path), "%s/%d", dir, j);
+			if (unlink(path) < 0)
+				die("unlink(%s) failed: %s\n",
+				    path, strerror(errno));
+		}
+	}
+
+	rmdir(dir);
+	exit(0);
+}
+
+int bench_fs_create(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total;
+	int ready[2], go[2];
+	int i, wait_stat;
+	char c = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_create_usage, 0);
+
+	if (loops <= 0)
+		die("number of loops must be positive\n");
+	if (nr_files <= 0)
+		die("number of files must be positive\n");
+	if (strlen(base_dir) >= PATH_MAX - 64)
+		die("path too long\n");
+	if (nr_procs <= 0)
+		nr_procs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_procs <= 0)
+		nr_procs = 1;
+
+	if (pipe(ready) < 0 || pipe(go) < 0)
+		die("pipe() failed: %s\n", strerror(errno));
+
+	for (i = 0; i < nr_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			die("fork() failed: %s\n", strerror(errno));
+		if (!pid)
+			worker(i, ready[1], go[0]);
+	}
+
+	/* wait for everybody to be ready, then release them at once */
+	for (i = 0; i < nr_procs; i++) {
+		if (read(ready[0], &c, 1) != 1)
+			die("worker failed to start\n");
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_procs; i++) {
+		if (write(go[1], &c, 1) != 1)
+			die("write() failed: %s\n", strerror(errno));
+	}
+	for (i = 0; i < nr_procs; i++) {
+		if (wait(&wait_stat) < 0)
+			die("wait() failed: %s\n", strerror(errno));
+		if (!WIFEXITED(wait_stat) || WEXITSTATUS(wait_stat))
+			die("worker failed\n");
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+	total = (unsigned long long)loops * nr_files * nr_procs;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d processes creating and unlinking %d files"
+		       " %d times each in %s\n\n",
+		       nr_procs, nr_files, loops, base_dir);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec * nr_procs / (double)total);
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)total /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ *
+ * fs-fsync.c
+ *
+ * fsync: Benchmark for the latency of fsync() after a small append
+ *
+ * A scratch file is extended by a small write() and fsync()ed, over
+ * and over, which is what logs and databases do to make each record
+ * durable.  On ext4 mounted with and without -o fast_commit this shows
+ * what a fast commit saves over committing the whole transaction.
+ * Reports the average, minimum and maximum fsync() latency.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define WRITE_SIZE_DEFAULT	4096
+#define LOOPS_DEFAULT		1000
+
+static int write_size = WRITE_SIZE_DEFAULT;
+static int loops = LOOPS_DEFAULT;
+static const char *base_dir = ".";
+static bool datasync;
+
+static const struct option options[] = {
+	OPT_INTEGER('s', "size", &write_size,
+		    "Specify size of each write() in bytes"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of write() and fsync() pairs (default: 1000)"),
+	OPT_STRING('d', "dir", &base_dir, "path",
+		   "Create the scratch file in this directory"),
+	OPT_BOOLEAN('D', "datasync", &datasync,
+		    "Use fdatasync() instead of fsync()"),
+	OPT_END()
+};
+
+static const char * const bench_fs_fsync_usage[] = {
+	"perf bench fs fsync <options>",
+	NULL
+};
+
+int bench_fs_fsync(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long usec, total_usec = 0;
+	unsigned long long min_usec = ~0ULL, max_usec = 0;
+	char path[PATH_MAX];
+	char *buf;
+	int fd, i, ret;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_fsync_usage, 0);
+
+	if (write_size <= 0)
+		die("write size must be positive\n");
+	if (loops <= 0)
+		die("number of loops must be positive\n");
+	if (strlen(base_dir) >= PATH_MAX - 64)
+		die("path too long\n");
+
+	buf = malloc(write_size);
+	if (!buf)
+		die("malloc() failed\n");
+	memset(buf, 0x5a, write_size);
+
+	snprintf(path, sizeof(path), "%s/perf-bench-fsync.%d",
+		 base_dir, getpid());
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0)
+		die("creat(%s) failed: %s\n", path, strerror(errno));
+	/* the creation itself is not what is measured */
+	if (fsync(fd) < 0)
+		die("fsync(%s) failed: %s\n", path, strerror(errno));
+
+	for (i = 0; i < loops; i++) {
+		if (write(fd, buf, write_size) != write_size)
+			die("write(%s) failed: %s\n", path, strerror(errno));
+
+		gettimeofday(&start, NULL);
+		ret = datasync ? fdatasync(fd) : fsync(fd);
+		gettimeofday(&stop, NULL);
+		if (ret < 0)
+			die("fsync(%s) failed: %s\n", path, strerror(errno));
+
+		timersub(&stop, &start, &diff);
+		usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+		total_usec += usec;
+		if (usec < min_usec)
+			min_usec = usec;
+		if (usec > max_usec)
+			max_usec = usec;
+	}
+
+	close(fd);
+	unlink(path);
+	free(buf);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d appends of %d bytes to a file in %s, each followed"
+		       " by %s()\n\n", loops, write_size, base_dir,
+		       datasync ? "fdatasync" : "fsync");
+
+		printf(" %14s: %llu.%03llu [sec]\n\n", "Total fsync time",
+		       total_usec / 1000000,
+		       (total_usec % 1000000) / 1000);
+
+		printf(" %14lf usecs/op\n", (double)total_usec / loops);
+		printf(" %14llu usecs min\n", min_usec);
+		printf(" %14llu usecs max\n", max_usec);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", (double)total_usec / loops);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ *
+ * fs-lsdir.c
+ *
+ * lsdir: Benchmark for listing a large directory with attributes
+ *
+ * A scratch directory is filled with empty files, and then read with
+ * readdir() and lstat() of every entry, like "ls -l" does.  On network
+ * and userspace filesystems this costs a lookup per entry on top of
+ * reading the directory, unless the listing returns the attributes
+ * along with the names.  Reports entries per second.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define LOOPS_DEFAULT		10
+#define FILES_DEFAULT		10000
+
+static int loops = LOOPS_DEFAULT;
+static int nr_files = FILES_DEFAULT;
+static const char *base_dir = ".";
+static bool no_stat;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of times the directory is listed"),
+	OPT_INTEGER('n', "nr-files", &nr_files,
+		    "Specify number of files in the directory"),
+	OPT_STRING('d', "dir", &base_dir, "path",
+		   "Create the scratch directory below this directory"),
+	OPT_BOOLEAN('N', "no-stat", &no_stat,
+		    "Only read the names, like plain ls"),
+	OPT_END()
+};
+
+static const char * const bench_fs_lsdir_usage[] = {
+	"perf bench fs lsdir <options>",
+	NULL
+};
+
+static unsigned long list_dir(const char *dir)
+{
+	char path[PATH_MAX + NAME_MAX + 2];
+	unsigned long nr = 0;
+	struct dirent *de;
+	struct stat st;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		die("opendir(%s) failed: %s\n", dir, strerror(errno));
+
+	while ((de = readdir(d)) != NULL) {
+		nr++;
+		if (no_stat)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		if (lstat(path, &st) < 0)
+			die("lstat(%s) failed: %s\n", path, strerror(errno));
+	}
+
+	closedir(d);
+	return nr;
+}
+
+int bench_fs_lsdir(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total = 0;
+	char dir[PATH_MAX], path[PATH_MAX + 16];
+	int i, fd;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_lsdir_usage, 0);
+
+	if (loops <= 0)
+		die("number of loops must be positive\n");
+	if (nr_files <= 0)
+		die("number of files must be positive\n");
+	if (strlen(base_dir) >= PATH_MAX - 64)
+		die("path too long\n");
+
+	snprintf(dir, sizeof(dir), "%s/perf-bench-lsdir.%d",
+		 base_dir, getpid());
+	if (mkdir(dir, 0755) < 0)
+		die("mkdir(%s) failed: %s\n", dir, strerror(errno));
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/%d", dir, i);
+		fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+		if (fd < 0)
+			die("creat(%s) failed: %s\n", path, strerror(errno));
+		close(fd);
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < loops; i++)
+		total += list_dir(dir);
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/%d", dir, i);
+		unlink(path);
+	}
+	rmdir(dir);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+	if (!result_usec)
+		result_usec = 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d listings of %d files in %s%s\n\n",
+		       loops, nr_files, base_dir,
+		       no_stat ? ", names only" : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/entry\n",
+		       (double)result_usec / (double)total);
+		printf(" %14llu entries/sec\n",
+		       (unsigned long long)((double)total /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
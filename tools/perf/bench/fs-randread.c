@@ -0,0 +1,220 @@
+/*
+ *
+ * fs-randread.c
+ *
+ * randread: Benchmark for logical to physical block lookups
+ *
+ * A scratch file is written with data in every other block, so that
+ * each data block ends up in an extent of its own, and is then read back
+ * at random block offsets with O_DIRECT.  Direct I/O skips the page
+ * cache, so every read has to map its block through the filesystem,
+ * which makes this mostly a test of the block mapping code once the
+ * file sits in the disk cache.  Reports reads per second.
+ *
+ */
+
+#define _GNU_SOURCE		/* for O_DIRECT */
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#undef _GNU_SOURCE
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#define LOOPS_DEFAULT		100000
+#define BLOCKS_DEFAULT		65536
+#define BLOCK_SIZE		4096
+
+static int loops = LOOPS_DEFAULT;
+static int nr_procs = 1;
+static int nr_blocks = BLOCKS_DEFAULT;
+static const char *base_dir = ".";
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of reads per process"),
+	OPT_INTEGER('p', "procs", &nr_procs,
+		    "Specify number of processes"),
+	OPT_INTEGER('b', "blocks", &nr_blocks,
+		    "Specify number of data blocks in the scratch file"),
+	OPT_STRING('d', "dir", &base_dir, "path",
+		   "Create the scratch file in this directory"),
+	OPT_END()
+};
+
+static const char * const bench_fs_randread_usage[] = {
+	"perf bench fs randread <options>",
+	NULL
+};
+
+static void *alloc_block(void)
+{
+	void *buf;
+
+	if (posix_memalign(&buf, BLOCK_SIZE, BLOCK_SIZE))
+		die("posix_memalign() failed\n");
+	memset(buf, 0x5a, BLOCK_SIZE);
+	return buf;
+}
+
+static void prepare_file(const char *path)
+{
+	void *buf = alloc_block();
+	int i, fd;
+
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0)
+		die("creat(%s) failed: %s\n", path, strerror(errno));
+
+	/* leave a hole after every block to keep extents from merging */
+	for (i = 0; i < nr_blocks; i++) {
+		if (pwrite(fd, buf, BLOCK_SIZE,
+			   (off_t)i * 2 * BLOCK_SIZE) != BLOCK_SIZE)
+			die("write(%s) failed: %s\n", path, strerror(errno));
+	}
+	if (fsync(fd) < 0)
+		die("fsync(%s) failed: %s\n", path, strerror(errno));
+
+	close(fd);
+	free(buf);
+}
+
+static void worker(const char *path, int nr, int ready, int go)
+{
+	unsigned int seed = getpid() * 2654435761U + nr;
+	void *buf = alloc_block();
+	char c = 0;
+	int i, fd, ret;
+
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		die("open(%s, O_DIRECT) failed: %s\n", path, strerror(errno));
+
+	ret = write(ready, &c, 1);
+	ret = read(go, &c, 1);
+	(void)ret;
+
+	for (i = 0; i < loops; i++) {
+		off_t block;
+
+		seed = seed * 1103515245 + 12345;
+		block = (seed >> 8) % nr_blocks;
+		if (pread(fd, buf, BLOCK_SIZE,
+			  block * 2 * BLOCK_SIZE) != BLOCK_SIZE)
+			die("read(%s) failed: %s\n", path, strerror(errno));
+	}
+
+	close(fd);
+	exit(0);
+}
+
+int bench_fs_randread(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total;
+	char path[PATH_MAX];
+	int ready[2], go[2];
+	int i, wait_stat;
+	char c = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_randread_usage, 0);
+
+	if (loops <= 0)
+		die("number of loops must be positive\n");
+	if (nr_procs <= 0)
+		die("number of processes must be positive\n");
+	if (nr_blocks <= 0)
+		die("number of blocks must be positive\n");
+	if (strlen(base_dir) >= PATH_MAX - 64)
+		die("path too long\n");
+
+	snprintf(path, sizeof(path), "%s/perf-bench-randread.%d",
+		 base_dir, getpid());
+	prepare_file(path);
+
+	if (pipe(ready) < 0 || pipe(go) < 0)
+		die("pipe() failed: %s\n", strerror(errno));
+
+	for (i = 0; i < nr_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			die("fork() failed: %s\n", strerror(errno));
+		if (!pid)
+			worker(path, i, ready[1], go[0]);
+	}
+
+	/* wait for everybody to be ready, then release them at once */
+	for (i = 0; i < nr_procs; i++) {
+		if (read(ready[0], &c, 1) != 1)
+			die("worker failed to start\n");
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_procs; i++) {
+		if (write(go[1], &c, 1) != 1)
+			die("write() failed: %s\n", strerror(errno));
+	}
+	for (i = 0; i < nr_procs; i++) {
+		if (wait(&wait_stat) < 0)
+			die("wait() failed: %s\n", strerror(errno));
+		if (!WIFEXITED(wait_stat) || WEXITSTATUS(wait_stat))
+			die("worker failed\n");
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	unlink(path);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+	total = (unsigned long long)loops * nr_procs;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d processes reading %d blocks of a %d extent"
+		       " file in %s\n\n",
+		       nr_procs, loops, nr_blocks, base_dir);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec * nr_procs / (double)total);
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)total /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
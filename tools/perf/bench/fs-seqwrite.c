@@ -0,0 +1,173 @@
+/*
+ *
+ * fs-seqwrite.c
+ *
+ * seqwrite: Benchmark for small sequential writes
+ *
+ * A scratch file is written from start to end with write() calls of a
+ * small size, and optionally fsync()ed at the end.  Filesystems that
+ * send every write to their backing store synchronously, like FUSE
+ * without the writeback cache, pay a round trip per call here.
+ * With --fuse the file is written on a FUSE mount served by perf
+ * itself, with or without the writeback cache, to compare the two.
+ * Reports writes and megabytes per second.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define WRITE_SIZE_DEFAULT	4096
+#define TOTAL_DEFAULT		"64MB"
+
+static int write_size = WRITE_SIZE_DEFAULT;
+static const char *total_str = TOTAL_DEFAULT;
+static const char *base_dir = ".";
+static bool do_fsync;
+static bool use_fuse;
+static bool writeback_cache;
+
+static const struct option options[] = {
+	OPT_INTEGER('s', "size", &write_size,
+		    "Specify size of each write() in bytes"),
+	OPT_STRING('t', "total", &total_str, "64MB",
+		   "Specify total amount of data to write (default: 64MB)"),
+	OPT_STRING('d', "dir", &base_dir, "path",
+		   "Create the scratch file in this directory"),
+	OPT_BOOLEAN('f', "fsync", &do_fsync,
+		    "fsync() the file before stopping the clock"),
+	OPT_BOOLEAN('F', "fuse", &use_fuse,
+		    "Write to a FUSE mount set up in this directory"),
+	OPT_BOOLEAN('W', "writeback-cache", &writeback_cache,
+		    "Ask for the FUSE writeback cache (with --fuse)"),
+	OPT_END()
+};
+
+static const char * const bench_fs_seqwrite_usage[] = {
+	"perf bench fs seqwrite <options>",
+	NULL
+};
+
+int bench_fs_seqwrite(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, nr_writes, i;
+	double total_mb;
+	char path[PATH_MAX], mnt[PATH_MAX];
+	const char *dir = base_dir;
+	s64 total;
+	char *buf;
+	int fd;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_seqwrite_usage, 0);
+
+	if (write_size <= 0)
+		die("write size must be positive\n");
+	total = perf_atoll(total_str);
+	if (total <= 0)
+		die("invalid total size: %s\n", total_str);
+	if (strlen(base_dir) >= PATH_MAX - 64)
+		die("path too long\n");
+
+	nr_writes = total / write_size;
+	if (!nr_writes)
+		nr_writes = 1;
+
+	buf = malloc(write_size);
+	if (!buf)
+		die("malloc() failed\n");
+	memset(buf, 0x5a, write_size);
+
+	if (use_fuse) {
+		snprintf(mnt, sizeof(mnt), "%s/perf-bench-fuse.%d",
+			 base_dir, getpid());
+		if (mkdir(mnt, 0755) < 0)
+			die("mkdir(%s) failed: %s\n", mnt, strerror(errno));
+		fuse_memfs_mount(mnt, writeback_cache);
+		dir = mnt;
+	}
+
+	snprintf(path, sizeof(path), "%s/perf-bench-seqwrite.%d",
+		 dir, getpid());
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0)
+		die("creat(%s) failed: %s\n", path, strerror(errno));
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_writes; i++) {
+		if (write(fd, buf, write_size) != write_size)
+			die("write(%s) failed: %s\n", path, strerror(errno));
+	}
+	if (do_fsync && fsync(fd) < 0)
+		die("fsync(%s) failed: %s\n", path, strerror(errno));
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	close(fd);
+	unlink(path);
+	free(buf);
+	if (use_fuse) {
+		fuse_memfs_umount(mnt);
+		rmdir(mnt);
+	}
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+	if (!result_usec)
+		result_usec = 1;
+	total_mb = (double)nr_writes * write_size / (1024 * 1024);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %llu writes of %d bytes to a file in %s%s%s\n\n",
+		       nr_writes, write_size, base_dir,
+		       !use_fuse ? "" : writeback_cache ?
+		       " (FUSE, writeback cache)" : " (FUSE)",
+		       do_fsync ? ", then fsync()" : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)nr_writes);
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)nr_writes /
+			     ((double)result_usec / (double)1000000)));
+		printf(" %14lf MB/sec\n",
+		       total_mb / ((double)result_usec / (double)1000000));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ *
+ * fs-stat.c
+ *
+ * stat: Benchmark for parallel path lookup
+ *
+ * A number of processes stat() the same path over and over again, the
+ * way a parallel build looks for headers.  By default the path is a file
+ * a few directories deep in a scratch tree under the current directory;
+ * lookups of a missing name can be measured too.  Reports the aggregate
+ * number of lookups per second.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define LOOPS_DEFAULT		1000000
+#define DEPTH_DEFAULT		4
+#define DEPTH_MAX		64
+
+static int loops = LOOPS_DEFAULT;
+static int nr_procs;
+static int depth = DEPTH_DEFAULT;
+static const char *stat_path;
+static bool missing;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of stat() calls per process"),
+	OPT_INTEGER('p', "procs", &nr_procs,
+		    "Specify number of processes (default: online CPUs)"),
+	OPT_INTEGER('d', "depth", &depth,
+		    "Specify directory depth of the scratch file"),
+	OPT_STRING('f', "file", &stat_path, "path",
+		   "stat() this existing path instead of a scratch file"),
+	OPT_BOOLEAN('n', "negative", &missing,
+		    "stat() a name that does not exist (ENOENT)"),
+	OPT_END()
+};
+
+static const char * const bench_fs_stat_usage[] = {
+	"perf bench fs stat <options>",
+	NULL
+};
+
+static char scratch[PATH_MAX];
+
+/* scratch/d/d/.../file, depth directories below scratch */
+static void make_tree(char *path)
+{
+	int i, fd;
+
+	snprintf(scratch, sizeof(scratch), "perf-bench-stat.%d", getpid());
+	if (mkdir(scratch, 0755) < 0)
+		die("mkdir(%s) failed: %s\n", scratch, strerror(errno));
+
+	strcpy(path, scratch);
+	for (i = 0; i < depth; i++) {
+		strcat(path, "/d");
+		if (mkdir(path, 0755) < 0)
+			die("mkdir(%s) failed: %s\n", path, strerror(errno));
+	}
+	strcat(path, "/file");
+	fd = open(path, O_CREAT | O_WRONLY, 0644);
+	if (fd < 0)
+		die("creat(%s) failed: %s\n", path, strerror(errno));
+	close(fd);
+}
+
+static void remove_tree(char *path)
+{
+	char *slash;
+
+	unlink(path);
+	while ((slash = strrchr(path, '/')) != NULL) {
+		*slash = '\0';
+		rmdir(path);
+	}
+}
+
+static void worker(const char *path, int ready, int go)
+{
+	struct stat st;
+	char c = 0;
+	int i, ret;
+
+	ret = write(ready, &c, 1);
+	ret = read(go, &c, 1);
+	(void)ret;
+
+	for (i = 0; i < loops; i++) {
+		if (stat(path, &st) < 0 && !(missing && errno == ENOENT))
+			die("stat(%s) failed: %s\n", path, strerror(errno));
+	}
+	exit(0);
+}
+
+int bench_fs_stat(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	char path[PATH_MAX + 16];
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total;
+	int ready[2], go[2];
+	int i, wait_stat;
+	char c = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_stat_usage, 0);
+
+	if (loops <= 0)
+		die("number of loops must be positive\n");
+	if (depth < 0 || depth > DEPTH_MAX)
+		die("depth must be between 0 and %d\n", DEPTH_MAX);
+	if (nr_procs <= 0)
+		nr_procs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_procs <= 0)
+		nr_procs = 1;
+
+	if (stat_path) {
+		if (strlen(stat_path) >= PATH_MAX)
+			die("path too long\n");
+		strcpy(path, stat_path);
+	} else {
+		make_tree(path);
+	}
+	if (missing)
+		strcat(path, ".none");
+
+	if (pipe(ready) < 0 || pipe(go) < 0)
+		die("pipe() failed: %s\n", strerror(errno));
+
+	for (i = 0; i < nr_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			die("fork() failed: %s\n", strerror(errno));
+		if (!pid)
+			worker(path, ready[1], go[0]);
+	}
+
+	/* wait for everybody to be ready, then release them at once */
+	for (i = 0; i < nr_procs; i++) {
+		if (read(ready[0], &c, 1) != 1)
+			die("read() failed: %s\n", strerror(errno));
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_procs; i++) {
+		if (write(go[1], &c, 1) != 1)
+			die("write() failed: %s\n", strerror(errno));
+	}
+	for (i = 0; i < nr_procs; i++) {
+		if (wait(&wait_stat) < 0)
+			die("wait() failed: %s\n", strerror(errno));
+		if (!WIFEXITED(wait_stat) || WEXITSTATUS(wait_stat))
+			die("worker failed\n");
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	if (missing)
+		path[strlen(path) - strlen(".none")] = '\0';
+	if (!stat_path)
+		remove_tree(path);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+	total = (unsigned long long)loops * nr_procs;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d processes doing %d stat() calls each",
+		       nr_procs, loops);
+		if (stat_path)
+			printf(" on %s", stat_path);
+		else
+			printf(", %d directories deep", depth);
+		printf("%s\n\n", missing ? ", missing last component" : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec * nr_procs / (double)total);
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)total /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
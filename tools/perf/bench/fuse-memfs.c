@@ -0,0 +1,322 @@
+/*
+ *
+ * fuse-memfs.c
+ *
+ * A minimal FUSE filesystem for the fs suites, so that they can be run
+ * against FUSE without an external daemon.  It talks to /dev/fuse from
+ * a child process and has a root directory holding at most one regular
+ * file at a time.  Data written to the file is thrown away and reads
+ * return zeroes: only the cost of getting requests to the filesystem
+ * is measured.  Mounting needs root.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/mount.h>
+#include <linux/fuse.h>
+
+#ifndef FUSE_WRITEBACK_CACHE
+#define FUSE_WRITEBACK_CACHE	(1 << 16)
+#endif
+
+/* The protocol spoken here: 7.14, negotiated flags aside */
+#define MEMFS_MINOR		14
+#define MEMFS_MAX_WRITE		(128 * 1024)
+#define MEMFS_BUFSIZE		(MEMFS_MAX_WRITE + 4096)
+
+/* fuse_init_out as of 7.14: later versions make it longer */
+struct memfs_init_out {
+	__u32	major;
+	__u32	minor;
+	__u32	max_readahead;
+	__u32	flags;
+	__u16	max_background;
+	__u16	congestion_threshold;
+	__u32	max_write;
+};
+
+static struct {
+	int		exists;
+	__u64		nodeid;
+	__u64		size;
+	char		name[256];
+} file;
+
+static __u64 next_nodeid = FUSE_ROOT_ID + 1;
+static pid_t memfs_pid;
+
+static void memfs_reply(int fd, struct fuse_in_header *in, int error,
+			const void *arg, size_t size)
+{
+	struct fuse_out_header out;
+	struct iovec iov[2];
+
+	out.unique = in->unique;
+	out.error = -error;
+	out.len = sizeof(out) + (error ? 0 : size);
+	iov[0].iov_base = &out;
+	iov[0].iov_len = sizeof(out);
+	iov[1].iov_base = (void *)arg;
+	iov[1].iov_len = error ? 0 : size;
+
+	/* ENOENT: the request was interrupted meanwhile */
+	if (writev(fd, iov, 2) < 0 && errno != ENOENT)
+		exit(1);
+}
+
+static void memfs_fill_attr(__u64 nodeid, struct fuse_attr *attr)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->uid = getuid();
+	attr->gid = getgid();
+	attr->blksize = 4096;
+	if (nodeid == FUSE_ROOT_ID) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+	} else {
+		attr->mode = S_IFREG | 0644;
+		attr->nlink = 1;
+		attr->size = file.size;
+		attr->blocks = (file.size + 511) / 512;
+	}
+}
+
+static void memfs_reply_entry(int fd, struct fuse_in_header *in)
+{
+	struct fuse_entry_out entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.nodeid = file.nodeid;
+	entry.entry_valid = 1;
+	entry.attr_valid = 1;
+	memfs_fill_attr(file.nodeid, &entry.attr);
+	memfs_reply(fd, in, 0, &entry, sizeof(entry));
+}
+
+static void memfs_reply_attr(int fd, struct fuse_in_header *in)
+{
+	struct fuse_attr_out out;
+
+	if (in->nodeid != FUSE_ROOT_ID &&
+	    (!file.exists || in->nodeid != file.nodeid)) {
+		memfs_reply(fd, in, ENOENT, NULL, 0);
+		return;
+	}
+	memset(&out, 0, sizeof(out));
+	out.attr_valid = 1;
+	memfs_fill_attr(in->nodeid, &out.attr);
+	memfs_reply(fd, in, 0, &out, sizeof(out));
+}
+
+static void memfs_init(int fd, struct fuse_in_header *in,
+		       struct fuse_init_in *arg, bool writeback_cache)
+{
+	struct memfs_init_out out;
+	__u32 want = FUSE_BIG_WRITES;
+
+	if (writeback_cache)
+		want |= FUSE_WRITEBACK_CACHE;
+
+	memset(&out, 0, sizeof(out));
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = MEMFS_MINOR;
+	out.max_readahead = arg->max_readahead;
+	out.flags = arg->flags & want;
+	out.max_write = MEMFS_MAX_WRITE;
+	if (writeback_cache && !(out.flags & FUSE_WRITEBACK_CACHE))
+		fprintf(stderr, "the kernel does not offer the FUSE "
+			"writeback cache\n");
+	memfs_reply(fd, in, 0, &out, sizeof(out));
+}
+
+static void memfs_serve(int fd, bool writeback_cache)
+{
+	struct fuse_in_header *in;
+	struct fuse_open_out open_out;
+	struct fuse_write_out write_out;
+	char *buf, *zeroes, *name;
+	void *arg;
+	ssize_t n;
+
+	buf = malloc(MEMFS_BUFSIZE);
+	zeroes = calloc(1, MEMFS_MAX_WRITE);
+	if (!buf || !zeroes)
+		exit(1);
+	memset(&open_out, 0, sizeof(open_out));
+	memset(&write_out, 0, sizeof(write_out));
+
+	for (;;) {
+		n = read(fd, buf, MEMFS_BUFSIZE);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == ENOENT)
+				continue;
+			/* ENODEV: unmounted */
+			break;
+		}
+		if (n < (ssize_t)sizeof(*in))
+			break;
+		in = (struct fuse_in_header *)buf;
+		arg = in + 1;
+
+		switch (in->opcode) {
+		case FUSE_INIT:
+			memfs_init(fd, in, arg, writeback_cache);
+			break;
+
+		case FUSE_LOOKUP:
+			name = arg;
+			if (in->nodeid == FUSE_ROOT_ID && file.exists &&
+			    !strcmp(name, file.name))
+				memfs_reply_entry(fd, in);
+			else
+				memfs_reply(fd, in, ENOENT, NULL, 0);
+			break;
+
+		case FUSE_CREATE: {
+			struct {
+				struct fuse_entry_out entry;
+				struct fuse_open_out open;
+			} out;
+
+			name = (char *)arg + sizeof(struct fuse_create_in);
+			if (in->nodeid != FUSE_ROOT_ID || file.exists ||
+			    strlen(name) >= sizeof(file.name)) {
+				memfs_reply(fd, in, file.exists ? ENOSPC :
+					    EINVAL, NULL, 0);
+				break;
+			}
+			file.exists = 1;
+			file.nodeid = next_nodeid++;
+			file.size = 0;
+			strcpy(file.name, name);
+
+			memset(&out, 0, sizeof(out));
+			out.entry.nodeid = file.nodeid;
+			out.entry.entry_valid = 1;
+			out.entry.attr_valid = 1;
+			memfs_fill_attr(file.nodeid, &out.entry.attr);
+			memfs_reply(fd, in, 0, &out, sizeof(out));
+			break;
+		}
+
+		case FUSE_UNLINK:
+			name = arg;
+			if (in->nodeid == FUSE_ROOT_ID && file.exists &&
+			    !strcmp(name, file.name)) {
+				file.exists = 0;
+				memfs_reply(fd, in, 0, NULL, 0);
+			} else
+				memfs_reply(fd, in, ENOENT, NULL, 0);
+			break;
+
+		case FUSE_GETATTR:
+			memfs_reply_attr(fd, in);
+			break;
+
+		case FUSE_SETATTR: {
+			struct fuse_setattr_in *sa = arg;
+
+			if (in->nodeid == file.nodeid &&
+			    (sa->valid & FATTR_SIZE))
+				file.size = sa->size;
+			memfs_reply_attr(fd, in);
+			break;
+		}
+
+		case FUSE_OPEN:
+		case FUSE_OPENDIR:
+			memfs_reply(fd, in, 0, &open_out, sizeof(open_out));
+			break;
+
+		case FUSE_READ: {
+			struct fuse_read_in *rd = arg;
+			__u64 len = 0;
+
+			if (rd->offset < file.size)
+				len = file.size - rd->offset;
+			if (len > rd->size)
+				len = rd->size;
+			if (len > MEMFS_MAX_WRITE)
+				len = MEMFS_MAX_WRITE;
+			memfs_reply(fd, in, 0, zeroes, len);
+			break;
+		}
+
+		case FUSE_WRITE: {
+			struct fuse_write_in *wr = arg;
+
+			if (in->nodeid == file.nodeid &&
+			    wr->offset + wr->size > file.size)
+				file.size = wr->offset + wr->size;
+			write_out.size = wr->size;
+			memfs_reply(fd, in, 0, &write_out, sizeof(write_out));
+			break;
+		}
+
+		case FUSE_FLUSH:
+		case FUSE_FSYNC:
+		case FUSE_RELEASE:
+		case FUSE_RELEASEDIR:
+		case FUSE_DESTROY:
+			memfs_reply(fd, in, 0, NULL, 0);
+			break;
+
+		case FUSE_FORGET:
+		case FUSE_INTERRUPT:
+			/* no reply */
+			break;
+
+		default:
+			memfs_reply(fd, in, ENOSYS, NULL, 0);
+			break;
+		}
+	}
+	exit(0);
+}
+
+/*
+ * Mount the filesystem on @dir, asking for the writeback cache if
+ * @writeback_cache is set.
+ */
+void fuse_memfs_mount(const char *dir, bool writeback_cache)
+{
+	char opts[128];
+	int fd;
+
+	fd = open("/dev/fuse", O_RDWR);
+	if (fd < 0)
+		die("cannot open /dev/fuse: %s\n", strerror(errno));
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=%u,group_id=%u",
+		 fd, getuid(), getgid());
+	if (mount("perf-bench", dir, "fuse", MS_NOSUID | MS_NODEV, opts) < 0)
+		die("cannot mount FUSE on %s: %s\n", dir, strerror(errno));
+
+	memfs_pid = fork();
+	if (memfs_pid < 0)
+		die("fork() failed: %s\n", strerror(errno));
+	if (!memfs_pid)
+		memfs_serve(fd, writeback_cache);
+	close(fd);
+}
+
+void fuse_memfs_umount(const char *dir)
+{
+	if (umount2(dir, 0) < 0)
+		die("cannot unmount %s: %s\n", dir, strerror(errno));
+	waitpid(memfs_pid, NULL, 0);
+}
@@ -0,0 +1,199 @@
+/*
+ *
+ * mem-randaccess.c
+ *
+ * randaccess: Benchmark for random access to a large anonymous mapping
+ *
+ * A large anonymous buffer is faulted in and then read by chasing
+ * pointers through its pages in random order, so that nearly every
+ * access misses the TLB.  Run it with --hugepage and --nohugepage to
+ * see what transparent huge pages save on page faults and on TLB
+ * misses.  Reports the time to fault the buffer in and nanoseconds
+ * per access.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE		14
+#endif
+#ifndef MADV_NOHUGEPAGE
+#define MADV_NOHUGEPAGE		15
+#endif
+
+#define SIZE_DEFAULT		"1GB"
+#define LOOPS_DEFAULT		10000000
+#define HPAGE_SIZE		(2UL << 20)
+#define LINE_SIZE		64
+
+static const char *size_str = SIZE_DEFAULT;
+static int loops = LOOPS_DEFAULT;
+static bool hugepage;
+static bool nohugepage;
+
+static const struct option options[] = {
+	OPT_STRING('s', "size", &size_str, "1GB",
+		   "Specify size of the buffer (default: 1GB)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of accesses"),
+	OPT_BOOLEAN('H', "hugepage", &hugepage,
+		    "madvise(MADV_HUGEPAGE) the buffer"),
+	OPT_BOOLEAN('N', "nohugepage", &nohugepage,
+		    "madvise(MADV_NOHUGEPAGE) the buffer"),
+	OPT_END()
+};
+
+static const char * const bench_mem_randaccess_usage[] = {
+	"perf bench mem randaccess <options>",
+	NULL
+};
+
+/*
+ * Link one cache line of every page into a single cycle, visiting the
+ * pages in random order (Sattolo's shuffle).  The line used in each
+ * page varies, to spread the chain over the cache sets.
+ */
+static void **build_chain(char *buf, unsigned long nr_pages,
+			  unsigned long page_size)
+{
+	unsigned long long seed = getpid();
+	unsigned long *order, i, j;
+	void **head;
+
+	order = malloc(nr_pages * sizeof(*order));
+	if (!order)
+		die("malloc() failed\n");
+	for (i = 0; i < nr_pages; i++)
+		order[i] = i;
+	for (i = nr_pages - 1; i > 0; i--) {
+		unsigned long tmp;
+
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		j = (seed >> 33) % i;
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	for (i = 0; i < nr_pages; i++) {
+		unsigned long next = (i + 1) % nr_pages;
+		void **slot;
+
+		slot = (void **)(buf + order[i] * page_size +
+				 (i * 7 * LINE_SIZE) % page_size);
+		*slot = buf + order[next] * page_size +
+			(next * 7 * LINE_SIZE) % page_size;
+	}
+
+	head = (void **)(buf + order[0] * page_size);
+	free(order);
+	return head;
+}
+
+int bench_mem_randaccess(int argc, const char **argv,
+			 const char *prefix __used)
+{
+	struct timeval start, stop, fault_diff, diff;
+	unsigned long long result_usec;
+	unsigned long page_size = sysconf(_SC_PAGESIZE);
+	unsigned long nr_pages, i;
+	void **p, **head;
+	char *map, *buf;
+	s64 size;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_randaccess_usage, 0);
+
+	if (loops <= 0)
+		die("number of loops must be positive\n");
+	if (hugepage && nohugepage)
+		die("--hugepage and --nohugepage are exclusive\n");
+	size = perf_atoll(size_str);
+	if (size <= 0)
+		die("invalid size: %s\n", size_str);
+	size = (size + HPAGE_SIZE - 1) & ~(HPAGE_SIZE - 1);
+	nr_pages = size / page_size;
+
+	/* over-allocate so the buffer can start on a huge page boundary */
+	map = mmap(NULL, size + HPAGE_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED)
+		die("mmap() failed: %s\n", strerror(errno));
+	buf = (char *)(((unsigned long)map + HPAGE_SIZE - 1) &
+		       ~(HPAGE_SIZE - 1));
+
+	if (hugepage && madvise(buf, size, MADV_HUGEPAGE) < 0)
+		die("madvise(MADV_HUGEPAGE) failed: %s\n", strerror(errno));
+	if (nohugepage && madvise(buf, size, MADV_NOHUGEPAGE) < 0)
+		die("madvise(MADV_NOHUGEPAGE) failed: %s\n", strerror(errno));
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_pages; i++)
+		buf[i * page_size] = 1;
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &fault_diff);
+
+	head = build_chain(buf, nr_pages, page_size);
+
+	gettimeofday(&start, NULL);
+	p = head;
+	for (i = 0; i < (unsigned long)loops; i++)
+		p = *p;
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	/* keep the compiler from dropping the loop */
+	if (!p)
+		die("broken pointer chain\n");
+
+	munmap(map, size + HPAGE_SIZE);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d random accesses to %lld MB of anonymous memory%s\n\n",
+		       loops, (long long)(size >> 20),
+		       hugepage ? ", MADV_HUGEPAGE" :
+		       nohugepage ? ", MADV_NOHUGEPAGE" : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n", "Fault in",
+		       fault_diff.tv_sec,
+		       (unsigned long) (fault_diff.tv_usec/1000));
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf nsecs/access\n",
+		       (double)result_usec * 1000 / (double)loops);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
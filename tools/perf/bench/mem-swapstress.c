@@ -0,0 +1,206 @@
+/*
+ *
+ * mem-swapstress.c
+ *
+ * swapstress: Benchmark for swapping out and in from many cpus at once
+ *
+ * Worker processes, one per cpu by default, each dirty every page of
+ * their share of a large anonymous buffer over and over.  Run it with
+ * less memory than the buffer, typically in a memory cgroup, and with a
+ * fast swap device such as brd or ramzswap, so that the kernel's swap
+ * allocation rather than the device is what limits throughput.
+ * Reports the time taken and the pages swapped out and in per second.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#define SIZE_DEFAULT		"1GB"
+
+static const char *size_str = SIZE_DEFAULT;
+static const char *cgroup;
+static int nr_workers;
+static int loops = 4;
+
+static const struct option options[] = {
+	OPT_STRING('s', "size", &size_str, "1GB",
+		   "Specify total size of the buffers (default: 1GB)"),
+	OPT_INTEGER('w', "workers", &nr_workers,
+		    "Specify number of worker processes (default: nr cpus)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of passes over the buffers (default: 4)"),
+	OPT_STRING('c', "cgroup", &cgroup, "dir",
+		   "Run in this memory cgroup directory"),
+	OPT_END()
+};
+
+static const char * const bench_mem_swapstress_usage[] = {
+	"perf bench mem swapstress <options>",
+	NULL
+};
+
+static unsigned long long vmstat_read(const char *name)
+{
+	unsigned long long val = 0, v;
+	char key[64];
+	FILE *fp;
+
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp)
+		die("cannot open /proc/vmstat: %s\n", strerror(errno));
+	while (fscanf(fp, "%63s %llu", key, &v) == 2) {
+		if (!strcmp(key, name)) {
+			val = v;
+			break;
+		}
+	}
+	fclose(fp);
+	return val;
+}
+
+static void enter_cgroup(const char *dir)
+{
+	char path[PATH_MAX], buf[32];
+	int fd, len;
+
+	snprintf(path, sizeof(path), "%s/tasks", dir);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		die("cannot open %s: %s\n", path, strerror(errno));
+	len = snprintf(buf, sizeof(buf), "%d\n", getpid());
+	if (write(fd, buf, len) != len)
+		die("cannot write %s: %s\n", path, strerror(errno));
+	close(fd);
+}
+
+static void worker(size_t size, unsigned long page_size)
+{
+	unsigned long i, nr_pages = size / page_size;
+	char *buf;
+	int loop;
+
+	buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		die("mmap() failed: %s\n", strerror(errno));
+
+	for (loop = 0; loop < loops; loop++)
+		for (i = 0; i < nr_pages; i++)
+			buf[i * page_size] = loop + 1;
+
+	/* check nothing was lost on the way out and back */
+	for (i = 0; i < nr_pages; i++)
+		if (buf[i * page_size] != loops)
+			exit(1);
+
+	munmap(buf, size);
+	exit(0);
+}
+
+int bench_mem_swapstress(int argc, const char **argv,
+			 const char *prefix __used)
+{
+	unsigned long page_size = sysconf(_SC_PAGESIZE);
+	unsigned long long pswpout, pswpin;
+	struct timeval start, stop, diff;
+	double secs;
+	size_t share;
+	s64 size;
+	int i, status, failed = 0;
+	pid_t pid;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_swapstress_usage, 0);
+
+	if (!nr_workers)
+		nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_workers <= 0)
+		die("number of workers must be positive\n");
+	if (loops <= 0)
+		die("number of loops must be positive\n");
+	size = perf_atoll(size_str);
+	if (size <= 0)
+		die("invalid size: %s\n", size_str);
+	share = (size / nr_workers) & ~(page_size - 1);
+	if (!share)
+		die("size too small for %d workers\n", nr_workers);
+
+	if (cgroup)
+		enter_cgroup(cgroup);
+
+	pswpout = vmstat_read("pswpout");
+	pswpin = vmstat_read("pswpin");
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_workers; i++) {
+		pid = fork();
+		if (pid < 0)
+			die("fork() failed: %s\n", strerror(errno));
+		if (!pid)
+			worker(share, page_size);
+	}
+	for (i = 0; i < nr_workers; i++) {
+		if (wait(&status) < 0)
+			die("wait() failed: %s\n", strerror(errno));
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed++;
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	pswpout = vmstat_read("pswpout") - pswpout;
+	pswpin = vmstat_read("pswpin") - pswpin;
+
+	if (failed)
+		die("%d worker processes failed\n", failed);
+
+	secs = diff.tv_sec + diff.tv_usec / 1e6;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d workers dirtying %lu MB each, %d times\n\n",
+		       nr_workers, (unsigned long)(share >> 20), loops);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf pages swapped out/sec (%llu)\n",
+		       pswpout / secs, pswpout);
+		printf(" %14lf pages swapped in/sec (%llu)\n",
+		       pswpin / secs, pswpin);
+		if (!pswpout)
+			printf("\n # nothing was swapped: try a larger --size"
+			       " or a memory cgroup\n");
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,333 @@
+/*
+ *
+ * mem-xfer.c
+ *
+ * xfer: Benchmark for moving data between two processes
+ *
+ * A child process holds a buffer which the parent copies out, over
+ * and over, in one of three ways: process_vm_readv() straight from
+ * the child's memory, a pipe the child writes into, or a shared
+ * mapping the child copies into with a pipe handshake per transfer.
+ * Reports the bandwidth achieved by each.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#define SIZE_DEFAULT		"1MB"
+#define TOTAL_DEFAULT		"4GB"
+
+static const char *size_str = SIZE_DEFAULT;
+static const char *total_str = TOTAL_DEFAULT;
+static const char *method = "all";
+
+static const struct option options[] = {
+	OPT_STRING('s', "size", &size_str, "1MB",
+		   "Specify size of each transfer"),
+	OPT_STRING('t', "total", &total_str, "4GB",
+		   "Specify amount of data to move"),
+	OPT_STRING('m', "method", &method, "all",
+		   "Specify method: pvm, pipe, shm or all"),
+	OPT_END()
+};
+
+static const char * const bench_mem_xfer_usage[] = {
+	"perf bench mem xfer <options>",
+	NULL
+};
+
+static size_t size;
+static unsigned long nr_xfers;
+
+static char *alloc_buf(int shared)
+{
+	char *buf;
+
+	buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS,
+		   -1, 0);
+	if (buf == MAP_FAILED)
+		die("mmap() failed: %s\n", strerror(errno));
+	return buf;
+}
+
+static void read_full(int fd, char *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = read(fd, buf, len);
+
+		if (ret <= 0)
+			die("read() failed: %s\n",
+			    ret ? strerror(errno) : "unexpected EOF");
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static void write_full(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = write(fd, buf, len);
+
+		if (ret < 0)
+			die("write() failed: %s\n", strerror(errno));
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static void reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid() failed: %s\n", strerror(errno));
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		die("child process failed\n");
+}
+
+static ssize_t do_process_vm_readv(pid_t pid, const struct iovec *lvec,
+				   const struct iovec *rvec)
+{
+#ifdef __NR_process_vm_readv
+	return syscall(__NR_process_vm_readv, pid, lvec, 1UL, rvec, 1UL, 0UL);
+#else
+	(void)pid;
+	(void)lvec;
+	(void)rvec;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* Single copy, straight out of the child's pages */
+static int xfer_pvm(char *dst)
+{
+	char *src = alloc_buf(0);
+	struct iovec lvec, rvec;
+	unsigned long i;
+	int ready[2], done[2];
+	char c;
+	pid_t pid;
+
+	if (pipe(ready) < 0 || pipe(done) < 0)
+		die("pipe() failed: %s\n", strerror(errno));
+
+	pid = fork();
+	if (pid < 0)
+		die("fork() failed: %s\n", strerror(errno));
+	if (!pid) {
+		/* own the buffer, then wait for the parent to finish */
+		close(ready[0]);
+		close(done[1]);
+		memset(src, 'y', size);
+		write_full(ready[1], "r", 1);
+		while (read(done[0], &c, 1) > 0)
+			;
+		exit(0);
+	}
+	close(ready[1]);
+	close(done[0]);
+	read_full(ready[0], &c, 1);
+	close(ready[0]);
+
+	lvec.iov_base = dst;
+	lvec.iov_len = size;
+	rvec.iov_base = src;
+	rvec.iov_len = size;
+	for (i = 0; i < nr_xfers; i++) {
+		ssize_t ret = do_process_vm_readv(pid, &lvec, &rvec);
+
+		if (ret != (ssize_t)size) {
+			close(done[1]);
+			kill(pid, SIGKILL);
+			waitpid(pid, NULL, 0);
+			munmap(src, size);
+			if (ret < 0 && errno == ENOSYS)
+				return -1;
+			die("process_vm_readv() failed: %s\n",
+			    ret < 0 ? strerror(errno) : "short read");
+		}
+	}
+
+	close(done[1]);
+	reap(pid);
+	munmap(src, size);
+	return 0;
+}
+
+/* Two copies, through the pipe buffer */
+static int xfer_pipe(char *dst)
+{
+	unsigned long i;
+	int fds[2];
+	pid_t pid;
+
+	if (pipe(fds) < 0)
+		die("pipe() failed: %s\n", strerror(errno));
+
+	pid = fork();
+	if (pid < 0)
+		die("fork() failed: %s\n", strerror(errno));
+	if (!pid) {
+		char *src = alloc_buf(0);
+
+		close(fds[0]);
+		memset(src, 'y', size);
+		for (i = 0; i < nr_xfers; i++)
+			write_full(fds[1], src, size);
+		exit(0);
+	}
+	close(fds[1]);
+
+	for (i = 0; i < nr_xfers; i++)
+		read_full(fds[0], dst, size);
+
+	close(fds[0]);
+	reap(pid);
+	return 0;
+}
+
+/* Two copies, through a shared mapping, handing it over by pipe */
+static int xfer_shm(char *dst)
+{
+	char *shm = alloc_buf(1);
+	int full[2], empty[2];
+	unsigned long i;
+	char c = 0;
+	pid_t pid;
+
+	if (pipe(full) < 0 || pipe(empty) < 0)
+		die("pipe() failed: %s\n", strerror(errno));
+
+	pid = fork();
+	if (pid < 0)
+		die("fork() failed: %s\n", strerror(errno));
+	if (!pid) {
+		char *src = alloc_buf(0);
+
+		close(full[0]);
+		close(empty[1]);
+		memset(src, 'y', size);
+		for (i = 0; i < nr_xfers; i++) {
+			memcpy(shm, src, size);
+			write_full(full[1], &c, 1);
+			read_full(empty[0], &c, 1);
+		}
+		exit(0);
+	}
+	close(full[1]);
+	close(empty[0]);
+
+	for (i = 0; i < nr_xfers; i++) {
+		read_full(full[0], &c, 1);
+		memcpy(dst, shm, size);
+		write_full(empty[1], &c, 1);
+	}
+
+	close(full[0]);
+	close(empty[1]);
+	reap(pid);
+	munmap(shm, size);
+	return 0;
+}
+
+struct xfer_method {
+	const char *name;
+	const char *desc;
+	int (*fn)(char *dst);
+};
+
+static const struct xfer_method methods[] = {
+	{ "pvm",  "process_vm_readv()",	xfer_pvm },
+	{ "pipe", "pipe",		xfer_pipe },
+	{ "shm",  "shared memory",	xfer_shm },
+	{ NULL,   NULL,			NULL }
+};
+
+static void print_result(const struct xfer_method *m, struct timeval *diff)
+{
+	double secs = diff->tv_sec + diff->tv_usec / 1e6;
+	double mbps = (double)size * nr_xfers / secs / 1024 / 1024;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %20s: %14lf MB/Sec\n", m->desc, mbps);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%s %lf\n", m->name, mbps);
+		break;
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+}
+
+int bench_mem_xfer(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	const struct xfer_method *m;
+	struct timeval start, stop, diff;
+	s64 total;
+	int found = 0;
+	char *dst;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_xfer_usage, 0);
+
+	size = perf_atoll(size_str);
+	if ((s64)size <= 0)
+		die("invalid size: %s\n", size_str);
+	total = perf_atoll(total_str);
+	if (total <= 0)
+		die("invalid total: %s\n", total_str);
+	nr_xfers = (total + size - 1) / size;
+
+	dst = alloc_buf(0);
+	memset(dst, 0, size);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Moving %lu x %s between two processes\n\n",
+		       nr_xfers, size_str);
+
+	for (m = methods; m->name; m++) {
+		if (strcmp(method, "all") && strcmp(method, m->name))
+			continue;
+		found = 1;
+
+		gettimeofday(&start, NULL);
+		if (m->fn(dst) < 0) {
+			if (bench_format == BENCH_FORMAT_DEFAULT)
+				printf(" %20s: not supported\n", m->desc);
+			continue;
+		}
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+
+		print_result(m, &diff);
+	}
+
+	munmap(dst, size);
+
+	if (!found)
+		die("unknown method: %s\n", method);
+	return 0;
+}
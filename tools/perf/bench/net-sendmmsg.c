@@ -0,0 +1,208 @@
+/*
+ *
+ * net-sendmmsg.c
+ *
+ * sendmmsg: Benchmark for batched datagram transmission
+ *
+ * Floods a UDP socket bound to the loopback address with small
+ * datagrams, either one sendmsg() per datagram or in batches of
+ * sendmmsg(), and reports the achieved packet rate.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define PACKETS_DEFAULT		1000000
+#define BATCH_DEFAULT		32
+#define SIZE_DEFAULT		64
+#define BATCH_MAX		1024
+
+static int packets = PACKETS_DEFAULT;
+static int batch = BATCH_DEFAULT;
+static int size = SIZE_DEFAULT;
+static bool only_sendmsg;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &packets,
+		    "Specify number of datagrams to send"),
+	OPT_INTEGER('b', "batch", &batch,
+		    "Specify number of datagrams per sendmmsg() call"),
+	OPT_INTEGER('s', "size", &size,
+		    "Specify payload size of each datagram"),
+	OPT_BOOLEAN('1', "sendmsg", &only_sendmsg,
+		    "Use one sendmsg() per datagram instead of sendmmsg()"),
+	OPT_END()
+};
+
+static const char * const bench_net_sendmmsg_usage[] = {
+	"perf bench net sendmmsg <options>",
+	NULL
+};
+
+/* libc may predate sendmmsg(), so carry our own copy of the ABI */
+struct bench_mmsghdr {
+	struct msghdr	msg_hdr;
+	unsigned int	msg_len;
+};
+
+static int do_sendmmsg(int fd, struct bench_mmsghdr *mmsg,
+		       unsigned int vlen)
+{
+#ifdef __NR_sendmmsg
+	return syscall(__NR_sendmmsg, fd, mmsg, vlen, 0);
+#else
+	(void)fd;
+	(void)mmsg;
+	(void)vlen;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int open_loopback(struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+	int fd, rcvbuf = 4 << 20;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		die("socket() failed: %s\n", strerror(errno));
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) < 0)
+		die("bind() failed: %s\n", strerror(errno));
+	if (getsockname(fd, (struct sockaddr *)addr, &len) < 0)
+		die("getsockname() failed: %s\n", strerror(errno));
+
+	/* best effort: overflowing datagrams are dropped, not blocked */
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	return fd;
+}
+
+int bench_net_sendmmsg(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct bench_mmsghdr *mmsg;
+	struct sockaddr_in addr;
+	struct iovec iov;
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	char *buf;
+	int rx, tx, i, sent = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_sendmmsg_usage, 0);
+
+	if (packets <= 0 || size <= 0)
+		die("number of datagrams and size must be positive\n");
+	if (batch <= 0 || batch > BATCH_MAX)
+		die("batch must be between 1 and %d\n", BATCH_MAX);
+	if (only_sendmsg)
+		batch = 1;
+
+	rx = open_loopback(&addr);
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+	if (tx < 0)
+		die("socket() failed: %s\n", strerror(errno));
+
+	buf = zalloc(size);
+	mmsg = zalloc(batch * sizeof(*mmsg));
+	if (!buf || !mmsg)
+		die("memory allocation failed\n");
+
+	iov.iov_base = buf;
+	iov.iov_len = size;
+	for (i = 0; i < batch; i++) {
+		mmsg[i].msg_hdr.msg_name = &addr;
+		mmsg[i].msg_hdr.msg_namelen = sizeof(addr);
+		mmsg[i].msg_hdr.msg_iov = &iov;
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	gettimeofday(&start, NULL);
+
+	while (sent < packets) {
+		int n = packets - sent < batch ? packets - sent : batch;
+		int ret;
+
+		if (only_sendmsg)
+			ret = sendmsg(tx, &mmsg[0].msg_hdr, 0) < 0 ? -1 : 1;
+		else
+			ret = do_sendmmsg(tx, mmsg, n);
+
+		if (ret < 0) {
+			if (errno == ENOBUFS || errno == EAGAIN)
+				continue;
+			die("%s() failed: %s\n",
+			    only_sendmsg ? "sendmsg" : "sendmmsg",
+			    strerror(errno));
+		}
+		sent += ret;
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	close(tx);
+	close(rx);
+	free(mmsg);
+	free(buf);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		if (only_sendmsg)
+			printf("# Sending %d datagrams of %d bytes, "
+			       "one sendmsg() each\n\n", packets, size);
+		else
+			printf("# Sending %d datagrams of %d bytes, "
+			       "%d per sendmmsg()\n\n", packets, size, batch);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/packet\n",
+		       (double)result_usec / (double)packets);
+		printf(" %14d packets/sec\n",
+		       (int)((double)packets /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  net   ... network stack performance
+ *  fs    ... filesystem and VFS performance
  *
  */
 
@@ -52,12 +54,56 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "randaccess",
+	  "Random access to a large anonymous mapping",
+	  bench_mem_randaccess },
+	{ "xfer",
+	  "Data transfer between processes: process_vm_readv(), pipe, shm",
+	  bench_mem_xfer },
+	{ "swapstress",
+	  "Swapping out and in from many cpus at once",
+	  bench_mem_swapstress },
 	suite_all,
 	{ NULL,
 	  NULL,
 	  NULL             }
 };
 
+static struct bench_suite net_suites[] = {
+	{ "sendmmsg",
+	  "Flood of UDP datagrams over loopback, batched with sendmmsg()",
+	  bench_net_sendmmsg },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL               }
+};
+
+static struct bench_suite fs_suites[] = {
+	{ "stat",
+	  "Parallel stat() of the same path from many processes",
+	  bench_fs_stat },
+	{ "create",
+	  "Parallel creation and unlinking of files",
+	  bench_fs_create },
+	{ "randread",
+	  "Random direct reads of a heavily fragmented file",
+	  bench_fs_randread },
+	{ "seqwrite",
+	  "Small sequential writes to a file",
+	  bench_fs_seqwrite },
+	{ "lsdir",
+	  "Listing of a large directory with attributes, like ls -l",
+	  bench_fs_lsdir },
+	{ "fsync",
+	  "Latency of fsync() after small appends to a file",
+	  bench_fs_fsync },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL          }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -71,6 +117,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "net",
+	  "network stack performance",
+	  net_suites },
+	{ "fs",
+	  "filesystem and VFS performance",
+	  fs_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
@@ -0,0 +1,89 @@
+#!/bin/sh
+#
+# ext4 fast commit replay test: fsync a file on a filesystem mounted
+# with -o fast_commit, take a copy of the device as it is at that point,
+# which is what it would look like after a crash, and check that
+# mounting the copy brings back the size, blocks and contents the file
+# had at fsync() time from the fast commit area.
+#
+# Licensed under the terms of the GNU GPL License version 2.
+
+name=fast_commit_replay
+
+skip()
+{
+	echo "$name: $1 [SKIP]"
+	exit 0
+}
+
+fail()
+{
+	echo "$name: $1 [FAIL]"
+	exit 1
+}
+
+[ "$(id -u)" = 0 ] || skip "must be run as root"
+for prog in mkfs.ext4 e2fsck md5sum stat dd; do
+	command -v $prog > /dev/null 2>&1 || skip "$prog not found"
+done
+
+tmp=$(mktemp -d /tmp/$name.XXXXXX) || fail "cannot create scratch directory"
+img=$tmp/img
+crash=$tmp/crash.img
+mnt=$tmp/mnt
+
+cleanup()
+{
+	umount $mnt 2> /dev/null
+	rm -rf $tmp
+}
+trap cleanup EXIT
+
+mkdir $mnt
+dd if=/dev/zero of=$img bs=1M count=64 2> /dev/null ||
+	fail "cannot create image"
+mkfs.ext4 -q -F -b 4096 -J size=8 $img || fail "mkfs.ext4 failed"
+
+# A long commit interval keeps full commits out of the way
+mount -o loop,fast_commit,commit=600 $img $mnt 2> /dev/null ||
+	skip "cannot mount with -o fast_commit"
+
+# The file is created and synced by a full commit first, since
+# creating it changes the directory, which a fast commit cannot log
+f=$mnt/file
+dd if=/dev/urandom of=$f bs=4096 count=16 2> /dev/null
+sync
+
+# Then it is overwritten at the start and extended, and only fsync()ed
+dd if=/dev/urandom of=$f bs=4096 count=1 conv=notrunc 2> /dev/null
+dd if=/dev/urandom of=$f bs=4096 seek=16 count=3 conv=notrunc,fsync \
+	2> /dev/null || fail "write or fsync failed"
+
+size=$(stat -c %s $f)
+blocks=$(stat -c %b $f)
+sum=$(md5sum < $f)
+
+# The crash: the device as it is right after fsync() returned
+cp $img $crash || fail "cannot copy image"
+umount $mnt || fail "umount failed"
+
+before=$(dmesg | grep -c "replayed .* fast commit blocks")
+mount -o loop $crash $mnt || fail "mount after crash failed"
+after=$(dmesg | grep -c "replayed .* fast commit blocks")
+[ "$after" -gt "$before" ] || fail "no fast commit was replayed"
+
+[ "$(stat -c %s $f)" = "$size" ] ||
+	fail "size $(stat -c %s $f) after replay, expected $size"
+[ "$(stat -c %b $f)" = "$blocks" ] ||
+	fail "$(stat -c %b $f) blocks after replay, expected $blocks"
+[ "$(md5sum < $f)" = "$sum" ] || fail "contents differ after replay"
+
+# The replay has to leave the bitmaps matching the inode
+umount $mnt || fail "umount after replay failed"
+e2fsck -fn $crash > $tmp/fsck.log 2>&1 || {
+	cat $tmp/fsck.log
+	fail "e2fsck found errors after replay"
+}
+
+echo "$name: [PASS]"
+exit 0
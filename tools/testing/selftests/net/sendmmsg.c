@@ -0,0 +1,174 @@
+/*
+ * sendmmsg() tests: send batches of UDP datagrams over loopback and check
+ * what arrives, what is returned, and how an error in the middle of a
+ * batch is reported.
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef __NR_sendmmsg
+#if defined(__x86_64__)
+#define __NR_sendmmsg	307
+#elif defined(__i386__)
+#define __NR_sendmmsg	345
+#elif defined(__arm__)
+#define __NR_sendmmsg	374
+#else
+#error "__NR_sendmmsg unknown for this architecture"
+#endif
+#endif
+
+#define BATCH	8
+#define MSGSZ	64
+
+struct mmsg {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+};
+
+static int failed;
+
+#define check(cond, fmt, ...)						\
+	do {								\
+		if (!(cond)) {						\
+			printf("sendmmsg: " fmt " [FAIL]\n", ##__VA_ARGS__); \
+			failed = 1;					\
+		}							\
+	} while (0)
+
+static int do_sendmmsg(int fd, struct mmsg *vec, unsigned int vlen)
+{
+	return syscall(__NR_sendmmsg, fd, vec, vlen, 0);
+}
+
+static struct sockaddr_in dst;
+static char bufs[BATCH][MSGSZ];
+static struct iovec iovs[BATCH];
+static struct mmsg vec[BATCH];
+
+static void setup_batch(int n)
+{
+	int i;
+
+	memset(vec, 0, sizeof(vec));
+	for (i = 0; i < n; i++) {
+		memset(bufs[i], 'a' + i, MSGSZ);
+		iovs[i].iov_base = bufs[i];
+		iovs[i].iov_len = MSGSZ - i;
+		vec[i].msg_hdr.msg_name = &dst;
+		vec[i].msg_hdr.msg_namelen = sizeof(dst);
+		vec[i].msg_hdr.msg_iov = &iovs[i];
+		vec[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+/* Receive what was sent, in order, and drain anything else */
+static void check_received(int rfd, int n)
+{
+	char buf[MSGSZ + 1];
+	int i, len;
+
+	for (i = 0; i < n; i++) {
+		len = recv(rfd, buf, sizeof(buf), MSG_DONTWAIT);
+		check(len == MSGSZ - i, "datagram %d: length %d", i, len);
+		if (len > 0)
+			check(buf[0] == 'a' + i && buf[len - 1] == 'a' + i,
+			      "datagram %d: wrong contents", i);
+	}
+	len = recv(rfd, buf, sizeof(buf), MSG_DONTWAIT);
+	check(len < 0 && errno == EAGAIN, "unexpected datagram");
+}
+
+static int get_so_error(int fd)
+{
+	socklen_t len = sizeof(int);
+	int err = -1;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+		return -1;
+	return err;
+}
+
+int main(void)
+{
+	socklen_t len = sizeof(dst);
+	int sfd, rfd, ret, i;
+
+	rfd = socket(AF_INET, SOCK_DGRAM, 0);
+	sfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rfd < 0 || sfd < 0) {
+		perror("socket");
+		return 1;
+	}
+	memset(&dst, 0, sizeof(dst));
+	dst.sin_family = AF_INET;
+	dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(rfd, (struct sockaddr *)&dst, sizeof(dst)) < 0 ||
+	    getsockname(rfd, (struct sockaddr *)&dst, &len) < 0) {
+		perror("bind");
+		return 1;
+	}
+
+	/* a whole batch goes out, and each msg_len is filled in */
+	setup_batch(BATCH);
+	ret = do_sendmmsg(sfd, vec, BATCH);
+	if (ret < 0 && errno == ENOSYS) {
+		printf("sendmmsg: not supported [SKIP]\n");
+		return 0;
+	}
+	check(ret == BATCH, "full batch returned %d (%s)", ret,
+	      ret < 0 ? strerror(errno) : "short");
+	for (i = 0; i < BATCH; i++)
+		check(vec[i].msg_len == MSGSZ - i, "msg_len[%d] is %u",
+		      i, vec[i].msg_len);
+	check_received(rfd, ret > 0 ? ret : 0);
+
+	/* nothing to send */
+	ret = do_sendmmsg(sfd, vec, 0);
+	check(ret == 0, "empty batch returned %d", ret);
+
+	/* an error on the first datagram is returned directly */
+	setup_batch(1);
+	vec[0].msg_hdr.msg_namelen = 1;
+	ret = do_sendmmsg(sfd, vec, 1);
+	check(ret == -1 && errno == EINVAL, "bad first datagram: %d", ret);
+	check(get_so_error(sfd) == 0, "error left pending after failure");
+
+	/* an error later on stops the batch and is left pending */
+	setup_batch(4);
+	vec[2].msg_hdr.msg_namelen = 1;
+	ret = do_sendmmsg(sfd, vec, 4);
+	check(ret == 2, "partial batch returned %d", ret);
+	check_received(rfd, ret > 0 ? ret : 0);
+	ret = get_so_error(sfd);
+	check(ret == EINVAL, "SO_ERROR after partial batch is %d", ret);
+	ret = get_so_error(sfd);
+	check(ret == 0, "SO_ERROR not cleared, still %d", ret);
+
+	/* not a socket */
+	ret = do_sendmmsg(0, vec, 1);
+	check(ret == -1 && (errno == ENOTSOCK || errno == EBADF),
+	      "non-socket returned %d", ret);
+
+	close(sfd);
+	close(rfd);
+
+	if (failed)
+		return 1;
+	printf("sendmmsg: [PASS]\n");
+	return 0;
+}
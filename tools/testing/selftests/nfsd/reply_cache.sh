@@ -0,0 +1,96 @@
+#!/bin/sh
+#
+# nfsd duplicate reply cache test: export a local directory, mount it
+# over localhost with NFSv3, drive it with many client processes doing
+# creates and unlinks (perf bench fs create), and check the counters in
+# /proc/fs/nfsd/reply_cache_stats.
+#
+# Every CREATE and REMOVE is cached, so each one has to show up as a
+# miss.  There are no retransmits over loopback, so no request may be
+# answered from the cache or missed on the checksum alone, and the
+# cache has to stay within its limit.
+#
+# Needs root, nfs-utils with rpc.mountd running, and perf built from
+# this tree in $PERF or in the PATH.
+#
+# Licensed under the terms of the GNU GPL License version 2.
+
+name=reply_cache
+procs=${PROCS:-16}
+files=${FILES:-100}
+loops=${LOOPS:-5}
+PERF=${PERF:-perf}
+
+skip()
+{
+	echo "$name: $1 [SKIP]"
+	exit 0
+}
+
+fail()
+{
+	echo "$name: $1 [FAIL]"
+	exit 1
+}
+
+[ "$(id -u)" = 0 ] || skip "must be run as root"
+for prog in exportfs rpc.nfsd mount.nfs pidof; do
+	command -v $prog > /dev/null 2>&1 || skip "$prog not found"
+done
+pidof rpc.mountd > /dev/null || skip "rpc.mountd not running"
+$PERF bench fs 2>&1 | grep -q create || skip "perf bench fs create not found"
+
+stats=/proc/fs/nfsd/reply_cache_stats
+[ -e $stats ] || mount -t nfsd nfsd /proc/fs/nfsd 2> /dev/null
+[ -e $stats ] || skip "$stats not found"
+
+counter()
+{
+	sed -n "s/^$1: *//p" $stats
+}
+
+tmp=$(mktemp -d /tmp/$name.XXXXXX) || fail "cannot create scratch directory"
+export=$tmp/export
+mnt=$tmp/mnt
+
+cleanup()
+{
+	umount $mnt 2> /dev/null
+	exportfs -u localhost:$export 2> /dev/null
+	rm -rf $tmp
+}
+trap cleanup EXIT
+
+mkdir $export $mnt
+rpc.nfsd 16 || fail "cannot start nfsd"
+exportfs -o rw,no_root_squash,insecure,sync localhost:$export ||
+	fail "cannot export $export"
+mount -t nfs -o vers=3,proto=tcp localhost:$export $mnt ||
+	fail "cannot mount $export over localhost"
+
+hits=$(counter "cache hits")
+misses=$(counter "cache misses")
+payload=$(counter "payload misses")
+
+$PERF bench fs create -p $procs -n $files -l $loops -d $mnt ||
+	fail "perf bench fs create failed"
+
+hits=$(($(counter "cache hits") - hits))
+misses=$(($(counter "cache misses") - misses))
+payload=$(($(counter "payload misses") - payload))
+entries=$(counter "num entries")
+max=$(counter "max entries")
+chain=$(counter "longest chain len")
+
+echo "$name: $misses misses, $hits hits, $payload payload misses," \
+     "$entries of $max entries, longest chain $chain"
+
+ops=$((procs * files * loops * 2))
+[ $misses -ge $ops ] || fail "$misses misses for $ops creates and unlinks"
+[ $hits = 0 ] || fail "$hits requests answered from the cache"
+[ $payload = 0 ] || fail "$payload payload misses"
+[ $entries -gt 0 ] || fail "cache is empty"
+[ $entries -le $max ] || fail "$entries entries, limit is $max"
+
+echo "$name: [PASS]"
+exit 0